@@ -1,20 +1,122 @@
+#include <string.h>
 #include "Endpoint.h"
 #include "NetUMP.h"
+#include "RTSafe.h"
 
-extern CNetUMPHandler* NetUMPHandler;
+#define STREAM_FORM_COMPLETE    0
+#define STREAM_FORM_START       1
+#define STREAM_FORM_CONTINUE    2
+#define STREAM_FORM_END         3
 
-void ProcessEndpointDiscovery (uint8_t Filter)
+static bool MIDI2Enabled = false;
+static bool JREnabled = false;
+static char EndpointName [ENDPOINT_NAME_MAX+1] = "";
+static TFunctionBlock FunctionBlocks [MAX_FUNCTION_BLOCKS];
+static unsigned int NumFunctionBlocks = 0;
+
+void EnableEndpointMIDI2 (void)
+{
+    MIDI2Enabled = true;
+}  // EnableEndpointMIDI2
+//-----------------------------------------------------------------------------
+
+void EnableEndpointJR (void)
+{
+    JREnabled = true;
+}  // EnableEndpointJR
+//-----------------------------------------------------------------------------
+
+void SetEndpointDiscoveryName (const char* Name)
+{
+    strncpy (EndpointName, Name, ENDPOINT_NAME_MAX);
+    EndpointName[ENDPOINT_NAME_MAX] = 0;
+}  // SetEndpointDiscoveryName
+//-----------------------------------------------------------------------------
+
+int AddFunctionBlock (const char* Name, uint8_t FirstGroup, uint8_t NumGroups, bool MIDI1)
+{
+    TFunctionBlock* Block;
+
+    if (NumFunctionBlocks>=MAX_FUNCTION_BLOCKS) return -1;
+    if ((FirstGroup>15)||(NumGroups==0)||(FirstGroup+NumGroups>16)) return -1;
+
+    Block = &FunctionBlocks[NumFunctionBlocks];
+    strncpy (Block->Name, Name, FUNCTION_BLOCK_NAME_MAX);
+    Block->Name[FUNCTION_BLOCK_NAME_MAX] = 0;
+    Block->FirstGroup = FirstGroup;
+    Block->NumGroups = NumGroups;
+    Block->MIDI1 = MIDI1;
+    return NumFunctionBlocks++;
+}  // AddFunctionBlock
+//-----------------------------------------------------------------------------
+
+unsigned int GetFunctionBlockCount (void)
+{
+    return NumFunctionBlocks;
+}  // GetFunctionBlockCount
+//-----------------------------------------------------------------------------
+
+const TFunctionBlock* GetFunctionBlock (unsigned int Block)
+{
+    if (Block>=NumFunctionBlocks) return 0;
+    return &FunctionBlocks[Block];
+}  // GetFunctionBlock
+//-----------------------------------------------------------------------------
+
+// Send a name in as many UMP Stream messages as needed (Form field : complete, start, continue, end)
+// Header gives the status and, for Function Block names, the block number in the first text byte (Prefix = 1)
+static void SendStreamText (CNetUMPHandler* Handler, uint32_t Header, unsigned int Prefix, const char* Text)
 {
     uint32_t UMPReply[4];
+    uint8_t Bytes[16];
+    unsigned int Len = strlen (Text);
+    unsigned int PerPacket = 14-Prefix;     // Two bytes in first word, 12 in the three others
+    unsigned int Pos = 0;
+    unsigned int Count;
+    unsigned int Form;
+
+    do
+    {
+        if (Pos==0)
+            Form = (Len<=PerPacket) ? STREAM_FORM_COMPLETE : STREAM_FORM_START;
+        else
+            Form = (Len-Pos<=PerPacket) ? STREAM_FORM_END : STREAM_FORM_CONTINUE;
+
+        Count = Len-Pos;
+        if (Count>PerPacket) Count = PerPacket;
+        memset (&Bytes[0], 0, sizeof(Bytes));
+        memcpy (&Bytes[2+Prefix], &Text[Pos], Count);
+        Pos += Count;
+
+        UMPReply[0] = Header|(Form<<26)|(Bytes[2]<<8)|Bytes[3];
+        for (unsigned int w=1; w<4; w++)
+            UMPReply[w] = ((uint32_t)Bytes[w*4]<<24)|(Bytes[w*4+1]<<16)|(Bytes[w*4+2]<<8)|Bytes[w*4+3];
+
+        Handler->SendUMPMessage(&UMPReply[0]);
+    } while (Pos<Len);
+}  // SendStreamText
+//-----------------------------------------------------------------------------
+
+void ProcessEndpointDiscovery (CNetUMPHandler* Handler, uint8_t Filter, uint8_t Protocol, uint8_t JR, const char* ProductInstanceID)
+{
+    uint32_t UMPReply[4];
+
+    RTSafeAssert("ProcessEndpointDiscovery");
 
     if (Filter&0x01)
     {  // e bit set : request Endpoint Info notification
         UMPReply[0]=0xF0010101;     // Endpoint Info notification, V=1.1
-        UMPReply[1]=0x80000100;     // Static Function Blocks, no Function Blocks, support : MIDI 1.0, don't support : MIDI 2.0, transmit JR, receive JR
+        if (MIDI2Enabled)
+            UMPReply[1]=0x80000300;     // Static Function Blocks, support : MIDI 1.0 and MIDI 2.0
+        else
+            UMPReply[1]=0x80000100;     // Static Function Blocks, support : MIDI 1.0, don't support : MIDI 2.0
+        if (JREnabled)
+            UMPReply[1]|=0x00000003;    // Receive JR, transmit JR
+        UMPReply[1]|=NumFunctionBlocks<<24;
         UMPReply[2]=0x00000000;     // Reserved
         UMPReply[3]=0x00000000;     // Reserved
 
-        NetUMPHandler->SendUMPMessage(&UMPReply[0]);
+        Handler->SendUMPMessage(&UMPReply[0]);
     }
 
     if (Filter&0x02)
@@ -24,38 +126,94 @@ void ProcessEndpointDiscovery (uint8_t Filter)
         UMPReply[2] = 0x00000100;       // Device family, Device family model : to be defined
         UMPReply[3] = 0x00010000;		// V0.1 		TODO : should come from a global definition
 
-        NetUMPHandler->SendUMPMessage(&UMPReply[0]);	   
+        Handler->SendUMPMessage(&UMPReply[0]);	   
     }
 
     if (Filter&0x04)
     {  // n bit set : request Endpoint Name notification
-        UMPReply[0]=0xF0035A79;     // Endpoint Name, Zy
-        UMPReply[1]=0x6E746869;     // nthi
-        UMPReply[2]=0x616E2056;     // an V
-        UMPReply[3]=0x35000000;     // 5
-
-        NetUMPHandler->SendUMPMessage(&UMPReply[0]);
+        SendStreamText(Handler, 0xF0030000, 0, EndpointName);
     }
 
     if (Filter&0x08)
     {  // i bit set : request Product Instance ID notification
-        // TODO : use MAC address or random number (as Zynthian does not have a serial number)
-        UMPReply[0]=0xF0045A59;     // Product Instance ID Name, ZY
-        UMPReply[1]=0x30303030;     // 0000
-        UMPReply[2]=0x30303031;     // 0001
-        UMPReply[3]=0x00000000;
-
-        NetUMPHandler->SendUMPMessage(&UMPReply[0]);
+        SendStreamText(Handler, 0xF0040000, 0, ProductInstanceID);
     }
 
     if (Filter&0x10)
     {  // s bit set : request Stream Configuration notification
-        UMPReply[0]=0xF0060100;     // Stream Configuration Notification, MIDI 1.0 protocol, no TX/RX jitter reduction
+        UMPReply[0]=0xF0060000|(Protocol<<8)|JR;     // Stream Configuration Notification, current protocol and JR settings
         UMPReply[1]=0x00000000;     // Reserved
         UMPReply[2]=0x00000000;     // Reserved
         UMPReply[3]=0x00000000;     // Reserved
 
-        NetUMPHandler->SendUMPMessage(&UMPReply[0]);
+        Handler->SendUMPMessage(&UMPReply[0]);
     }
 }  // ProcessEndpointDiscovery
 //-----------------------------------------------------------------------------
+
+void ProcessFunctionBlockDiscovery (CNetUMPHandler* Handler, uint8_t Block, uint8_t Filter)
+{
+    uint32_t UMPReply[4];
+    const TFunctionBlock* FB;
+    unsigned int First, Last;
+
+    RTSafeAssert("ProcessFunctionBlockDiscovery");
+
+    if (Block==0xFF)
+    {
+        First = 0;
+        Last = NumFunctionBlocks;
+    }
+    else
+    {
+        if (Block>=NumFunctionBlocks) return;       // Unknown block : no reply
+        First = Block;
+        Last = Block+1;
+    }
+
+    for (unsigned int b=First; b<Last; b++)
+    {
+        FB = &FunctionBlocks[b];
+
+        if (Filter&0x01)
+        {  // Function Block Info notification : active, bidirectional, UI hint sender and receiver
+            UMPReply[0]=0xF0118000|(b<<8)|0x30|0x03;
+            if (FB->MIDI1)
+                UMPReply[0]|=0x04;          // MIDI 1.0 port, don't restrict bandwidth
+            UMPReply[1]=(FB->FirstGroup<<24)|(FB->NumGroups<<16);   // No MIDI-CI, no SYSEX8 streams
+            UMPReply[2]=0x00000000;     // Reserved
+            UMPReply[3]=0x00000000;     // Reserved
+
+            Handler->SendUMPMessage(&UMPReply[0]);
+        }
+
+        if (Filter&0x02)
+        {  // Function Block Name notification
+            SendStreamText(Handler, 0xF0120000|(b<<8), 1, FB->Name);
+        }
+    }
+}  // ProcessFunctionBlockDiscovery
+//-----------------------------------------------------------------------------
+
+uint8_t ProcessStreamConfigRequest (CNetUMPHandler* Handler, uint32_t Request, uint8_t* JR)
+{
+    uint32_t UMPReply[4];
+    uint8_t Protocol;
+
+    RTSafeAssert("ProcessStreamConfigRequest");
+
+    // Only MIDI 1.0 and MIDI 2.0 protocols exist, JR Timestamps only when the jitter buffer is adaptive
+    Protocol=(Request>>8)&0xFF;
+    if ((Protocol!=UMP_PROTOCOL_MIDI2)||(!MIDI2Enabled))
+        Protocol=UMP_PROTOCOL_MIDI1;
+    *JR = JREnabled ? (Request&(UMP_JR_TX|UMP_JR_RX)) : 0;
+
+    UMPReply[0]=0xF0060000|(Protocol<<8)|*JR;     // Stream Configuration Notification
+    UMPReply[1]=0x00000000;     // Reserved
+    UMPReply[2]=0x00000000;     // Reserved
+    UMPReply[3]=0x00000000;     // Reserved
+
+    Handler->SendUMPMessage(&UMPReply[0]);
+    return Protocol;
+}  // ProcessStreamConfigRequest
+//-----------------------------------------------------------------------------
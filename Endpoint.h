@@ -3,6 +3,50 @@
 
 #include <stdint.h>
 
-void ProcessEndpointDiscovery (uint8_t Filter);
+#define UMP_PROTOCOL_MIDI1      0x01
+#define UMP_PROTOCOL_MIDI2      0x02
+
+#define UMP_JR_TX               0x01        // Stream Configuration : Endpoint sends JR Timestamps
+#define UMP_JR_RX               0x02        // Stream Configuration : Endpoint expects JR Timestamps
+
+#define MAX_FUNCTION_BLOCKS     7           // Each block has its own JACK port pair, next to the main ones
+#define ENDPOINT_NAME_MAX       98          // UMP 1.1 limits for the multi-packet names
+#define FUNCTION_BLOCK_NAME_MAX 91
+
+class CNetUMPHandler;
+
+typedef struct {
+    char Name [FUNCTION_BLOCK_NAME_MAX+1];
+    uint8_t FirstGroup;         // 0 to 15
+    uint8_t NumGroups;
+    bool MIDI1;                 // Block is connected to MIDI 1.0 JACK ports
+} TFunctionBlock;
+
+//! Advertise MIDI 2.0 Protocol support and accept it in Stream Configuration requests
+void EnableEndpointMIDI2 (void);
+
+//! Advertise JR Timestamps support (--jitter-buffer auto) and accept them in Stream Configuration requests
+//! Sessions start without JR Timestamps : they are only used once a peer has requested them
+void EnableEndpointJR (void);
+
+//! Name sent in Endpoint Name notifications (same as the one given to CNetUMPHandler::SetEndpointName)
+void SetEndpointDiscoveryName (const char* Name);
+
+//! Declare a static Function Block. Returns its number, -1 if there are too many blocks
+int AddFunctionBlock (const char* Name, uint8_t FirstGroup, uint8_t NumGroups, bool MIDI1);
+
+unsigned int GetFunctionBlockCount (void);
+const TFunctionBlock* GetFunctionBlock (unsigned int Block);
+
+//! Protocol and JR give the current Stream Configuration of the session. ProductInstanceID is the one advertised
+//! by mDNS for the session
+void ProcessEndpointDiscovery (CNetUMPHandler* Handler, uint8_t Filter, uint8_t Protocol, uint8_t JR, const char* ProductInstanceID);
+
+//! Answer a Function Block Discovery message (Block 0xFF : all blocks)
+void ProcessFunctionBlockDiscovery (CNetUMPHandler* Handler, uint8_t Block, uint8_t Filter);
+
+//! Answer a Stream Configuration Request. Returns the protocol to use from now on, JR receives the
+//! JR settings granted (UMP_JR_TX / UMP_JR_RX)
+uint8_t ProcessStreamConfigRequest (CNetUMPHandler* Handler, uint32_t Request, uint8_t* JR);
 
 #endif // __ENDPOINTDISCOVERY_H__
@@ -0,0 +1,349 @@
+/*
+ * EventLoop.cpp
+ * epoll/timerfd/eventfd based event loop used by the network thread
+ *
+ * The loop sleeps until a socket becomes readable, a timer expires or
+ * another thread (or a signal handler) calls WakeEventLoop()
+ *
+ * The realtime thread signals queued work with KickEventLoop() : it sets a flag,
+ * and writes the eventfd only when the loop is sleeping (one non-blocking write
+ * per wake-up at most). A busy loop sees the flag after its current iteration
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <atomic>
+#include "EventLoop.h"
+
+#define MAX_EVENT_SOURCES   32
+#define MAX_FD_SCAN         1024
+
+typedef struct {
+    int fd;
+    bool IsTimer;
+    TEventCallback Callback;
+    void* UserInstance;
+} TEventSource;
+
+static int EpollFD = -1;
+static int WakeFD = -1;
+static TEventSource Sources [MAX_EVENT_SOURCES];
+static std::atomic<bool> WorkQueued (false);
+static std::atomic<bool> LoopSleeping (false);
+static TEventCallback KickCallback = 0;
+static void* KickInstance = 0;
+
+static TEventSource* FindSource (int fd)
+{
+    for (unsigned int i=0; i<MAX_EVENT_SOURCES; i++)
+    {
+        if (Sources[i].fd==fd) return &Sources[i];
+    }
+    return 0;
+}  // FindSource
+// -------------------------------------------------------------
+
+static bool RegisterSource (int fd, bool IsTimer, TEventCallback Callback, void* UserInstance)
+{
+    struct epoll_event Event;
+    TEventSource* Source;
+
+    if (EpollFD<0) return false;
+    if (fd<0) return false;
+
+    Source = FindSource (-1);
+    if (Source==0)
+    {
+        fprintf (stderr, "EventLoop : too many event sources\n");
+        return false;
+    }
+
+    memset (&Event, 0, sizeof(Event));
+    Event.events = EPOLLIN;
+    Event.data.ptr = Source;
+    if (epoll_ctl (EpollFD, EPOLL_CTL_ADD, fd, &Event)<0)
+    {
+        fprintf (stderr, "EventLoop : can not watch descriptor %d (%s)\n", fd, strerror(errno));
+        return false;
+    }
+
+    Source->fd = fd;
+    Source->IsTimer = IsTimer;
+    Source->Callback = Callback;
+    Source->UserInstance = UserInstance;
+    return true;
+}  // RegisterSource
+// -------------------------------------------------------------
+
+bool InitEventLoop (TEventCallback WakeCallback, void* UserInstance)
+{
+    for (unsigned int i=0; i<MAX_EVENT_SOURCES; i++)
+    {
+        Sources[i].fd = -1;
+    }
+
+    EpollFD = epoll_create1 (EPOLL_CLOEXEC);
+    if (EpollFD<0)
+    {
+        fprintf (stderr, "EventLoop : can not create epoll instance (%s)\n", strerror(errno));
+        return false;
+    }
+
+    WakeFD = eventfd (0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (WakeFD<0)
+    {
+        fprintf (stderr, "EventLoop : can not create wake-up event (%s)\n", strerror(errno));
+        CloseEventLoop();
+        return false;
+    }
+
+    if (!RegisterSource (WakeFD, false, WakeCallback, UserInstance))
+    {
+        CloseEventLoop();
+        return false;
+    }
+    KickCallback = WakeCallback;
+    KickInstance = UserInstance;
+
+    return true;
+}  // InitEventLoop
+// -------------------------------------------------------------
+
+void CloseEventLoop (void)
+{
+    for (unsigned int i=0; i<MAX_EVENT_SOURCES; i++)
+    {
+        if ((Sources[i].fd>=0)&&(Sources[i].IsTimer))
+            close (Sources[i].fd);
+        Sources[i].fd = -1;
+    }
+
+    if (WakeFD>=0)
+    {
+        close (WakeFD);
+        WakeFD = -1;
+    }
+
+    if (EpollFD>=0)
+    {
+        close (EpollFD);
+        EpollFD = -1;
+    }
+}  // CloseEventLoop
+// -------------------------------------------------------------
+
+bool AddEventSource (int fd, TEventCallback Callback, void* UserInstance)
+{
+    return RegisterSource (fd, false, Callback, UserInstance);
+}  // AddEventSource
+// -------------------------------------------------------------
+
+void RemoveEventSource (int fd)
+{
+    TEventSource* Source;
+
+    Source = FindSource (fd);
+    if ((fd<0)||(Source==0)) return;
+
+    epoll_ctl (EpollFD, EPOLL_CTL_DEL, fd, 0);
+    Source->fd = -1;
+}  // RemoveEventSource
+// -------------------------------------------------------------
+
+int AddEventTimer (unsigned int PeriodMs, TEventCallback Callback, void* UserInstance)
+{
+    struct itimerspec Spec;
+    int TimerFD;
+
+    if (PeriodMs==0) return -1;
+
+    TimerFD = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (TimerFD<0)
+    {
+        fprintf (stderr, "EventLoop : can not create timer (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    Spec.it_interval.tv_sec = PeriodMs/1000;
+    Spec.it_interval.tv_nsec = (PeriodMs%1000)*1000000;
+    Spec.it_value = Spec.it_interval;
+    timerfd_settime (TimerFD, 0, &Spec, 0);
+
+    if (!RegisterSource (TimerFD, true, Callback, UserInstance))
+    {
+        close (TimerFD);
+        return -1;
+    }
+
+    return TimerFD;
+}  // AddEventTimer
+// -------------------------------------------------------------
+
+int AddEventOneShotTimer (TEventCallback Callback, void* UserInstance)
+{
+    int TimerFD;
+
+    TimerFD = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (TimerFD<0)
+    {
+        fprintf (stderr, "EventLoop : can not create timer (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    if (!RegisterSource (TimerFD, true, Callback, UserInstance))
+    {
+        close (TimerFD);
+        return -1;
+    }
+
+    return TimerFD;
+}  // AddEventOneShotTimer
+// -------------------------------------------------------------
+
+void ArmEventTimer (int TimerFD, unsigned int DelayMs)
+{
+    struct itimerspec Spec;
+
+    if (TimerFD<0) return;
+
+    memset (&Spec, 0, sizeof(Spec));
+    Spec.it_value.tv_sec = DelayMs/1000;
+    Spec.it_value.tv_nsec = (DelayMs%1000)*1000000;
+    if ((Spec.it_value.tv_sec==0)&&(Spec.it_value.tv_nsec==0))
+        Spec.it_value.tv_nsec = 1;      // Zero would disarm the timer
+    timerfd_settime (TimerFD, 0, &Spec, 0);
+}  // ArmEventTimer
+// -------------------------------------------------------------
+
+void RemoveEventTimer (int TimerFD)
+{
+    if (TimerFD<0) return;
+    RemoveEventSource (TimerFD);
+    close (TimerFD);
+}  // RemoveEventTimer
+// -------------------------------------------------------------
+
+void WakeEventLoop (void)
+{
+    uint64_t One = 1;
+
+    // write() is async-signal-safe, so this can be called from a signal handler
+    if (WakeFD>=0)
+    {
+        if (write (WakeFD, &One, sizeof(One))<0) { }
+    }
+}  // WakeEventLoop
+// -------------------------------------------------------------
+
+void KickEventLoop (void)
+{
+    // Pairs with RunEventLoop : either the loop sees WorkQueued before sleeping, or LoopSleeping is seen here
+    WorkQueued.store (true, std::memory_order_seq_cst);
+    if ((LoopSleeping.load (std::memory_order_seq_cst))&&(LoopSleeping.exchange (false, std::memory_order_seq_cst)))
+        WakeEventLoop();
+}  // KickEventLoop
+// -------------------------------------------------------------
+
+bool RunEventLoop (int TimeoutMs)
+{
+    struct epoll_event Events [MAX_EVENT_SOURCES];
+    TEventSource* Source;
+    uint64_t Count;
+    int NumEvents;
+    bool Kicked = false;
+
+    if (EpollFD<0) return false;
+
+    LoopSleeping.store (true, std::memory_order_seq_cst);
+    if (WorkQueued.load (std::memory_order_seq_cst))
+        TimeoutMs = 0;          // Queued before LoopSleeping was set : nobody will write the eventfd
+
+    NumEvents = epoll_wait (EpollFD, &Events[0], MAX_EVENT_SOURCES, TimeoutMs);
+    LoopSleeping.store (false, std::memory_order_relaxed);
+    if (NumEvents<0)
+    {
+        if (errno!=EINTR)
+        {
+            fprintf (stderr, "EventLoop : epoll_wait failed (%s)\n", strerror(errno));
+            return false;
+        }
+        NumEvents = 0;
+    }
+
+    if ((WorkQueued.load (std::memory_order_relaxed))&&(WorkQueued.exchange (false, std::memory_order_acquire)))
+    {
+        if (KickCallback)
+            KickCallback (KickInstance, 1);
+        Kicked = true;
+    }
+
+    for (int i=0; i<NumEvents; i++)
+    {
+        Source = (TEventSource*)Events[i].data.ptr;
+        if (Source->fd<0) continue;     // Removed by a previous callback
+
+        Count = 1;
+        if ((Source->IsTimer)||(Source->fd==WakeFD))
+        {
+            // Timers and eventfd must be read to rearm them
+            if (read (Source->fd, &Count, sizeof(Count))!=sizeof(Count))
+                continue;
+        }
+        if ((Source->fd==WakeFD)&&(Kicked)) continue;      // Same callback, already called for the kick
+
+        if (Source->Callback)
+            Source->Callback (Source->UserInstance, Count);
+    }
+
+    return true;
+}  // RunEventLoop
+// -------------------------------------------------------------
+
+int FindUDPSocketByPort (unsigned short Port)
+{
+    struct sockaddr_storage Addr;
+    socklen_t AddrLen;
+    int SockType;
+    socklen_t OptLen;
+    unsigned short BoundPort;
+
+    // The session socket is owned by the NetUMP library : look for the descriptor bound to our port
+    for (int fd=0; fd<MAX_FD_SCAN; fd++)
+    {
+        OptLen = sizeof(SockType);
+        if (getsockopt (fd, SOL_SOCKET, SO_TYPE, &SockType, &OptLen)<0) continue;
+        if (SockType!=SOCK_DGRAM) continue;
+
+        AddrLen = sizeof(Addr);
+        if (getsockname (fd, (struct sockaddr*)&Addr, &AddrLen)<0) continue;
+
+        if (Addr.ss_family==AF_INET)
+            BoundPort = ntohs (((struct sockaddr_in*)&Addr)->sin_port);
+        else if (Addr.ss_family==AF_INET6)
+            BoundPort = ntohs (((struct sockaddr_in6*)&Addr)->sin6_port);
+        else
+            continue;
+
+        if (BoundPort==Port) return fd;
+    }
+
+    return -1;
+}  // FindUDPSocketByPort
+// -------------------------------------------------------------
+
+uint64_t GetMonotonicMs (void)
+{
+    struct timespec Now;
+
+    clock_gettime (CLOCK_MONOTONIC, &Now);
+    return ((uint64_t)Now.tv_sec*1000)+(Now.tv_nsec/1000000);
+}  // GetMonotonicMs
+// -------------------------------------------------------------
@@ -0,0 +1,44 @@
+#ifndef __EVENTLOOP_H__
+#define __EVENTLOOP_H__
+
+#include <stdint.h>
+
+//! Called when a registered file descriptor becomes readable.
+//! For timers, Count is the number of expirations since last call, otherwise 1
+typedef void (*TEventCallback) (void* UserInstance, uint64_t Count);
+
+//! WakeCallback is called when another thread has called WakeEventLoop()
+bool InitEventLoop (TEventCallback WakeCallback, void* UserInstance);
+void CloseEventLoop (void);
+
+//! Watch a file descriptor for readability (level triggered)
+bool AddEventSource (int fd, TEventCallback Callback, void* UserInstance);
+void RemoveEventSource (int fd);
+
+//! Create a periodic CLOCK_MONOTONIC timer. Returns the timer descriptor or -1
+int AddEventTimer (unsigned int PeriodMs, TEventCallback Callback, void* UserInstance);
+void RemoveEventTimer (int TimerFD);
+
+//! Create a one-shot timer, not started. Returns the timer descriptor or -1
+int AddEventOneShotTimer (TEventCallback Callback, void* UserInstance);
+
+//! Start (or restart) a one-shot timer : its callback is called once, DelayMs from now
+void ArmEventTimer (int TimerFD, unsigned int DelayMs);
+
+//! Wake up the event loop from another thread or from a signal handler
+void WakeEventLoop (void);
+
+//! Signal work queued by the realtime thread : the loop calls the WakeCallback. The eventfd is written
+//! only if the loop is sleeping, it is the one (non-blocking) syscall allowed in the process callback
+void KickEventLoop (void);
+
+//! Wait for events and dispatch them. Returns false if the wait failed
+bool RunEventLoop (int TimeoutMs);
+
+//! Return the descriptor of the UDP socket bound to local Port, or -1
+int FindUDPSocketByPort (unsigned short Port);
+
+//! Monotonic clock in milliseconds
+uint64_t GetMonotonicMs (void);
+
+#endif // __EVENTLOOP_H__
@@ -0,0 +1,215 @@
+/*
+ * FEC.cpp
+ * Redundant transmission of note-off and state messages
+ *
+ * Works with MIDI 1.0 (MT 2) and MIDI 2.0 (MT 4) Channel Voice messages. A MT 2 Note On
+ * with velocity 0 is a Note Off, a MT 4 Note On is always a Note On
+ */
+
+#include <string.h>
+#include "FEC.h"
+
+enum {
+    FEC_CLASS_NONE,
+    FEC_CLASS_NOTE_ON,
+    FEC_CLASS_NOTE_OFF,
+    FEC_CLASS_STATE_CC
+};
+
+#define CC_SUSTAIN          64
+#define CC_ALL_SOUND_OFF    120
+#define CC_ALL_NOTES_OFF    123
+#define KEY_CC_FLAG         0x80000000
+
+static unsigned int FECDepth = 0;
+
+void SetFECDepth (unsigned int Depth)
+{
+    FECDepth = (Depth>FEC_MAX_DEPTH) ? FEC_MAX_DEPTH : Depth;
+}  // SetFECDepth
+// -------------------------------------------------------------
+
+unsigned int GetFECDepth (void)
+{
+    return FECDepth;
+}  // GetFECDepth
+// -------------------------------------------------------------
+
+static unsigned int ClassifyMessage (const uint32_t* UMP)
+{
+    unsigned int MT = UMP[0]>>28;
+    unsigned int Status = (UMP[0]>>20)&0x0F;
+    unsigned int Index;
+
+    if ((MT!=0x02)&&(MT!=0x04)) return FEC_CLASS_NONE;
+
+    if (Status==0x08) return FEC_CLASS_NOTE_OFF;
+    if (Status==0x09)
+    {
+        if ((MT==0x02)&&((UMP[0]&0x7F)==0)) return FEC_CLASS_NOTE_OFF;
+        return FEC_CLASS_NOTE_ON;
+    }
+    if (Status==0x0B)
+    {
+        Index = (UMP[0]>>8)&0x7F;
+        if ((Index==CC_SUSTAIN)||(Index==CC_ALL_SOUND_OFF)||(Index==CC_ALL_NOTES_OFF))
+            return FEC_CLASS_STATE_CC;
+    }
+    return FEC_CLASS_NONE;
+}  // ClassifyMessage
+// -------------------------------------------------------------
+
+//! Group, channel and note (or controller) of the message
+static uint32_t GetKey (const uint32_t* UMP, unsigned int Class)
+{
+    uint32_t Key = UMP[0]&0x0F0F7F00;
+
+    if (Class==FEC_CLASS_STATE_CC) Key|=KEY_CC_FLAG;
+    return Key;
+}  // GetKey
+// -------------------------------------------------------------
+
+static unsigned int GetCCSlot (unsigned int Index)
+{
+    if (Index==CC_SUSTAIN) return 0;
+    if (Index==CC_ALL_SOUND_OFF) return 1;
+    return 2;
+}  // GetCCSlot
+// -------------------------------------------------------------
+
+static uint32_t GetCCValue (const uint32_t* UMP)
+{
+    if ((UMP[0]>>28)==0x04) return UMP[1];
+    return UMP[0]&0x7F;
+}  // GetCCValue
+// -------------------------------------------------------------
+
+void InitFECTx (TFECTxState* State)
+{
+    State->Count = 0;
+}  // InitFECTx
+// -------------------------------------------------------------
+
+void InitFECRx (TFECRxState* State)
+{
+    memset (State, 0, sizeof(TFECRxState));
+}  // InitFECRx
+// -------------------------------------------------------------
+
+static void RemoveEntry (TFECTxState* State, unsigned int Index)
+{
+    State->Count--;
+    memmove (&State->Entries[Index], &State->Entries[Index+1], (State->Count-Index)*sizeof(TFECEntry));
+}  // RemoveEntry
+// -------------------------------------------------------------
+
+void AddFECMessage (TFECTxState* State, const uint32_t* UMP)
+{
+    unsigned int Class;
+    uint32_t Key;
+    uint32_t ChannelKey;
+    unsigned int e;
+    TFECEntry* Entry;
+
+    if (FECDepth==0) return;
+
+    Class = ClassifyMessage (UMP);
+    if (Class==FEC_CLASS_NONE) return;
+    Key = GetKey (UMP, Class);
+    ChannelKey = Key&0x0F0F0000;
+
+    e=0;
+    while (e<State->Count)
+    {
+        Entry = &State->Entries[e];
+        // Newer message for the same note or controller makes the copy obsolete.
+        // A Note On also cancels All Sound Off / All Notes Off copies of its channel
+        if ((Entry->Key==Key)||
+            ((Class==FEC_CLASS_NOTE_ON)&&((Entry->Key&KEY_CC_FLAG)!=0)&&((Entry->Key&0x0F0F0000)==ChannelKey)&&
+             (((Entry->Key>>8)&0x7F)!=CC_SUSTAIN)))
+        {
+            RemoveEntry (State, e);
+            continue;
+        }
+        e++;
+    }
+
+    if (Class==FEC_CLASS_NOTE_ON) return;
+
+    // Queue is full : oldest copies are given up
+    if (State->Count==FEC_QUEUE_SIZE)
+        RemoveEntry (State, 0);
+
+    Entry = &State->Entries[State->Count++];
+    Entry->Key = Key;
+    Entry->NumWords = ((UMP[0]>>28)==0x04) ? 2 : 1;
+    Entry->Words[0] = UMP[0];
+    Entry->Words[1] = (Entry->NumWords==2) ? UMP[1] : 0;
+    Entry->Remaining = FECDepth;
+}  // AddFECMessage
+// -------------------------------------------------------------
+
+unsigned int GetFECCopies (TFECTxState* State, uint32_t* Words, unsigned int MaxWords)
+{
+    unsigned int NumWords = 0;
+    unsigned int e = 0;
+    TFECEntry* Entry;
+
+    while (e<State->Count)
+    {
+        Entry = &State->Entries[e];
+        if (NumWords+Entry->NumWords>MaxWords) break;
+
+        memcpy (&Words[NumWords], &Entry->Words[0], Entry->NumWords*sizeof(uint32_t));
+        NumWords+=Entry->NumWords;
+
+        Entry->Remaining--;
+        if (Entry->Remaining==0)
+            RemoveEntry (State, e);
+        else
+            e++;
+    }
+    return NumWords;
+}  // GetFECCopies
+// -------------------------------------------------------------
+
+bool IsFECDuplicate (TFECRxState* State, const uint32_t* UMP)
+{
+    unsigned int Class = ClassifyMessage (UMP);
+    unsigned int Group = (UMP[0]>>24)&0x0F;
+    unsigned int Channel = (UMP[0]>>16)&0x0F;
+    unsigned int Note = (UMP[0]>>8)&0x7F;
+    uint32_t* Notes = &State->ActiveNotes[Group][Channel][0];
+    uint32_t Bit = 1u<<(Note&31);
+    TFECLastValue* Last;
+    uint32_t Value;
+
+    switch (Class)
+    {
+        case FEC_CLASS_NOTE_ON :
+            Notes[Note>>5] |= Bit;
+            // Next All Sound Off / All Notes Off is a new one
+            State->LastCC[Group][Channel][1].Known = false;
+            State->LastCC[Group][Channel][2].Known = false;
+            return false;
+
+        case FEC_CLASS_NOTE_OFF :
+            if ((Notes[Note>>5]&Bit)==0)
+                return true;        // Note is not playing : copy of a Note Off already received
+            Notes[Note>>5] &= ~Bit;
+            return false;
+
+        case FEC_CLASS_STATE_CC :
+            Last = &State->LastCC[Group][Channel][GetCCSlot (Note)];
+            Value = GetCCValue (UMP);
+            if ((Last->Known)&&(Last->Value==Value))
+                return true;
+            Last->Value = Value;
+            Last->Known = true;
+            if (Note!=CC_SUSTAIN)
+                memset (Notes, 0, 4*sizeof(uint32_t));
+            return false;
+    }
+    return false;
+}  // IsFECDuplicate
+// -------------------------------------------------------------
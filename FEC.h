@@ -0,0 +1,61 @@
+#ifndef __FEC_H__
+#define __FEC_H__
+
+/*
+ * FEC.h
+ * Redundant transmission of note-off and state messages (--fec-depth)
+ *
+ * Packets are built by the NetUMP library, so redundancy is done on messages : every
+ * message which can leave a note stuck (Note Off, Sustain, All Sound Off, All Notes Off)
+ * is sent again with the next bursts, up to Depth times. The receiver keeps the state of
+ * the notes and drops the copies before they reach the FIFO.
+ * Copies are cancelled when a newer message for the same note or controller is sent,
+ * so a late copy can never cut a new note.
+ */
+
+#include <stdint.h>
+
+#define FEC_MAX_DEPTH       4
+#define FEC_QUEUE_SIZE      64
+#define FEC_NUM_GROUPS      16
+
+typedef struct {
+    uint32_t Key;
+    uint32_t Words [2];
+    uint8_t NumWords;
+    uint8_t Remaining;          // Copies still to send
+} TFECEntry;
+
+typedef struct {
+    TFECEntry Entries [FEC_QUEUE_SIZE];
+    unsigned int Count;
+} TFECTxState;
+
+typedef struct {
+    uint32_t Value;
+    bool Known;
+} TFECLastValue;
+
+typedef struct {
+    uint32_t ActiveNotes [FEC_NUM_GROUPS][16][4];       // One bit per note
+    TFECLastValue LastCC [FEC_NUM_GROUPS][16][3];       // Sustain, All Sound Off, All Notes Off
+} TFECRxState;
+
+//! Number of copies sent after each protected message (0 : disabled)
+void SetFECDepth (unsigned int Depth);
+unsigned int GetFECDepth (void);
+
+void InitFECTx (TFECTxState* State);
+void InitFECRx (TFECRxState* State);
+
+//! Sender : record a message given to the network. Protected messages are queued for copies,
+//! pending copies made obsolete by this message are cancelled
+void AddFECMessage (TFECTxState* State, const uint32_t* UMP);
+
+//! Sender : get the copies to send now (one per pending message). Returns the number of words
+unsigned int GetFECCopies (TFECTxState* State, uint32_t* Words, unsigned int MaxWords);
+
+//! Receiver : returns true if the message is a copy of a message already received and must be dropped
+bool IsFECDuplicate (TFECRxState* State, const uint32_t* UMP);
+
+#endif // __FEC_H__
@@ -0,0 +1,80 @@
+/*
+ * FIFOPolicy.cpp
+ * Overflow policies of the UMP2JACK FIFO
+ *
+ * Works with MIDI 1.0 (MT 2) and MIDI 2.0 (MT 4) Channel Voice messages, like FEC.cpp.
+ * Collapsible messages are those the output scheduler may merge (see OutputScheduler.h)
+ * SYSEX packets (MT 3 / MT 5) are NORMAL, the network thread tracks which messages are in progress
+ */
+
+#include <string.h>
+#include "OutputScheduler.h"
+#include "FIFOPolicy.h"
+
+#define CC_SUSTAIN              64
+#define CC_FIRST_CHANNEL_MODE   120
+
+static const char* PolicyNames [NUM_FIFO_POLICIES] = {"drop-newest", "drop-oldest", "priority"};
+
+bool ParseFIFOPolicy (const char* Name, unsigned int* Policy)
+{
+    for (unsigned int p=0; p<NUM_FIFO_POLICIES; p++)
+    {
+        if (strcmp (Name, PolicyNames[p])==0)
+        {
+            *Policy = p;
+            return true;
+        }
+    }
+    return false;
+}  // ParseFIFOPolicy
+// -------------------------------------------------------------
+
+const char* GetFIFOPolicyName (unsigned int Policy)
+{
+    if (Policy>=NUM_FIFO_POLICIES) return "unknown";
+    return PolicyNames[Policy];
+}  // GetFIFOPolicyName
+// -------------------------------------------------------------
+
+unsigned int GetFIFOMessageClass (uint32_t Word0, uint32_t Word1)
+{
+    unsigned int MT = Word0>>28;
+    unsigned int Status = (Word0>>20)&0x0F;
+    unsigned int Index;
+    uint32_t Key;
+    bool Released;
+
+    if ((MT!=0x02)&&(MT!=0x04)) return FIFO_MSG_NORMAL;
+
+    if (Status==0x08) return FIFO_MSG_CRITICAL;
+    if ((Status==0x09)&&(MT==0x02)&&((Word0&0x7F)==0)) return FIFO_MSG_CRITICAL;
+
+    if (Status==0x0B)
+    {
+        Index = (Word0>>8)&0x7F;
+        if (Index>=CC_FIRST_CHANNEL_MODE) return FIFO_MSG_CRITICAL;
+        if (Index==CC_SUSTAIN)
+        {
+            Released = (MT==0x02) ? ((Word0&0x7F)<64) : (Word1<0x80000000);
+            return Released ? FIFO_MSG_CRITICAL : FIFO_MSG_NORMAL;
+        }
+    }
+
+    if ((IsCoalesceCandidate (Word0))&&(GetCoalesceKey (Word0, &Key)))
+        return FIFO_MSG_COLLAPSIBLE;
+    return FIFO_MSG_NORMAL;
+}  // GetFIFOMessageClass
+// -------------------------------------------------------------
+
+unsigned int GetFIFOSysExPart (uint32_t Word0)
+{
+    unsigned int MT = Word0>>28;
+    unsigned int Status = (Word0>>20)&0x0F;
+
+    // Status 0 to 3 : complete, start, continue, end. MT 5 mixed data sets (status 8 and 9) are not SYSEX
+    if ((MT!=0x03)&&(MT!=0x05)) return FIFO_SYSEX_NONE;
+    if (Status>3) return FIFO_SYSEX_NONE;
+    return Status;
+}  // GetFIFOSysExPart
+// -------------------------------------------------------------
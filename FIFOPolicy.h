@@ -0,0 +1,64 @@
+#ifndef __FIFOPOLICY_H__
+#define __FIFOPOLICY_H__
+
+/*
+ * FIFOPolicy.h
+ * What happens to messages from the network when the UMP2JACK FIFO is full (--fifo-policy)
+ *
+ * drop-newest : the message which does not fit is dropped
+ * drop-oldest : the message is kept by the network thread, and the JACK thread is asked to
+ *               drop as many of the oldest messages of the FIFO at the beginning of next period.
+ *               When the oldest message is part of a SYSEX, the rest of that SYSEX is dropped too
+ * priority    : part of the FIFO is kept free for the messages which end notes. Controller and
+ *               pitch bend updates are refused first (merged with an update of the same controller
+ *               from the same packet when possible), then the other messages. Messages ending
+ *               notes are never dropped while the network thread has room to keep them : they
+ *               wait there until the JACK thread has read enough of the FIFO
+ *
+ * A SYSEX split over several packets is kept or refused as a whole : once its start packet is
+ * queued, the next packets of the message are handled like messages ending notes, and once its
+ * start packet is refused, the next ones are dropped up to the end packet
+ */
+
+#include <stdint.h>
+
+#define FIFO_RESERVE_DIVIDER    8           // Each priority class keeps 1/8 of the FIFO for the classes above
+
+enum {
+    FIFO_DROP_NEWEST,
+    FIFO_DROP_OLDEST,
+    FIFO_PRIORITY,
+    NUM_FIFO_POLICIES
+};
+
+enum {
+    FIFO_MSG_COLLAPSIBLE,       // Control Change and Pitch Bend : only the last value matters
+    FIFO_MSG_NORMAL,
+    FIFO_MSG_CRITICAL           // Note Off, Sustain release, Channel Mode messages (All Notes Off...)
+};
+
+enum {
+    FIFO_SYSEX_NONE,            // Complete SYSEX packet or not a SYSEX
+    FIFO_SYSEX_START,
+    FIFO_SYSEX_CONTINUE,
+    FIFO_SYSEX_END
+};
+
+//! Parse a policy name (drop-newest, drop-oldest or priority). Returns false if unknown
+bool ParseFIFOPolicy (const char* Name, unsigned int* Policy);
+
+const char* GetFIFOPolicyName (unsigned int Policy);
+
+//! Class of a message from its first two words (Word1 is only used for MT 4)
+unsigned int GetFIFOMessageClass (uint32_t Word0, uint32_t Word1);
+
+//! Position of a MT 3 / MT 5 packet in its SYSEX message
+unsigned int GetFIFOSysExPart (uint32_t Word0);
+
+//! Words which must stay free in the FIFO once a message of Class is queued (priority policy)
+static inline unsigned int GetFIFOReserve (unsigned int Class, unsigned int FIFOSize)
+{
+    return (FIFO_MSG_CRITICAL-Class)*(FIFOSize/FIFO_RESERVE_DIVIDER);
+}
+
+#endif // __FIFOPOLICY_H__
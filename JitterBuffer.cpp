@@ -0,0 +1,184 @@
+/*
+ * JitterBuffer.cpp
+ * Playout time of the messages received from the network
+ *
+ * All functions are called from the network thread. The playout frame is computed when
+ * the message is received and stored in the UMP2JACK FIFO with the message.
+ */
+
+#include <string.h>
+#include "JitterBuffer.h"
+
+#define JITTER_RELEASE          (1.0/512)   // Jitter estimate decrease per timestamp
+#define JR_MAX_GAP_TICKS        32768       // 16-bit JR Timestamps are unwrapped with the arrival time
+
+void InitJitterBuffer (TJitterBuffer* Buffer, double SampleRate, unsigned int FixedFrames, bool Adaptive)
+{
+    memset (Buffer, 0, sizeof(TJitterBuffer));
+    Buffer->SampleRate = SampleRate;
+    Buffer->FixedFrames = FixedFrames;
+    Buffer->MaxFrames = (unsigned int)(SampleRate*JITTER_MAX_MS/1000);
+    Buffer->MarginFrames = (unsigned int)(SampleRate*JITTER_MARGIN_MS/1000);
+    Buffer->Adaptive = Adaptive;
+    Buffer->Target = FixedFrames;
+    if (Buffer->MaxFrames<FixedFrames) Buffer->MaxFrames=FixedFrames;
+}  // InitJitterBuffer
+// -------------------------------------------------------------
+
+//! Least squares fit of the window minima
+static void FitEnvelope (TJitterBuffer* Buffer)
+{
+    double SumX=0, SumY=0, SumXX=0, SumXY=0;
+    double N = Buffer->NumMins;
+    double Denominator;
+
+    for (unsigned int i=0; i<Buffer->NumMins; i++)
+    {
+        SumX+=Buffer->MinX[i];
+        SumY+=Buffer->MinY[i];
+        SumXX+=Buffer->MinX[i]*Buffer->MinX[i];
+        SumXY+=Buffer->MinX[i]*Buffer->MinY[i];
+    }
+
+    Denominator = N*SumXX-SumX*SumX;
+    if ((Buffer->NumMins<2)||(Denominator<=0))
+    {
+        Buffer->Drift = 0;
+        Buffer->Offset = SumY/N;
+        return;
+    }
+
+    Buffer->Drift = (N*SumXY-SumX*SumY)/Denominator;
+    Buffer->Offset = (SumY-Buffer->Drift*SumX)/N;
+}  // FitEnvelope
+// -------------------------------------------------------------
+
+static void UpdateEstimate (TJitterBuffer* Buffer, double Transit)
+{
+    double X = Buffer->SenderFrames;
+    double Envelope;
+    double Excess;
+    double WindowFrames = Buffer->SampleRate*JITTER_WINDOW_MS/1000;
+
+    // Close the window : its minimum is a point of the envelope
+    if (X-Buffer->WindowStart>=WindowFrames)
+    {
+        Buffer->MinX[Buffer->MinPos] = Buffer->WindowMinX;
+        Buffer->MinY[Buffer->MinPos] = Buffer->WindowMin;
+        Buffer->MinPos = (Buffer->MinPos+1)%JITTER_NUM_WINDOWS;
+        if (Buffer->NumMins<JITTER_NUM_WINDOWS) Buffer->NumMins++;
+        FitEnvelope (Buffer);
+
+        Buffer->WindowStart = X;
+        Buffer->WindowMin = Transit;
+        Buffer->WindowMinX = X;
+    }
+    else if (Transit<Buffer->WindowMin)
+    {
+        Buffer->WindowMin = Transit;
+        Buffer->WindowMinX = X;
+    }
+
+    // A faster message than the envelope moves it down at once
+    Envelope = Buffer->Offset+Buffer->Drift*X;
+    if (Transit<Envelope)
+    {
+        Buffer->Offset+=Transit-Envelope;
+        Envelope = Transit;
+    }
+
+    Excess = Transit-Envelope;
+    if (Excess>Buffer->Jitter)
+        Buffer->Jitter = Excess;
+    else
+        Buffer->Jitter-= (Buffer->Jitter-Excess)*JITTER_RELEASE;
+
+    Buffer->Target = Buffer->Jitter+Buffer->MarginFrames;
+    if (Buffer->Target<Buffer->FixedFrames) Buffer->Target=Buffer->FixedFrames;
+    if (Buffer->Target>Buffer->MaxFrames) Buffer->Target=Buffer->MaxFrames;
+}  // UpdateEstimate
+// -------------------------------------------------------------
+
+void JitterBufferTimestamp (TJitterBuffer* Buffer, uint16_t Timestamp, uint32_t ArrivalFrame)
+{
+    int64_t ExpectedTicks;
+    int16_t Correction;
+    double Transit;
+
+    if (!Buffer->Adaptive) return;
+
+    if (!Buffer->Started)
+    {
+        Buffer->Started = true;
+        Buffer->SenderTicks = 0;
+        Buffer->LocalFrames = 0;
+        Buffer->LocalOrigin = ArrivalFrame;
+        Buffer->SenderFrames = 0;
+        Buffer->WindowStart = 0;
+        Buffer->WindowMin = 0;
+        Buffer->WindowMinX = 0;
+        Buffer->Offset = 0;
+        Buffer->Drift = 0;
+    }
+    else
+    {
+        Buffer->LocalFrames+=(int32_t)(ArrivalFrame-Buffer->LastArrival);
+
+        // Timestamp wraps every 2 seconds : take the value closest to the elapsed local time
+        ExpectedTicks = (int64_t)((double)(int32_t)(ArrivalFrame-Buffer->LastArrival)*JR_TICKS_PER_SECOND/Buffer->SampleRate);
+        if (ExpectedTicks<JR_MAX_GAP_TICKS)
+            ExpectedTicks = 0;
+        Correction = (int16_t)(Timestamp-(uint16_t)(Buffer->LastJR+ExpectedTicks));
+        Buffer->SenderTicks+=ExpectedTicks+Correction;
+        Buffer->SenderFrames = (double)Buffer->SenderTicks*Buffer->SampleRate/JR_TICKS_PER_SECOND;
+    }
+
+    Buffer->LastJR = Timestamp;
+    Buffer->LastArrival = ArrivalFrame;
+    Buffer->PacketHasTime = true;
+
+    Transit = (double)Buffer->LocalFrames-Buffer->SenderFrames;
+    UpdateEstimate (Buffer, Transit);
+}  // JitterBufferTimestamp
+// -------------------------------------------------------------
+
+void JitterBufferEndOfPacket (TJitterBuffer* Buffer)
+{
+    Buffer->PacketHasTime = false;
+}  // JitterBufferEndOfPacket
+// -------------------------------------------------------------
+
+uint32_t GetPlayoutFrame (TJitterBuffer* Buffer, uint32_t ArrivalFrame, uint32_t PeriodFrames)
+{
+    uint32_t Playout;
+    double Local;
+
+    if ((Buffer->Adaptive)&&(Buffer->PacketHasTime))
+    {
+        // Sender time mapped on the local clock, plus the transit of the fastest messages and the jitter delay
+        Local = Buffer->SenderFrames+Buffer->Offset+Buffer->Drift*Buffer->SenderFrames+Buffer->Target;
+        Playout = Buffer->LocalOrigin+(uint32_t)(int64_t)Local+PeriodFrames;
+
+        // Latency stays bounded even if the estimate is wrong
+        if ((int32_t)(Playout-ArrivalFrame)>(int32_t)(PeriodFrames+Buffer->MaxFrames))
+            Playout = ArrivalFrame+PeriodFrames+Buffer->MaxFrames;
+    }
+    else
+    {
+        Playout = ArrivalFrame+PeriodFrames+Buffer->FixedFrames;
+    }
+
+    // Messages are played in the order they are received
+    if ((Buffer->HasPlayout)&&((int32_t)(Playout-Buffer->LastPlayout)<0))
+        Playout = Buffer->LastPlayout;
+    Buffer->LastPlayout = Playout;
+    Buffer->HasPlayout = true;
+    return Playout;
+}  // GetPlayoutFrame
+// -------------------------------------------------------------
+
+unsigned int GetJitterBufferDelay (const TJitterBuffer* Buffer)
+{
+    return (unsigned int)Buffer->Target;
+}  // GetJitterBufferDelay
+// -------------------------------------------------------------
@@ -0,0 +1,73 @@
+#ifndef __JITTERBUFFER_H__
+#define __JITTERBUFFER_H__
+
+/*
+ * JitterBuffer.h
+ * Playout time of the messages received from the network (--jitter-buffer)
+ *
+ * Fixed mode : messages are played one JACK period after their arrival, plus a fixed delay.
+ * Adaptive mode : when the peer sends JR Timestamps, the sender clock is mapped on the JACK
+ * frame clock (offset and drift, estimated on the lower envelope of the transit times), so
+ * messages are played with the spacing they were sent with. The delay added on top of the
+ * fastest transit follows the observed jitter, within JITTER_MAX_MS.
+ * Messages without timestamp use the fixed mode.
+ */
+
+#include <stdint.h>
+
+#define JITTER_MAX_MS           50          // Upper bound of the adaptive delay
+#define JITTER_MARGIN_MS        1           // Added to the observed jitter
+#define JITTER_WINDOW_MS        1000        // Transit time minimum is taken over windows of this length
+#define JITTER_NUM_WINDOWS      8           // Offset and drift are fitted on the last minima
+#define JR_TICKS_PER_SECOND     31250
+
+typedef struct {
+    double SampleRate;
+    unsigned int FixedFrames;
+    unsigned int MaxFrames;
+    unsigned int MarginFrames;
+    bool Adaptive;
+
+    // Sender clock, from JR Timestamps
+    bool Started;
+    bool PacketHasTime;         // Current packet carries a JR Timestamp
+    uint16_t LastJR;
+    uint32_t LastArrival;
+    int64_t SenderTicks;        // Unwrapped, from first JR Timestamp
+    int64_t LocalFrames;        // Unwrapped arrival time, from first JR Timestamp
+    uint32_t LocalOrigin;
+    double SenderFrames;        // Sender time of current packet, in local frames from origin
+
+    // Lower envelope of the transit time (arrival - sender time) : Offset + Drift*SenderFrames
+    double WindowStart;
+    double WindowMin;
+    double WindowMinX;
+    double MinX [JITTER_NUM_WINDOWS];
+    double MinY [JITTER_NUM_WINDOWS];
+    unsigned int NumMins;
+    unsigned int MinPos;
+    double Offset;
+    double Drift;
+
+    double Jitter;              // Peak transit time above the envelope, slowly released
+    double Target;              // Delay added to the envelope, in frames
+    uint32_t LastPlayout;
+    bool HasPlayout;
+} TJitterBuffer;
+
+//! FixedFrames is the delay of the fixed mode, and the minimum delay of the adaptive mode
+void InitJitterBuffer (TJitterBuffer* Buffer, double SampleRate, unsigned int FixedFrames, bool Adaptive);
+
+//! A JR Timestamp has been received, it applies to the following messages of the same packet
+void JitterBufferTimestamp (TJitterBuffer* Buffer, uint16_t Timestamp, uint32_t ArrivalFrame);
+
+//! The current packet has been processed
+void JitterBufferEndOfPacket (TJitterBuffer* Buffer);
+
+//! JACK frame at which a message arrived at ArrivalFrame must be played
+uint32_t GetPlayoutFrame (TJitterBuffer* Buffer, uint32_t ArrivalFrame, uint32_t PeriodFrames);
+
+//! Current adaptive delay, in frames
+unsigned int GetJitterBufferDelay (const TJitterBuffer* Buffer);
+
+#endif // __JITTERBUFFER_H__
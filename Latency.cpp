@@ -0,0 +1,245 @@
+/*
+ * Latency.cpp
+ * End-to-end latency measurement and probe reflector
+ *
+ * A probe goes through the following stages :
+ *  - out_queue   : injected by the process callback -> given to SendUMPMessage by the network thread
+ *  - network_rtt : sent -> echo received from the reflector (one way is estimated as half of it)
+ *  - fifo_wait   : received -> read from UMP2JACK by the process callback
+ *  - jack_period : read from the FIFO -> played, at its offset in the next period
+ *  - round_trip  : injected -> played
+ *
+ * Probe slots are handed from one thread to the other through the UMP rings, which
+ * order the accesses. Histograms are only updated by the JACK thread and read at exit.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "Latency.h"
+
+#define LATENCY_SLOTS           256         // Probes in flight, must be a power of two
+#define HISTOGRAM_BUCKET_US     50
+#define HISTOGRAM_BUCKETS       1000        // Up to 50 ms, slower probes go in the last bucket
+
+typedef struct {
+    uint16_t Sequence;
+    bool Active;
+    uint64_t InjectedUs;
+    uint64_t SentUs;
+    uint64_t ReceivedUs;
+} TLatencyProbe;
+
+typedef struct {
+    const char* Name;
+    uint32_t Buckets [HISTOGRAM_BUCKETS];
+    uint32_t Count;
+    uint64_t MinUs;
+    uint64_t MaxUs;
+    uint64_t SumUs;
+} THistogram;
+
+enum {
+    STAGE_OUT_QUEUE,
+    STAGE_NETWORK_RTT,
+    STAGE_FIFO_WAIT,
+    STAGE_JACK_PERIOD,
+    STAGE_ROUND_TRIP,
+    NUM_STAGES
+};
+
+static bool MeasureEnabled = false;
+static bool ReflectorEnabled = false;
+static uint64_t MeasureDurationUs = 0;
+static uint64_t ProbePeriodUs = 0;
+static uint64_t FirstProbeUs = 0;
+static uint64_t NextProbeUs = 0;
+static uint16_t NextSequence = 0;
+static uint32_t ProbesSent = 0;
+static uint32_t ProbesBack = 0;
+
+static TLatencyProbe Probes [LATENCY_SLOTS];
+static THistogram Histograms [NUM_STAGES];
+static const char* StageNames [NUM_STAGES] = {"out_queue", "network_rtt", "fifo_wait", "jack_period", "round_trip"};
+
+static TLatencyProbe* FindProbe (uint32_t Word)
+{
+    uint16_t Sequence = Word&0xFFFF;
+    TLatencyProbe* Probe = &Probes[Sequence&(LATENCY_SLOTS-1)];
+
+    // Probe may have been overwritten if it was lost long ago
+    if ((!Probe->Active)||(Probe->Sequence!=Sequence)) return 0;
+    return Probe;
+}  // FindProbe
+// -------------------------------------------------------------
+
+static void AddToHistogram (unsigned int Stage, uint64_t Start, uint64_t End)
+{
+    THistogram* Histogram = &Histograms[Stage];
+    uint64_t Delay = (End>Start) ? End-Start : 0;
+    uint64_t Bucket = Delay/HISTOGRAM_BUCKET_US;
+
+    if (Bucket>=HISTOGRAM_BUCKETS) Bucket=HISTOGRAM_BUCKETS-1;
+    Histogram->Buckets[Bucket]++;
+    if ((Histogram->Count==0)||(Delay<Histogram->MinUs)) Histogram->MinUs=Delay;
+    if (Delay>Histogram->MaxUs) Histogram->MaxUs=Delay;
+    Histogram->SumUs+=Delay;
+    Histogram->Count++;
+}  // AddToHistogram
+// -------------------------------------------------------------
+
+void EnableLatencyMeasure (unsigned int DurationSec, unsigned int PeriodMs)
+{
+    memset (&Probes[0], 0, sizeof(Probes));
+    memset (&Histograms[0], 0, sizeof(Histograms));
+    for (unsigned int s=0; s<NUM_STAGES; s++)
+        Histograms[s].Name=StageNames[s];
+
+    MeasureEnabled = true;
+    MeasureDurationUs = (uint64_t)DurationSec*1000000;
+    ProbePeriodUs = (uint64_t)PeriodMs*1000;
+}  // EnableLatencyMeasure
+// -------------------------------------------------------------
+
+bool IsLatencyMeasureEnabled (void)
+{
+    return MeasureEnabled;
+}  // IsLatencyMeasureEnabled
+// -------------------------------------------------------------
+
+bool IsLatencyMeasureDone (uint64_t NowUs)
+{
+    if ((!MeasureEnabled)||(MeasureDurationUs==0)||(FirstProbeUs==0)) return false;
+    // Leave one second for the last probes to come back
+    return NowUs>FirstProbeUs+MeasureDurationUs+1000000;
+}  // IsLatencyMeasureDone
+// -------------------------------------------------------------
+
+void EnableLatencyReflector (void)
+{
+    ReflectorEnabled = true;
+}  // EnableLatencyReflector
+// -------------------------------------------------------------
+
+bool IsLatencyReflectorEnabled (void)
+{
+    return ReflectorEnabled;
+}  // IsLatencyReflectorEnabled
+// -------------------------------------------------------------
+
+bool MakeLatencyProbe (uint64_t NowUs, uint32_t* Word)
+{
+    TLatencyProbe* Probe;
+
+    if (!MeasureEnabled) return false;
+    if (NowUs<NextProbeUs) return false;
+    if (FirstProbeUs==0) FirstProbeUs=NowUs;
+    if ((MeasureDurationUs!=0)&&(NowUs>FirstProbeUs+MeasureDurationUs)) return false;
+
+    NextProbeUs = NowUs+ProbePeriodUs;
+    Probe = &Probes[NextSequence&(LATENCY_SLOTS-1)];
+    Probe->Sequence = NextSequence;
+    Probe->Active = true;
+    Probe->InjectedUs = NowUs;
+    Probe->SentUs = 0;
+    Probe->ReceivedUs = 0;
+
+    *Word = LATENCY_PROBE_MARKER|NextSequence;
+    NextSequence++;
+    ProbesSent++;
+    return true;
+}  // MakeLatencyProbe
+// -------------------------------------------------------------
+
+void LatencyProbeSent (uint32_t Word, uint64_t NowUs)
+{
+    TLatencyProbe* Probe = FindProbe (Word);
+
+    if (Probe) Probe->SentUs=NowUs;
+}  // LatencyProbeSent
+// -------------------------------------------------------------
+
+void LatencyProbeReceived (uint32_t Word, uint64_t NowUs)
+{
+    TLatencyProbe* Probe = FindProbe (Word);
+
+    if ((Probe)&&(Probe->SentUs!=0)) Probe->ReceivedUs=NowUs;
+}  // LatencyProbeReceived
+// -------------------------------------------------------------
+
+void LatencyProbePlayed (uint32_t Word, uint64_t NowUs, uint64_t OutputUs)
+{
+    TLatencyProbe* Probe = FindProbe (Word);
+
+    if ((Probe==0)||(Probe->ReceivedUs==0)) return;
+
+    AddToHistogram (STAGE_OUT_QUEUE, Probe->InjectedUs, Probe->SentUs);
+    AddToHistogram (STAGE_NETWORK_RTT, Probe->SentUs, Probe->ReceivedUs);
+    AddToHistogram (STAGE_FIFO_WAIT, Probe->ReceivedUs, NowUs);
+    AddToHistogram (STAGE_JACK_PERIOD, NowUs, OutputUs);
+    AddToHistogram (STAGE_ROUND_TRIP, Probe->InjectedUs, OutputUs);
+    Probe->Active = false;
+    ProbesBack++;
+}  // LatencyProbePlayed
+// -------------------------------------------------------------
+
+//! Upper edge of the bucket containing the given percentile, in microseconds
+static uint64_t GetPercentile (const THistogram* Histogram, unsigned int Percent)
+{
+    uint64_t Target = ((uint64_t)Histogram->Count*Percent+99)/100;
+    uint64_t Total = 0;
+
+    for (unsigned int b=0; b<HISTOGRAM_BUCKETS; b++)
+    {
+        Total+=Histogram->Buckets[b];
+        if (Total>=Target)
+        {
+            if ((b==HISTOGRAM_BUCKETS-1)||((uint64_t)(b+1)*HISTOGRAM_BUCKET_US>Histogram->MaxUs))
+                return Histogram->MaxUs;
+            return (uint64_t)(b+1)*HISTOGRAM_BUCKET_US;
+        }
+    }
+    return Histogram->MaxUs;
+}  // GetPercentile
+// -------------------------------------------------------------
+
+static void PrintHistogram (const THistogram* Histogram, unsigned int Divider, const char* Name)
+{
+    if (Histogram->Count==0) return;
+
+    fprintf (stdout, "  %-16s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", Name,
+             (double)Histogram->MinUs/Divider/1000,
+             (double)Histogram->SumUs/Histogram->Count/Divider/1000,
+             (double)GetPercentile (Histogram, 50)/Divider/1000,
+             (double)GetPercentile (Histogram, 90)/Divider/1000,
+             (double)GetPercentile (Histogram, 99)/Divider/1000,
+             (double)Histogram->MaxUs/Divider/1000);
+}  // PrintHistogram
+// -------------------------------------------------------------
+
+void LatencyReport (void)
+{
+    const THistogram* Histogram;
+
+    if (!MeasureEnabled) return;
+
+    fprintf (stdout, "jacknetumpd : latency probes sent %u, received %u, lost %u\n", ProbesSent, ProbesBack, ProbesSent-ProbesBack);
+    if (ProbesBack==0) return;
+
+    fprintf (stdout, "  %-16s %8s %8s %8s %8s %8s %8s  (ms)\n", "stage", "min", "mean", "p50", "p90", "p99", "max");
+    for (unsigned int s=0; s<NUM_STAGES; s++)
+    {
+        PrintHistogram (&Histograms[s], 1, Histograms[s].Name);
+        // Both directions go through the same path, one way is estimated from the round trip
+        if (s==STAGE_NETWORK_RTT)
+            PrintHistogram (&Histograms[s], 2, "network_one_way");
+    }
+
+    fprintf (stdout, "  round_trip histogram (%u us buckets) :\n", HISTOGRAM_BUCKET_US);
+    Histogram = &Histograms[STAGE_ROUND_TRIP];
+    for (unsigned int b=0; b<HISTOGRAM_BUCKETS; b++)
+    {
+        if (Histogram->Buckets[b]==0) continue;
+        fprintf (stdout, "    %6u-%-6u us %8u\n", b*HISTOGRAM_BUCKET_US, (b+1)*HISTOGRAM_BUCKET_US, Histogram->Buckets[b]);
+    }
+}  // LatencyReport
+// -------------------------------------------------------------
@@ -0,0 +1,49 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+/*
+ * End-to-end latency measurement (--measure-latency) and probe reflector (--reflect)
+ *
+ * Probes are UMP JR Timestamp messages (MT 0, status 2) carrying a sequence number, with
+ * the reserved bits set so they are not taken for real timestamps by the jitter buffer.
+ * They are injected in the JACK process callback, follow the normal path to the
+ * network, are echoed by a peer running with --reflect and come back through the
+ * UMP2JACK FIFO. Each stage is timed with the JACK microsecond clock.
+ */
+
+#include <stdint.h>
+
+#define LATENCY_PROBE_MARKER    0x002F0000
+
+//! True if Word is a latency probe
+static inline bool IsLatencyProbe (uint32_t Word)
+{
+    return (Word&0xF0FF0000)==LATENCY_PROBE_MARKER;
+}
+
+//! Send one probe every PeriodMs, for DurationSec seconds (0 : until the daemon is stopped)
+void EnableLatencyMeasure (unsigned int DurationSec, unsigned int PeriodMs);
+bool IsLatencyMeasureEnabled (void);
+
+//! True when the measure duration has elapsed
+bool IsLatencyMeasureDone (uint64_t NowUs);
+
+void EnableLatencyReflector (void);
+bool IsLatencyReflectorEnabled (void);
+
+//! JACK thread : returns true and the probe word when a new probe must be sent
+bool MakeLatencyProbe (uint64_t NowUs, uint32_t* Word);
+
+//! Network thread : probe given to SendUMPMessage()
+void LatencyProbeSent (uint32_t Word, uint64_t NowUs);
+
+//! Network thread : echoed probe received from the peer
+void LatencyProbeReceived (uint32_t Word, uint64_t NowUs);
+
+//! JACK thread : probe read from the FIFO. OutputUs is the time its position in the JACK buffer is played
+void LatencyProbePlayed (uint32_t Word, uint64_t NowUs, uint64_t OutputUs);
+
+//! Print the histograms of each stage. Call when the JACK client is closed
+void LatencyReport (void);
+
+#endif // __LATENCY_H__
@@ -0,0 +1,162 @@
+/*
+ * MIDI2Convert.cpp
+ * Conversion between MIDI 2.0 Channel Voice messages (MT 4) and MIDI 1.0
+ *
+ * Values are scaled with the Min-Center-Max algorithm of the UMP specification,
+ * so that center values (pitch bend, pan...) stay exactly at center
+ */
+
+#include "MIDI2Convert.h"
+
+//! Upscale a value keeping min, center and max values
+static uint32_t ScaleUp (uint32_t Value, unsigned int SrcBits, unsigned int DstBits)
+{
+    unsigned int ScaleBits = DstBits-SrcBits;
+    uint32_t Shifted = Value<<ScaleBits;
+    uint32_t Center = 1<<(SrcBits-1);
+    unsigned int RepeatBits;
+    uint32_t Repeat;
+
+    if (Value<=Center) return Shifted;
+
+    // Fill the lower bits by repeating the value bits below the MSB
+    RepeatBits = SrcBits-1;
+    Repeat = Value&((1<<RepeatBits)-1);
+    if (ScaleBits>RepeatBits)
+        Repeat <<= ScaleBits-RepeatBits;
+    else
+        Repeat >>= RepeatBits-ScaleBits;
+
+    while (Repeat!=0)
+    {
+        Shifted |= Repeat;
+        Repeat >>= RepeatBits;
+    }
+    return Shifted;
+}  // ScaleUp
+// -------------------------------------------------------------
+
+static unsigned int MakeCC (uint8_t* MIDIMsg, uint8_t Channel, uint8_t Controller, uint8_t Value)
+{
+    MIDIMsg[0] = 0xB0|Channel;
+    MIDIMsg[1] = Controller;
+    MIDIMsg[2] = Value;
+    return 3;
+}  // MakeCC
+// -------------------------------------------------------------
+
+unsigned int TranscodeMIDI2_MIDI1 (const uint32_t* UMP, uint8_t* MIDIMsg)
+{
+    uint8_t Status = (UMP[0]>>20)&0x0F;
+    uint8_t Channel = (UMP[0]>>16)&0x0F;
+    uint8_t Index1 = (UMP[0]>>8)&0x7F;
+    uint8_t Index2 = UMP[0]&0x7F;
+    uint8_t Velocity;
+    unsigned int Len;
+
+    if ((UMP[0]>>28)!=0x04) return 0;
+
+    switch (Status)
+    {
+        case 0x8 :      // Note Off
+        case 0x9 :      // Note On
+            Velocity = UMP[1]>>25;
+            // Velocity 0 is a valid Note On in MIDI 2.0, but a Note Off in MIDI 1.0
+            if ((Status==0x9)&&(Velocity==0))
+                Velocity = 1;
+            MIDIMsg[0] = (Status<<4)|Channel;
+            MIDIMsg[1] = Index1;
+            MIDIMsg[2] = Velocity;
+            return 3;
+
+        case 0xA :      // Poly Pressure
+        case 0xB :      // Control Change
+            MIDIMsg[0] = (Status<<4)|Channel;
+            MIDIMsg[1] = Index1;
+            MIDIMsg[2] = UMP[1]>>25;
+            return 3;
+
+        case 0x2 :      // Registered Controller (RPN)
+        case 0x3 :      // Assignable Controller (NRPN)
+            Len = MakeCC (&MIDIMsg[0], Channel, (Status==0x2) ? 101 : 99, Index1);
+            Len += MakeCC (&MIDIMsg[Len], Channel, (Status==0x2) ? 100 : 98, Index2);
+            Len += MakeCC (&MIDIMsg[Len], Channel, 6, (UMP[1]>>25)&0x7F);
+            Len += MakeCC (&MIDIMsg[Len], Channel, 38, (UMP[1]>>18)&0x7F);
+            return Len;
+
+        case 0xC :      // Program Change, with optional Bank Select
+            Len = 0;
+            if (UMP[0]&0x01)
+            {
+                Len += MakeCC (&MIDIMsg[Len], Channel, 0, (UMP[1]>>8)&0x7F);
+                Len += MakeCC (&MIDIMsg[Len], Channel, 32, UMP[1]&0x7F);
+            }
+            MIDIMsg[Len++] = 0xC0|Channel;
+            MIDIMsg[Len++] = (UMP[1]>>24)&0x7F;
+            return Len;
+
+        case 0xD :      // Channel Pressure
+            MIDIMsg[0] = 0xD0|Channel;
+            MIDIMsg[1] = UMP[1]>>25;
+            return 2;
+
+        case 0xE :      // Pitch Bend
+            MIDIMsg[0] = 0xE0|Channel;
+            MIDIMsg[1] = (UMP[1]>>18)&0x7F;
+            MIDIMsg[2] = UMP[1]>>25;
+            return 3;
+    }
+
+    // Per-note and relative controllers have no MIDI 1.0 equivalent
+    return 0;
+}  // TranscodeMIDI2_MIDI1
+// -------------------------------------------------------------
+
+bool UpgradeMIDI1_MIDI2 (const uint32_t* UMP, uint32_t* MIDI2Msg)
+{
+    uint32_t Header = (UMP[0]&0x0FFF0000)|0x40000000;        // Keep group, status and channel
+    uint8_t Status = (UMP[0]>>20)&0x0F;
+    uint8_t Data1 = (UMP[0]>>8)&0x7F;
+    uint8_t Data2 = UMP[0]&0x7F;
+
+    if ((UMP[0]>>28)!=0x02) return false;
+
+    switch (Status)
+    {
+        case 0x9 :      // Note On, velocity 0 is a Note Off
+            if (Data2==0)
+            {
+                MIDI2Msg[0] = (Header&0xFF0FFFFF)|0x00800000|(Data1<<8);
+                MIDI2Msg[1] = ScaleUp (0x40, 7, 16)<<16;
+                return true;
+            }
+            // fall through
+        case 0x8 :      // Note Off
+            MIDI2Msg[0] = Header|(Data1<<8);
+            MIDI2Msg[1] = ScaleUp (Data2, 7, 16)<<16;
+            return true;
+
+        case 0xA :      // Poly Pressure
+        case 0xB :      // Control Change
+            MIDI2Msg[0] = Header|(Data1<<8);
+            MIDI2Msg[1] = ScaleUp (Data2, 7, 32);
+            return true;
+
+        case 0xC :      // Program Change
+            MIDI2Msg[0] = Header;
+            MIDI2Msg[1] = Data1<<24;
+            return true;
+
+        case 0xD :      // Channel Pressure
+            MIDI2Msg[0] = Header;
+            MIDI2Msg[1] = ScaleUp (Data1, 7, 32);
+            return true;
+
+        case 0xE :      // Pitch Bend, LSB first
+            MIDI2Msg[0] = Header;
+            MIDI2Msg[1] = ScaleUp ((Data2<<7)|Data1, 14, 32);
+            return true;
+    }
+    return false;
+}  // UpgradeMIDI1_MIDI2
+// -------------------------------------------------------------
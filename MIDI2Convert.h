@@ -0,0 +1,20 @@
+#ifndef __MIDI2CONVERT_H__
+#define __MIDI2CONVERT_H__
+
+/*
+ * MIDI2Convert.h
+ * Conversion between MIDI 2.0 Channel Voice messages (MT 4) and MIDI 1.0,
+ * following the translation rules of the UMP specification
+ */
+
+#include <stdint.h>
+
+#define MIDI2_MAX_MIDI1_BYTES   12      // RPN/NRPN become four Control Changes
+
+//! Convert a MT 4 message into one or several MIDI 1.0 messages. Returns the number of bytes, 0 if not convertible
+unsigned int TranscodeMIDI2_MIDI1 (const uint32_t* UMP, uint8_t* MIDIMsg);
+
+//! Convert a MT 2 (MIDI 1.0 Channel Voice) message into MT 4. Returns false if not convertible
+bool UpgradeMIDI1_MIDI2 (const uint32_t* UMP, uint32_t* MIDI2Msg);
+
+#endif // __MIDI2CONVERT_H__
@@ -0,0 +1,227 @@
+/*
+ * NetInterfaces.cpp
+ * Network interfaces and addresses, read from the kernel with netlink (rtnetlink)
+ *
+ * Links are dumped first (state, name, hardware address), then addresses are dumped
+ * and attached to the links kept. Dumps are synchronous, they are only done when
+ * starting and when the monitor reports a change
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "NetInterfaces.h"
+
+#define NETLINK_BUFFER_SIZE     16384
+
+// Send a dump request and call the parser for each message of the answer
+static bool NetlinkDump (int Socket, uint16_t Type, uint32_t Sequence, void (*Parser) (const nlmsghdr*, TNetInterface*, unsigned int*, unsigned int),
+                         TNetInterface* Interfaces, unsigned int* NumInterfaces, unsigned int MaxInterfaces)
+{
+    struct {
+        nlmsghdr Header;
+        rtgenmsg Message;
+    } Request;
+    sockaddr_nl Kernel;
+    uint8_t Buffer [NETLINK_BUFFER_SIZE];
+    ssize_t Len;
+    const nlmsghdr* Message;
+
+    memset (&Request, 0, sizeof(Request));
+    Request.Header.nlmsg_len = NLMSG_LENGTH(sizeof(rtgenmsg));
+    Request.Header.nlmsg_type = Type;
+    Request.Header.nlmsg_flags = NLM_F_REQUEST|NLM_F_DUMP;
+    Request.Header.nlmsg_seq = Sequence;
+    Request.Message.rtgen_family = AF_UNSPEC;
+
+    memset (&Kernel, 0, sizeof(Kernel));
+    Kernel.nl_family = AF_NETLINK;
+    if (sendto (Socket, &Request, Request.Header.nlmsg_len, 0, (sockaddr*)&Kernel, sizeof(Kernel))<0)
+        return false;
+
+    while (true)
+    {
+        Len = recv (Socket, Buffer, sizeof(Buffer), 0);
+        if (Len<0)
+        {
+            if (errno==EINTR) continue;
+            return false;
+        }
+
+        for (Message = (const nlmsghdr*)Buffer; NLMSG_OK(Message, (unsigned int)Len); Message = NLMSG_NEXT(Message, Len))
+        {
+            if (Message->nlmsg_seq!=Sequence) continue;
+            if (Message->nlmsg_type==NLMSG_DONE) return true;
+            if (Message->nlmsg_type==NLMSG_ERROR) return false;
+            Parser (Message, Interfaces, NumInterfaces, MaxInterfaces);
+        }
+    }
+}  // NetlinkDump
+// -------------------------------------------------------------
+
+static void ParseLink (const nlmsghdr* Message, TNetInterface* Interfaces, unsigned int* NumInterfaces, unsigned int MaxInterfaces)
+{
+    const ifinfomsg* Link = (const ifinfomsg*)NLMSG_DATA(Message);
+    const rtattr* Attribute;
+    int AttributesLen = IFLA_PAYLOAD(Message);
+    TNetInterface* Interface;
+
+    if (Message->nlmsg_type!=RTM_NEWLINK) return;
+    if ((Link->ifi_flags&IFF_UP)==0) return;
+    if (Link->ifi_flags&IFF_LOOPBACK) return;
+    if ((Link->ifi_flags&IFF_MULTICAST)==0) return;
+    if (*NumInterfaces>=MaxInterfaces) return;
+
+    Interface = &Interfaces[*NumInterfaces];
+    memset (Interface, 0, sizeof(TNetInterface));
+    Interface->Index = Link->ifi_index;
+
+    for (Attribute = IFLA_RTA(Link); RTA_OK(Attribute, AttributesLen); Attribute = RTA_NEXT(Attribute, AttributesLen))
+    {
+        if (Attribute->rta_type==IFLA_IFNAME)
+            snprintf (Interface->Name, sizeof(Interface->Name), "%s", (const char*)RTA_DATA(Attribute));
+        else if ((Attribute->rta_type==IFLA_ADDRESS)&&(RTA_PAYLOAD(Attribute)==6))
+        {
+            memcpy (Interface->MAC, RTA_DATA(Attribute), 6);
+            Interface->HasMAC = true;
+        }
+    }
+    (*NumInterfaces)++;
+}  // ParseLink
+// -------------------------------------------------------------
+
+static void ParseAddress (const nlmsghdr* Message, TNetInterface* Interfaces, unsigned int* NumInterfaces, unsigned int MaxInterfaces)
+{
+    const ifaddrmsg* Address = (const ifaddrmsg*)NLMSG_DATA(Message);
+    const rtattr* Attribute;
+    int AttributesLen = IFA_PAYLOAD(Message);
+    TNetInterface* Interface = 0;
+    const uint8_t* Data;
+
+    if (Message->nlmsg_type!=RTM_NEWADDR) return;
+    if (Address->ifa_flags&(IFA_F_TENTATIVE|IFA_F_DADFAILED)) return;
+
+    for (unsigned int i=0; i<*NumInterfaces; i++)
+    {
+        if (Interfaces[i].Index==(int)Address->ifa_index)
+            Interface = &Interfaces[i];
+    }
+    if (Interface==0) return;           // Down, loopback...
+
+    for (Attribute = IFA_RTA(Address); RTA_OK(Attribute, AttributesLen); Attribute = RTA_NEXT(Attribute, AttributesLen))
+    {
+        Data = (const uint8_t*)RTA_DATA(Attribute);
+
+        // IFA_LOCAL is the local address of point to point links, IFA_ADDRESS is the peer address then
+        if ((Address->ifa_family==AF_INET)&&(Attribute->rta_type==IFA_LOCAL))
+        {
+            if (Interface->NumIPv4<NET_MAX_ADDRESSES)
+                Interface->IPv4[Interface->NumIPv4++] = ((uint32_t)Data[0]<<24)|(Data[1]<<16)|(Data[2]<<8)|Data[3];
+        }
+        else if ((Address->ifa_family==AF_INET6)&&(Attribute->rta_type==IFA_ADDRESS))
+        {
+            if (Interface->NumIPv6<NET_MAX_ADDRESSES)
+                memcpy (Interface->IPv6[Interface->NumIPv6++], Data, 16);
+        }
+    }
+}  // ParseAddress
+// -------------------------------------------------------------
+
+unsigned int ReadNetInterfaces (TNetInterface* Interfaces, unsigned int MaxInterfaces)
+{
+    static uint32_t Sequence = 0;
+    unsigned int NumInterfaces = 0;
+    int Socket;
+    TNetInterface Swap;
+
+    Socket = socket (AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (Socket<0)
+    {
+        fprintf (stderr, "jacknetumpd : can not open netlink socket (%s)\n", strerror(errno));
+        return 0;
+    }
+
+    if ((!NetlinkDump (Socket, RTM_GETLINK, ++Sequence, &ParseLink, Interfaces, &NumInterfaces, MaxInterfaces))||
+        (!NetlinkDump (Socket, RTM_GETADDR, ++Sequence, &ParseAddress, Interfaces, &NumInterfaces, MaxInterfaces)))
+    {
+        fprintf (stderr, "jacknetumpd : can not read network interfaces (%s)\n", strerror(errno));
+        NumInterfaces = 0;
+    }
+    close (Socket);
+
+    // Kernel gives links by index most of the time, but this is not guaranteed
+    for (unsigned int i=1; i<NumInterfaces; i++)
+    {
+        for (unsigned int j=i; (j>0)&&(Interfaces[j-1].Index>Interfaces[j].Index); j--)
+        {
+            Swap = Interfaces[j];
+            Interfaces[j] = Interfaces[j-1];
+            Interfaces[j-1] = Swap;
+        }
+    }
+    return NumInterfaces;
+}  // ReadNetInterfaces
+// -------------------------------------------------------------
+
+int OpenNetInterfaceMonitor (void)
+{
+    sockaddr_nl Local;
+    int Monitor;
+
+    Monitor = socket (AF_NETLINK, SOCK_RAW|SOCK_NONBLOCK|SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (Monitor<0) return -1;
+
+    memset (&Local, 0, sizeof(Local));
+    Local.nl_family = AF_NETLINK;
+    Local.nl_groups = RTMGRP_LINK|RTMGRP_IPV4_IFADDR|RTMGRP_IPV6_IFADDR;
+    if (bind (Monitor, (sockaddr*)&Local, sizeof(Local))<0)
+    {
+        close (Monitor);
+        return -1;
+    }
+    return Monitor;
+}  // OpenNetInterfaceMonitor
+// -------------------------------------------------------------
+
+bool DrainNetInterfaceMonitor (int Monitor)
+{
+    uint8_t Buffer [NETLINK_BUFFER_SIZE];
+    ssize_t Len;
+    const nlmsghdr* Message;
+    bool Changed = false;
+
+    while ((Len = recv (Monitor, Buffer, sizeof(Buffer), 0))>0)
+    {
+        for (Message = (const nlmsghdr*)Buffer; NLMSG_OK(Message, (unsigned int)Len); Message = NLMSG_NEXT(Message, Len))
+        {
+            switch (Message->nlmsg_type)
+            {
+                case RTM_NEWLINK :
+                case RTM_DELLINK :
+                case RTM_NEWADDR :
+                case RTM_DELADDR :
+                    Changed = true;
+                    break;
+                default :
+                    break;
+            }
+        }
+    }
+
+    // Notifications lost (socket buffer overrun) : assume something changed
+    if ((Len<0)&&(errno==ENOBUFS))
+        Changed = true;
+    return Changed;
+}  // DrainNetInterfaceMonitor
+// -------------------------------------------------------------
+
+void CloseNetInterfaceMonitor (int Monitor)
+{
+    if (Monitor>=0)
+        close (Monitor);
+}  // CloseNetInterfaceMonitor
+// -------------------------------------------------------------
@@ -0,0 +1,41 @@
+#ifndef __NETINTERFACES_H__
+#define __NETINTERFACES_H__
+
+/*
+ * NetInterfaces.h
+ * Network interfaces and addresses, read from the kernel with netlink (rtnetlink)
+ *
+ * Only interfaces which are up, support multicast and are not loopback are listed,
+ * with their usable addresses (tentative or duplicate IPv6 addresses are skipped).
+ * A monitor socket becomes readable when a link or an address changes
+ */
+
+#include <stdint.h>
+#include <net/if.h>
+
+#define NET_MAX_INTERFACES          8
+#define NET_MAX_ADDRESSES           4           // Per family and interface
+
+typedef struct {
+    int Index;
+    char Name [IF_NAMESIZE];
+    uint8_t MAC [6];
+    bool HasMAC;
+    unsigned int NumIPv4;
+    uint32_t IPv4 [NET_MAX_ADDRESSES];          // Host byte order
+    unsigned int NumIPv6;
+    uint8_t IPv6 [NET_MAX_ADDRESSES][16];
+} TNetInterface;
+
+//! Read the interfaces, sorted by index. Returns the number of interfaces, 0 if netlink is not available
+unsigned int ReadNetInterfaces (TNetInterface* Interfaces, unsigned int MaxInterfaces);
+
+//! Open a netlink socket notified of link and address changes. Returns -1 on error
+int OpenNetInterfaceMonitor (void);
+
+//! Read the pending notifications. Returns true if one of them is a link or address change
+bool DrainNetInterfaceMonitor (int Monitor);
+
+void CloseNetInterfaceMonitor (int Monitor);
+
+#endif // __NETINTERFACES_H__
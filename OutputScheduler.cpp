@@ -0,0 +1,161 @@
+/*
+ * OutputScheduler.cpp
+ * Scheduling of the messages written to a JACK MIDI output port
+ *
+ * The coalescing table is a small open addressing hash, valid for one period only :
+ * slots are tagged with the period number, so nothing has to be cleared between periods.
+ * If the table is full, the remaining updates are simply written without merging
+ */
+
+#include <string.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "OutputScheduler.h"
+#include "Transcoder.h"
+
+#define KEY_PITCH_BEND      128
+
+void InitOutputScheduler (TOutputScheduler* Scheduler)
+{
+    Scheduler->Epoch = 0;
+    for (unsigned int i=0; i<COALESCE_SLOTS; i++)
+        Scheduler->Slots[i].Epoch = 0;
+    memset (&Scheduler->Superseded[0], 0, sizeof(Scheduler->Superseded));
+    Scheduler->MarkedEnd = 0;
+    Scheduler->PendingLen = 0;
+    Scheduler->PendingPort = 0;
+}  // InitOutputScheduler
+// -------------------------------------------------------------
+
+void BeginOutputPeriod (TOutputScheduler* Scheduler)
+{
+    // Only the part of the bitmap used in previous period has to be cleared
+    memset (&Scheduler->Superseded[0], 0, Scheduler->MarkedEnd*sizeof(uint64_t));
+    Scheduler->MarkedEnd = 0;
+
+    Scheduler->Epoch++;
+    if (Scheduler->Epoch==0)
+    {  // Wrapped around : slots tagged 0 must not look valid
+        InitOutputScheduler (Scheduler);
+        Scheduler->Epoch = 1;
+    }
+}  // BeginOutputPeriod
+// -------------------------------------------------------------
+
+bool GetCoalesceKey (uint32_t Word, uint32_t* Key)
+{
+    unsigned int Index;
+
+    // Candidates are Control Change and Pitch Bend only
+    if (((Word>>20)&0x0F)==0x0E)
+        Index = KEY_PITCH_BEND;
+    else
+    {
+        Index = (Word>>8)&0x7F;
+        // Bank Select, Data Entry, RPN/NRPN numbers and Data Increment/Decrement are parts of sequences
+        if ((Index==0)||(Index==6)||(Index==32)||(Index==38)) return false;
+        if ((Index>=96)&&(Index<=101)) return false;
+        // Switches (Sustain, Portamento, Sostenuto, Soft, Legato, Hold 2) and Channel Mode messages
+        if ((Index>=64)&&(Index<=69)) return false;
+        if (Index>=120) return false;
+    }
+
+    // Group, channel and controller
+    *Key = (((Word>>24)&0x0F)<<12)|(((Word>>16)&0x0F)<<8)|Index;
+    return true;
+}  // GetCoalesceKey
+// -------------------------------------------------------------
+
+static inline unsigned int HashKey (uint32_t Key)
+{
+    return ((Key*0x9E37u)>>8)&(COALESCE_SLOTS-1);
+}  // HashKey
+// -------------------------------------------------------------
+
+void RecordOutputMessage (TOutputScheduler* Scheduler, uint32_t Word, unsigned int Pos)
+{
+    TCoalesceSlot* Slot;
+    uint32_t Key;
+    unsigned int Index;
+
+    if (Pos>=COALESCE_MAX_WORDS) return;
+    if (!GetCoalesceKey (Word, &Key)) return;
+
+    Index = HashKey (Key);
+    for (unsigned int p=0; p<COALESCE_MAX_PROBES; p++)
+    {
+        Slot = &Scheduler->Slots[(Index+p)&(COALESCE_SLOTS-1)];
+        if (Slot->Epoch!=Scheduler->Epoch)
+        {
+            Slot->Epoch = Scheduler->Epoch;
+            Slot->Key = Key;
+            Slot->Pos = Pos;
+            return;
+        }
+        if (Slot->Key==Key)
+        {
+            // Previous update of this controller is replaced by this one
+            Scheduler->Superseded[Slot->Pos>>6] |= (uint64_t)1<<(Slot->Pos&63);
+            if ((Slot->Pos>>6)>=Scheduler->MarkedEnd)
+                Scheduler->MarkedEnd = (Slot->Pos>>6)+1;
+            Slot->Pos = Pos;
+            return;
+        }
+    }
+}  // RecordOutputMessage
+// -------------------------------------------------------------
+
+unsigned int WriteMIDI1Messages (void* PortBuffer, uint32_t Offset, const uint8_t* Bytes, unsigned int Size, unsigned int* NumEvents)
+{
+    jack_midi_data_t* Event;
+    unsigned int Pos = 0;
+    unsigned int Len;
+
+    while (Pos<Size)
+    {
+        // A single message is the usual case, no need to parse it
+        if (Size<=3)
+            Len = Size;
+        else
+        {
+            Len = GetMIDI1MessageLength (Bytes[Pos]);
+            if ((Len==0)||(Pos+Len>Size)) Len = Size-Pos;
+        }
+
+        // JACK refuses the event if the buffer can not hold it, nothing is written then
+        Event = jack_midi_event_reserve (PortBuffer, Offset, Len);
+        if (Event==0) break;
+        memcpy (Event, &Bytes[Pos], Len);
+        Pos += Len;
+        (*NumEvents)++;
+    }
+    return Pos;
+}  // WriteMIDI1Messages
+// -------------------------------------------------------------
+
+void KeepPendingMessages (TOutputScheduler* Scheduler, unsigned int Port, const uint8_t* Bytes, unsigned int Size)
+{
+    if (Size>MIDI2_MAX_MIDI1_BYTES) Size = MIDI2_MAX_MIDI1_BYTES;
+    memcpy (&Scheduler->Pending[0], Bytes, Size);
+    Scheduler->PendingLen = Size;
+    Scheduler->PendingPort = Port;
+}  // KeepPendingMessages
+// -------------------------------------------------------------
+
+bool WritePendingMessages (TOutputScheduler* Scheduler, void* PortBuffer, unsigned int* NumEvents)
+{
+    unsigned int Written;
+
+    if (Scheduler->PendingLen==0) return true;
+
+    Written = WriteMIDI1Messages (PortBuffer, 0, &Scheduler->Pending[0], Scheduler->PendingLen, NumEvents);
+    if (Written<Scheduler->PendingLen)
+    {
+        memmove (&Scheduler->Pending[0], &Scheduler->Pending[Written], Scheduler->PendingLen-Written);
+        Scheduler->PendingLen -= Written;
+        return false;
+    }
+    Scheduler->PendingLen = 0;
+    return true;
+}  // WritePendingMessages
+// -------------------------------------------------------------
@@ -0,0 +1,79 @@
+#ifndef __OUTPUTSCHEDULER_H__
+#define __OUTPUTSCHEDULER_H__
+
+/*
+ * OutputScheduler.h
+ * Scheduling of the messages written to a JACK MIDI output port
+ *
+ * Messages due in the period are scanned once before being written : for a continuous
+ * controller or a pitch bend, only the last update of each channel/controller in the
+ * period is written (last value wins). The scan marks the replaced updates in a bitmap
+ * indexed by FIFO position, so the write loop only tests one bit per message. Switches, mode messages and the controllers used
+ * in RPN/NRPN/Bank Select sequences are never merged, as their order matters.
+ * Messages are only written if the JACK buffer can hold them, otherwise they stay in
+ * the FIFO for next period. When a MIDI 2.0 message gives several MIDI 1.0 messages
+ * and only some of them fit, the rest is kept here and written first in next period.
+ */
+
+#include <stdint.h>
+#include "MIDI2Convert.h"
+
+#define COALESCE_SLOTS          256         // Must be a power of two
+#define COALESCE_MAX_PROBES     8
+#define COALESCE_MAX_WORDS      16384       // FIFO positions covered by the scan (default UMP2JACK FIFO size), later ones are not merged
+
+typedef struct {
+    uint32_t Epoch;             // Period the slot belongs to, older slots are free
+    uint32_t Key;
+    uint32_t Pos;               // FIFO position of the last update
+} TCoalesceSlot;
+
+typedef struct {
+    uint32_t Epoch;
+    TCoalesceSlot Slots [COALESCE_SLOTS];
+    uint64_t Superseded [COALESCE_MAX_WORDS/64];    // One bit per FIFO position
+    unsigned int MarkedEnd;                         // Bitmap words to clear in next period
+    uint8_t Pending [MIDI2_MAX_MIDI1_BYTES];
+    unsigned int PendingLen;
+    unsigned int PendingPort;                       // Port the pending messages go to
+} TOutputScheduler;
+
+//! Control Change or Pitch Bend (MT 2 or MT 4) : the only messages which may be merged
+static inline bool IsCoalesceCandidate (uint32_t Word)
+{
+    unsigned int MT = Word>>28;
+    unsigned int Status = (Word>>20)&0x0F;
+
+    return ((MT==0x02)||(MT==0x04))&&((Status==0x0B)||(Status==0x0E));
+}
+
+//! Key of a candidate (group, channel, controller). Returns false for messages which must be written
+//! even if a newer update follows (parts of RPN/NRPN/Bank Select sequences, switches, Channel Mode messages)
+bool GetCoalesceKey (uint32_t Word, uint32_t* Key);
+
+void InitOutputScheduler (TOutputScheduler* Scheduler);
+
+//! Forget the updates recorded in previous period
+void BeginOutputPeriod (TOutputScheduler* Scheduler);
+
+//! First pass : record the FIFO position of a candidate message due in the period
+void RecordOutputMessage (TOutputScheduler* Scheduler, uint32_t Word, unsigned int Pos);
+
+//! Second pass : true if a later update of the same channel/controller is due in the period
+static inline bool IsOutputSuperseded (const TOutputScheduler* Scheduler, unsigned int Pos)
+{
+    if (Pos>=COALESCE_MAX_WORDS) return false;
+    return (Scheduler->Superseded[Pos>>6]>>(Pos&63))&1;
+}
+
+//! Write MIDI 1.0 messages while they fit in the JACK buffer. Returns the number of bytes written,
+//! NumEvents is incremented for each message written
+unsigned int WriteMIDI1Messages (void* PortBuffer, uint32_t Offset, const uint8_t* Bytes, unsigned int Size, unsigned int* NumEvents);
+
+//! Keep the messages which could not be written to Port for next period
+void KeepPendingMessages (TOutputScheduler* Scheduler, unsigned int Port, const uint8_t* Bytes, unsigned int Size);
+
+//! Write the messages kept in previous period to the buffer of PendingPort. Returns false if they still do not fit
+bool WritePendingMessages (TOutputScheduler* Scheduler, void* PortBuffer, unsigned int* NumEvents);
+
+#endif // __OUTPUTSCHEDULER_H__
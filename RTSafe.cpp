@@ -0,0 +1,97 @@
+/*
+ * RTSafe.cpp
+ * Realtime safety self-check for the JACK process callback
+ *
+ * Two kinds of violations are detected :
+ *  - calls to functions marked with RTSafeAssert() (socket I/O paths)
+ *  - voluntary context switches during the callback, meaning something blocked
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <atomic>
+#include "RTSafe.h"
+
+static bool CheckEnabled = false;
+static thread_local bool InProcessCallback = false;
+static thread_local long SwitchesAtEnter = 0;
+
+static std::atomic<unsigned int> AssertViolations (0);
+static std::atomic<const char*> LastAssertViolation (nullptr);
+static std::atomic<unsigned int> BlockingViolations (0);
+static unsigned int ReportedAsserts = 0;
+static unsigned int ReportedBlockings = 0;
+
+void EnableRTSafeCheck (void)
+{
+    CheckEnabled = true;
+}  // EnableRTSafeCheck
+// -------------------------------------------------------------
+
+bool IsRTSafeCheckEnabled (void)
+{
+    return CheckEnabled;
+}  // IsRTSafeCheckEnabled
+// -------------------------------------------------------------
+
+void RTSafeEnterCallback (void)
+{
+    struct rusage Usage;
+
+    if (!CheckEnabled) return;
+
+    InProcessCallback = true;
+    // getrusage is itself a syscall, this is acceptable as the check is a debug mode
+    getrusage (RUSAGE_THREAD, &Usage);
+    SwitchesAtEnter = Usage.ru_nvcsw;
+}  // RTSafeEnterCallback
+// -------------------------------------------------------------
+
+void RTSafeLeaveCallback (void)
+{
+    struct rusage Usage;
+
+    if (!CheckEnabled) return;
+
+    getrusage (RUSAGE_THREAD, &Usage);
+    if (Usage.ru_nvcsw!=SwitchesAtEnter)
+        BlockingViolations.fetch_add (1, std::memory_order_relaxed);
+    InProcessCallback = false;
+}  // RTSafeLeaveCallback
+// -------------------------------------------------------------
+
+void RTSafeAssert (const char* What)
+{
+    if (!InProcessCallback) return;
+
+    LastAssertViolation.store (What, std::memory_order_relaxed);
+    AssertViolations.fetch_add (1, std::memory_order_relaxed);
+}  // RTSafeAssert
+// -------------------------------------------------------------
+
+void RTSafeReport (void)
+{
+    unsigned int Asserts;
+    unsigned int Blockings;
+    const char* What;
+
+    if (!CheckEnabled) return;
+
+    Asserts = AssertViolations.load (std::memory_order_relaxed);
+    if (Asserts!=ReportedAsserts)
+    {
+        What = LastAssertViolation.load (std::memory_order_relaxed);
+        fprintf (stderr, "jacknetumpd : RT check : %u call(s) to %s from the process callback\n",
+            Asserts-ReportedAsserts, What ? What : "?");
+        ReportedAsserts = Asserts;
+    }
+
+    Blockings = BlockingViolations.load (std::memory_order_relaxed);
+    if (Blockings!=ReportedBlockings)
+    {
+        fprintf (stderr, "jacknetumpd : RT check : process callback blocked %u time(s)\n", Blockings-ReportedBlockings);
+        ReportedBlockings = Blockings;
+    }
+}  // RTSafeReport
+// -------------------------------------------------------------
@@ -0,0 +1,26 @@
+#ifndef __RTSAFE_H__
+#define __RTSAFE_H__
+
+/*
+ * Self-check (--rt-safe) for code running in the JACK process callback
+ * Functions doing socket I/O call RTSafeAssert() : if they are reached from
+ * the process callback, the violation is recorded and reported later by the
+ * network thread (the callback itself can not print anything)
+ * The only syscall allowed is the eventfd write of KickEventLoop(), done when
+ * the network thread sleeps : it never blocks (EFD_NONBLOCK)
+ */
+
+void EnableRTSafeCheck (void);
+bool IsRTSafeCheckEnabled (void);
+
+//! Bracket the body of the process callback
+void RTSafeEnterCallback (void);
+void RTSafeLeaveCallback (void);
+
+//! Declare that the calling function must never run in the process callback
+void RTSafeAssert (const char* What);
+
+//! Print violations detected since last call. Must not be called from the process callback
+void RTSafeReport (void);
+
+#endif // __RTSAFE_H__
@@ -0,0 +1,114 @@
+/*
+ * RealTime.cpp
+ * Scheduling, CPU affinity and memory locking of the daemon threads
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "RealTime.h"
+
+#define PREFAULT_STACK_SIZE     (256*1024)      // Deepest stack used by the network thread, with margin
+
+bool ParseCPUSet (const char* List, cpu_set_t* Set)
+{
+    const char* Pos = List;
+    char* End;
+    long First, Last;
+
+    CPU_ZERO (Set);
+    while (*Pos)
+    {
+        First = strtol (Pos, &End, 10);
+        if ((End==Pos)||(First<0)||(First>=CPU_SETSIZE)) return false;
+        Last = First;
+        Pos = End;
+        if (*Pos=='-')
+        {
+            Pos++;
+            Last = strtol (Pos, &End, 10);
+            if ((End==Pos)||(Last<First)||(Last>=CPU_SETSIZE)) return false;
+            Pos = End;
+        }
+        for (long CPU=First; CPU<=Last; CPU++)
+            CPU_SET (CPU, Set);
+
+        if (*Pos==',') Pos++;
+        else if (*Pos!=0) return false;
+    }
+    return CPU_COUNT (Set)>0;
+}  // ParseCPUSet
+// -------------------------------------------------------------
+
+bool SetThreadRealtime (pthread_t Thread, int Priority, const char* Name)
+{
+    sched_param Param;
+    int Error;
+
+    memset (&Param, 0, sizeof(Param));
+    Param.sched_priority = Priority;
+    Error = pthread_setschedparam (Thread, SCHED_FIFO, &Param);
+    if (Error!=0)
+    {
+        fprintf (stderr, "jacknetumpd : can not run %s thread with SCHED_FIFO priority %d (%s)\n", Name, Priority, strerror(Error));
+        return false;
+    }
+    fprintf (stdout, "jacknetumpd : %s thread running with SCHED_FIFO priority %d\n", Name, Priority);
+    return true;
+}  // SetThreadRealtime
+// -------------------------------------------------------------
+
+bool SetThreadCPUs (pthread_t Thread, const cpu_set_t* Set, const char* Name)
+{
+    int Error;
+
+    Error = pthread_setaffinity_np (Thread, sizeof(cpu_set_t), Set);
+    if (Error!=0)
+    {
+        fprintf (stderr, "jacknetumpd : can not pin %s thread (%s)\n", Name, strerror(Error));
+        return false;
+    }
+    return true;
+}  // SetThreadCPUs
+// -------------------------------------------------------------
+
+//! Grow the stack now, so the pages are locked by MCL_FUTURE / MCL_CURRENT instead of being faulted in later
+static void PrefaultStack (void)
+{
+    uint8_t Stack [PREFAULT_STACK_SIZE];
+    volatile uint8_t* Touch = Stack;            // Writes can not be optimized out
+    long PageSize = sysconf (_SC_PAGESIZE);
+
+    for (long i=0; i<PREFAULT_STACK_SIZE; i+=PageSize)
+        Touch[i] = 0;
+}  // PrefaultStack
+// -------------------------------------------------------------
+
+bool LockMemory (void)
+{
+    if (mlockall (MCL_CURRENT|MCL_FUTURE)<0)
+    {
+        fprintf (stderr, "jacknetumpd : can not lock memory (%s), check RLIMIT_MEMLOCK\n", strerror(errno));
+        return false;
+    }
+    PrefaultStack ();
+    return true;
+}  // LockMemory
+// -------------------------------------------------------------
+
+void PrefaultMemory (void* Data, size_t Size)
+{
+    volatile uint8_t* Bytes = (volatile uint8_t*)Data;
+    long PageSize = sysconf (_SC_PAGESIZE);
+
+    // Written back with the same value : contents are kept, the page is mapped for writing
+    for (size_t i=0; i<Size; i+=PageSize)
+        Bytes[i] = Bytes[i];
+    if (Size>0)
+        Bytes[Size-1] = Bytes[Size-1];
+}  // PrefaultMemory
+// -------------------------------------------------------------
@@ -0,0 +1,34 @@
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+/*
+ * RealTime.h
+ * Scheduling, CPU affinity and memory locking of the daemon threads
+ *
+ * The network thread (event loop running the NetUMP sessions) can be given a
+ * SCHED_FIFO priority and pinned to a set of CPUs (--rt-priority, --cpu), the
+ * JACK process thread can be pinned too (--jack-cpu). --mlock locks all pages
+ * in memory and touches the buffers once at startup, so the realtime paths
+ * never wait for a page fault
+ */
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+
+//! Parse a CPU list like "2", "2,3" or "1-3". Returns false if the list is invalid or empty
+bool ParseCPUSet (const char* List, cpu_set_t* Set);
+
+//! Run Thread with SCHED_FIFO at Priority (1..99). Returns false on error (no RLIMIT_RTPRIO, no CAP_SYS_NICE...)
+bool SetThreadRealtime (pthread_t Thread, int Priority, const char* Name);
+
+//! Restrict Thread to the CPUs of Set. Returns false on error
+bool SetThreadCPUs (pthread_t Thread, const cpu_set_t* Set, const char* Name);
+
+//! Lock current and future pages in memory, and fault in the stack of the calling thread. Returns false on error
+bool LockMemory (void);
+
+//! Touch every page of a buffer, so it is mapped before the realtime threads use it
+void PrefaultMemory (void* Data, size_t Size);
+
+#endif // __REALTIME_H__
@@ -0,0 +1,289 @@
+/*
+ * Recorder.cpp
+ * Session recorder and replay log reader
+ *
+ * Ring entries are the record header on 3 words (time high, time low, direction/session/size)
+ * followed by the message words. The writer thread wakes up every RECORDER_WRITE_PERIOD_MS,
+ * always writes the oldest head of the two rings first and goes through a stdio buffer
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include "UMPRing.h"
+#include "Recorder.h"
+
+#define RECORDER_RING_SIZE          65536       // In 32-bit words, per direction
+#define RECORDER_WRITE_PERIOD_MS    10
+#define RECORDER_ENTRY_HEADER       3           // Words before the message in a ring entry
+#define RECORD_HEADER_SIZE          12          // Bytes before the message in the file
+#define RECORD_MAX_WORDS            4
+
+static const char RecordMagic [8] = { 'J', 'N', 'U', 'M', 'P', 'R', 'E', 'C' };
+
+typedef struct {
+    char Magic [8];
+    uint32_t Version;
+    uint32_t Reserved;
+} TRecordFileHeader;
+
+static CUMPRing<RECORDER_RING_SIZE> RecordRings [RECORD_DIRECTIONS];
+static std::atomic<uint64_t> RecordDrops [RECORD_DIRECTIONS];
+static std::atomic<bool> Recording (false);
+static std::atomic<bool> StopWriter (false);
+static pthread_t WriterThread;
+static FILE* RecordFile = 0;
+static uint64_t RecordsWritten = 0;
+
+static const uint8_t* ReplayData = 0;
+static size_t ReplaySize = 0;
+static size_t ReplayPos = 0;
+
+uint64_t GetRecorderTimeUs (void)
+{
+    struct timespec Now;
+
+    clock_gettime (CLOCK_MONOTONIC, &Now);
+    return (uint64_t)Now.tv_sec*1000000+Now.tv_nsec/1000;
+}  // GetRecorderTimeUs
+// -------------------------------------------------------------
+
+void RecordUMP (unsigned int Direction, unsigned int Session, const uint32_t* Words, unsigned int NumWords)
+{
+    uint32_t Entry [RECORDER_ENTRY_HEADER+RECORD_MAX_WORDS];
+    uint64_t TimeUs;
+
+    if (!Recording.load (std::memory_order_relaxed)) return;
+    if (NumWords>RECORD_MAX_WORDS) return;
+
+    TimeUs = GetRecorderTimeUs ();
+    Entry[0] = TimeUs>>32;
+    Entry[1] = TimeUs&0xFFFFFFFF;
+    Entry[2] = (Direction<<16)|((Session&0xFF)<<8)|NumWords;
+    memcpy (&Entry[RECORDER_ENTRY_HEADER], Words, NumWords*sizeof(uint32_t));
+
+    if (!RecordRings[Direction].Push (&Entry[0], RECORDER_ENTRY_HEADER+NumWords))
+        RecordDrops[Direction].store (RecordDrops[Direction].load (std::memory_order_relaxed)+1, std::memory_order_relaxed);
+}  // RecordUMP
+// -------------------------------------------------------------
+
+//! Write the entry at the head of a ring to the file and release it
+static void WriteEntry (CUMPRing<RECORDER_RING_SIZE>* Ring)
+{
+    uint8_t Record [RECORD_HEADER_SIZE+RECORD_MAX_WORDS*sizeof(uint32_t)];
+    uint64_t TimeUs;
+    uint32_t Info;
+    uint32_t Word;
+    unsigned int NumWords;
+
+    TimeUs = ((uint64_t)Ring->Peek (0)<<32)|Ring->Peek (1);
+    Info = Ring->Peek (2);
+    NumWords = Info&0xFF;
+
+    memcpy (&Record[0], &TimeUs, sizeof(TimeUs));
+    Record[8] = (Info>>16)&0xFF;        // Direction
+    Record[9] = (Info>>8)&0xFF;         // Session
+    Record[10] = NumWords;
+    Record[11] = 0;
+    for (unsigned int w=0; w<NumWords; w++)
+    {
+        Word = Ring->Peek (RECORDER_ENTRY_HEADER+w);
+        memcpy (&Record[RECORD_HEADER_SIZE+w*sizeof(uint32_t)], &Word, sizeof(Word));
+    }
+    Ring->Consume (RECORDER_ENTRY_HEADER+NumWords);
+
+    fwrite (&Record[0], RECORD_HEADER_SIZE+NumWords*sizeof(uint32_t), 1, RecordFile);
+    RecordsWritten++;
+}  // WriteEntry
+// -------------------------------------------------------------
+
+//! Write everything queued, oldest first
+static void DrainRings (void)
+{
+    CUMPRing<RECORDER_RING_SIZE>* Rx = &RecordRings[RECORD_RX];
+    CUMPRing<RECORDER_RING_SIZE>* Tx = &RecordRings[RECORD_TX];
+    uint64_t RxTime, TxTime;
+
+    while (true)
+    {
+        if (Rx->GetReadAvailable ()==0)
+        {
+            if (Tx->GetReadAvailable ()==0) return;
+            WriteEntry (Tx);
+            continue;
+        }
+        if (Tx->GetReadAvailable ()==0)
+        {
+            WriteEntry (Rx);
+            continue;
+        }
+
+        RxTime = ((uint64_t)Rx->Peek (0)<<32)|Rx->Peek (1);
+        TxTime = ((uint64_t)Tx->Peek (0)<<32)|Tx->Peek (1);
+        WriteEntry ((RxTime<=TxTime) ? Rx : Tx);
+    }
+}  // DrainRings
+// -------------------------------------------------------------
+
+static void* RecorderWriter (void* Arg)
+{
+    struct timespec Period;
+
+    Period.tv_sec = 0;
+    Period.tv_nsec = RECORDER_WRITE_PERIOD_MS*1000000;
+
+    while (!StopWriter.load ())
+    {
+        nanosleep (&Period, 0);
+        DrainRings ();
+        fflush (RecordFile);
+    }
+    return 0;
+}  // RecorderWriter
+// -------------------------------------------------------------
+
+bool StartRecorder (const char* Path)
+{
+    TRecordFileHeader Header;
+
+    RecordFile = fopen (Path, "wb");
+    if (RecordFile==0)
+    {
+        fprintf (stderr, "jacknetumpd : can not create record file %s (%s)\n", Path, strerror(errno));
+        return false;
+    }
+
+    memset (&Header, 0, sizeof(Header));
+    memcpy (Header.Magic, RecordMagic, sizeof(RecordMagic));
+    Header.Version = RECORD_VERSION;
+    fwrite (&Header, sizeof(Header), 1, RecordFile);
+
+    for (unsigned int d=0; d<RECORD_DIRECTIONS; d++)
+    {
+        RecordRings[d].Reset ();
+        RecordDrops[d].store (0);
+    }
+    RecordsWritten = 0;
+    StopWriter.store (false);
+
+    if (pthread_create (&WriterThread, 0, &RecorderWriter, 0)!=0)
+    {
+        fprintf (stderr, "jacknetumpd : can not start recorder thread\n");
+        fclose (RecordFile);
+        RecordFile = 0;
+        return false;
+    }
+
+    Recording.store (true);
+    fprintf (stdout, "jacknetumpd : recording UMP traffic to %s\n", Path);
+    return true;
+}  // StartRecorder
+// -------------------------------------------------------------
+
+void StopRecorder (void)
+{
+    if (RecordFile==0) return;
+
+    Recording.store (false);
+    StopWriter.store (true);
+    pthread_join (WriterThread, 0);
+
+    DrainRings ();
+    fclose (RecordFile);
+    RecordFile = 0;
+
+    fprintf (stdout, "jacknetumpd : %llu messages recorded, %llu received and %llu sent messages lost (recorder too slow)\n",
+             (unsigned long long)RecordsWritten, (unsigned long long)RecordDrops[RECORD_RX].load (),
+             (unsigned long long)RecordDrops[RECORD_TX].load ());
+}  // StopRecorder
+// -------------------------------------------------------------
+
+bool OpenReplay (const char* Path)
+{
+    TRecordFileHeader Header;
+    struct stat Info;
+    void* Data;
+    int fd;
+
+    fd = open (Path, O_RDONLY);
+    if (fd<0)
+    {
+        fprintf (stderr, "jacknetumpd : can not open replay file %s (%s)\n", Path, strerror(errno));
+        return false;
+    }
+    if ((fstat (fd, &Info)<0)||((size_t)Info.st_size<sizeof(TRecordFileHeader)))
+    {
+        fprintf (stderr, "jacknetumpd : %s is not a record file\n", Path);
+        close (fd);
+        return false;
+    }
+
+    Data = mmap (0, Info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (Data==MAP_FAILED)
+    {
+        fprintf (stderr, "jacknetumpd : can not map replay file %s (%s)\n", Path, strerror(errno));
+        return false;
+    }
+
+    memcpy (&Header, Data, sizeof(Header));
+    if ((memcmp (Header.Magic, RecordMagic, sizeof(RecordMagic))!=0)||(Header.Version!=RECORD_VERSION))
+    {
+        fprintf (stderr, "jacknetumpd : %s is not a record file (or not version %d)\n", Path, RECORD_VERSION);
+        munmap (Data, Info.st_size);
+        return false;
+    }
+
+    // Records are read in sequence
+    madvise (Data, Info.st_size, MADV_SEQUENTIAL);
+    ReplayData = (const uint8_t*)Data;
+    ReplaySize = Info.st_size;
+    ReplayPos = sizeof(TRecordFileHeader);
+    return true;
+}  // OpenReplay
+// -------------------------------------------------------------
+
+void CloseReplay (void)
+{
+    if (ReplayData==0) return;
+    munmap ((void*)ReplayData, ReplaySize);
+    ReplayData = 0;
+}  // CloseReplay
+// -------------------------------------------------------------
+
+bool PeekReplay (TRecordedUMP* Record)
+{
+    const uint8_t* Data;
+
+    if (ReplayData==0) return false;
+    if (ReplayPos+RECORD_HEADER_SIZE>ReplaySize) return false;
+
+    Data = &ReplayData[ReplayPos];
+    memcpy (&Record->TimeUs, &Data[0], sizeof(uint64_t));
+    Record->Direction = Data[8];
+    Record->Session = Data[9];
+    Record->NumWords = Data[10];
+    Record->Words = (const uint32_t*)&Data[RECORD_HEADER_SIZE];
+
+    // Truncated last record (recorder killed while writing) or corrupted log
+    if ((Record->NumWords==0)||(Record->NumWords>RECORD_MAX_WORDS)) return false;
+    if (ReplayPos+RECORD_HEADER_SIZE+Record->NumWords*sizeof(uint32_t)>ReplaySize) return false;
+    return true;
+}  // PeekReplay
+// -------------------------------------------------------------
+
+void NextReplay (void)
+{
+    TRecordedUMP Record;
+
+    if (PeekReplay (&Record))
+        ReplayPos += RECORD_HEADER_SIZE+Record.NumWords*sizeof(uint32_t);
+}  // NextReplay
+// -------------------------------------------------------------
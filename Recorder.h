@@ -0,0 +1,62 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+/*
+ * Recorder.h
+ * Session recorder (--record) and replay log reader (--replay)
+ *
+ * The recorder logs the UMP messages received from the network (as given to
+ * NetUMPCallback) and those queued for the network by jack_process (after the
+ * routing table). Each direction has its own lock-free ring, filled by the only
+ * thread producing that direction, and a background thread writes them to the
+ * file : recording never blocks the JACK thread nor the network thread. When a
+ * ring is full the record is dropped and counted.
+ *
+ * File format (host byte order, append-only, can be read with mmap) :
+ *   Header : "JNUMPREC" (8 bytes), uint32_t Version (RECORD_VERSION), uint32_t reserved
+ *   Record : uint64_t TimeUs (CLOCK_MONOTONIC), uint8_t Direction, uint8_t Session, uint8_t NumWords,
+ *            uint8_t reserved, uint32_t Words [NumWords]
+ * Records are merged by time when they are written, so the file is in time order
+ * except for records which stayed longer than RECORDER_WRITE_PERIOD_MS in a ring
+ */
+
+#include <stdint.h>
+
+#define RECORD_VERSION          1
+
+#define RECORD_RX               0       // Received from the network
+#define RECORD_TX               1       // Queued for the network by the JACK thread
+#define RECORD_DIRECTIONS       2
+
+typedef struct {
+    uint64_t TimeUs;
+    uint8_t Direction;
+    uint8_t Session;
+    uint8_t NumWords;
+    const uint32_t* Words;              // Points into the mapped file
+} TRecordedUMP;
+
+//! Create the log file and start the writer thread
+bool StartRecorder (const char* Path);
+
+//! Write the remaining records, stop the writer thread and close the file
+void StopRecorder (void);
+
+//! Log a message. Must only be called from the thread producing Direction (network thread for RECORD_RX,
+//! JACK thread for RECORD_TX). Does nothing if the recorder is not started
+void RecordUMP (unsigned int Direction, unsigned int Session, const uint32_t* Words, unsigned int NumWords);
+
+//! Clock of the records (CLOCK_MONOTONIC, in microseconds)
+uint64_t GetRecorderTimeUs (void);
+
+//! Map a log file for replay. Returns false if it can not be read or is not a log
+bool OpenReplay (const char* Path);
+void CloseReplay (void);
+
+//! Get the next record without consuming it. Returns false at the end of the log
+bool PeekReplay (TRecordedUMP* Record);
+
+//! Move to the next record
+void NextReplay (void);
+
+#endif // __RECORDER_H__
@@ -0,0 +1,337 @@
+/*
+ * Routes.cpp
+ * Routing and filtering of UMP messages between NetUMP and JACK
+ *
+ * Rules are compiled by walking the whole table for each rule : this is done once at
+ * startup, so the realtime paths only do the lookup
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Routes.h"
+
+#define ROUTE_MAX_LINE      256
+#define ENTRY_MAIN_PORT     0x00010000
+
+typedef struct {
+    unsigned int Direction;
+    uint16_t MTMask;
+    uint16_t GroupMask;
+    uint16_t ChannelMask;
+    bool MatchChannel;
+    bool MatchStatus;
+    bool StatusBytes [256];
+    bool SetPorts;
+    uint8_t PortMask;
+    int MapGroup;               // -1 : unchanged
+    int MapChannel;
+} TRouteRule;
+
+uint32_t RouteTables [NUM_ROUTE_DIRECTIONS][ROUTE_TABLE_SIZE];
+
+static char PortNames [ROUTE_MAX_PORTS][ROUTE_MAX_NAME];
+static unsigned int NumPorts = 1;
+
+static inline bool HasGroup (unsigned int MT)
+{
+    return ((MT>=0x01)&&(MT<=0x05))||(MT==0x0D);
+}
+
+static inline bool IsChannelVoice (unsigned int MT)
+{
+    return (MT==0x02)||(MT==0x04);
+}
+
+void InitRoutes (void)
+{
+    for (unsigned int d=0; d<NUM_ROUTE_DIRECTIONS; d++)
+        for (unsigned int i=0; i<ROUTE_TABLE_SIZE; i++)
+            RouteTables[d][i] = ENTRY_MAIN_PORT|i;
+
+    strcpy (PortNames[0], "main");
+    NumPorts = 1;
+}  // InitRoutes
+// -------------------------------------------------------------
+
+unsigned int GetRoutePortCount (void)
+{
+    return NumPorts;
+}  // GetRoutePortCount
+// -------------------------------------------------------------
+
+const char* GetRoutePortName (unsigned int Port)
+{
+    if (Port>=NumPorts) return 0;
+    return PortNames[Port];
+}  // GetRoutePortName
+// -------------------------------------------------------------
+
+int AddRoutePort (const char* Name)
+{
+    if ((NumPorts>=ROUTE_MAX_PORTS)||(*Name==0)||(strlen (Name)>=ROUTE_MAX_NAME)) return -1;
+    for (unsigned int p=0; p<NumPorts; p++)
+        if (strcmp (PortNames[p], Name)==0) return -1;
+
+    strcpy (PortNames[NumPorts], Name);
+    return NumPorts++;
+}  // AddRoutePort
+// -------------------------------------------------------------
+
+// Parse "a,b-c,..." into a bit mask. Values are checked against Min..Max and stored as value-Min
+static bool ParseList (const char* Text, unsigned int Min, unsigned int Max, int Base, uint16_t* Mask)
+{
+    char* End;
+    unsigned long First, Last;
+
+    *Mask = 0;
+    while (*Text)
+    {
+        First = strtoul (Text, &End, Base);
+        if (End==Text) return false;
+        Last = First;
+        if (*End=='-')
+        {
+            Text = End+1;
+            Last = strtoul (Text, &End, Base);
+            if (End==Text) return false;
+        }
+        if ((First<Min)||(Last>Max)||(First>Last)) return false;
+        for (unsigned long v=First; v<=Last; v++)
+            *Mask |= 1<<(v-Min);
+
+        if (*End==',') End++;
+        else if (*End!=0) return false;
+        Text = End;
+    }
+    return true;
+}  // ParseList
+// -------------------------------------------------------------
+
+static bool ParseStatus (const char* Text, TRouteRule* Rule)
+{
+    char* End;
+    unsigned long Status;
+
+    while (*Text)
+    {
+        Status = strtoul (Text, &End, 16);
+        if ((End==Text)||(Status<0x80)||(Status>0xFF)) return false;
+
+        // Channel messages match whatever the channel, system messages match exactly
+        if (Status<0xF0)
+        {
+            for (unsigned int c=0; c<16; c++)
+                Rule->StatusBytes[(Status&0xF0)|c] = true;
+        }
+        else
+            Rule->StatusBytes[Status] = true;
+
+        if (*End==',') End++;
+        else if (*End!=0) return false;
+        Text = End;
+    }
+    Rule->MatchStatus = true;
+    return true;
+}  // ParseStatus
+// -------------------------------------------------------------
+
+static bool ParsePorts (const char* Text, TRouteRule* Rule)
+{
+    char Name [ROUTE_MAX_NAME];
+    unsigned int Len;
+    unsigned int p;
+
+    Rule->SetPorts = true;
+    Rule->PortMask = 0;
+    while (*Text)
+    {
+        Len = strcspn (Text, ",");
+        if ((Len==0)||(Len>=ROUTE_MAX_NAME)) return false;
+        memcpy (Name, Text, Len);
+        Name[Len] = 0;
+
+        for (p=0; p<NumPorts; p++)
+            if (strcmp (PortNames[p], Name)==0) break;
+        if (p==NumPorts) return false;
+        Rule->PortMask |= 1<<p;
+
+        Text += Len;
+        if (*Text==',') Text++;
+    }
+    return true;
+}  // ParsePorts
+// -------------------------------------------------------------
+
+static void CompileRule (const TRouteRule* Rule)
+{
+    uint32_t* Table = &RouteTables[Rule->Direction][0];
+    unsigned int MT, Group, Channel;
+    uint32_t Entry;
+
+    for (unsigned int i=0; i<ROUTE_TABLE_SIZE; i++)
+    {
+        MT = i>>12;
+        Group = (i>>8)&0x0F;
+        Channel = i&0x0F;
+
+        if ((Rule->MTMask&(1<<MT))==0) continue;
+        if ((HasGroup(MT))&&((Rule->GroupMask&(1<<Group))==0)) continue;
+        if ((!HasGroup(MT))&&(Rule->GroupMask!=0xFFFF)) continue;
+        if ((Rule->MatchChannel)&&((!IsChannelVoice(MT))||((Rule->ChannelMask&(1<<Channel))==0))) continue;
+        if ((Rule->MatchStatus)&&((MT!=0x01)&&(!IsChannelVoice(MT)))) continue;
+        if ((Rule->MatchStatus)&&(!Rule->StatusBytes[i&0xFF])) continue;
+
+        Entry = Table[i];
+        if (Rule->SetPorts)
+            Entry = (Entry&0xFFFF)|((uint32_t)Rule->PortMask<<16);
+        if ((Rule->MapGroup>=0)&&(HasGroup(MT)))
+            Entry = (Entry&0xFFFFF0FF)|(Rule->MapGroup<<8);
+        if ((Rule->MapChannel>=0)&&(IsChannelVoice(MT)))
+            Entry = (Entry&0xFFFFFFF0)|Rule->MapChannel;
+        Table[i] = Entry;
+    }
+}  // CompileRule
+// -------------------------------------------------------------
+
+void RouteGroupsToPort (unsigned int FirstGroup, unsigned int NumGroups, unsigned int Port)
+{
+    TRouteRule Rule;
+
+    memset (&Rule, 0, sizeof(TRouteRule));
+    Rule.Direction = ROUTE_IN;
+    Rule.MTMask = 0xFFFF;
+    Rule.GroupMask = ((1<<NumGroups)-1)<<FirstGroup;
+    Rule.ChannelMask = 0xFFFF;
+    Rule.SetPorts = true;
+    Rule.PortMask = 1<<Port;
+    Rule.MapGroup = -1;
+    Rule.MapChannel = -1;
+    CompileRule (&Rule);
+}  // RouteGroupsToPort
+// -------------------------------------------------------------
+
+static bool ParseRule (char* Line, TRouteRule* Rule)
+{
+    char* Token;
+    char* Save;
+    char* Value;
+    uint16_t Mask;
+
+    memset (Rule, 0, sizeof(TRouteRule));
+    Rule->MTMask = 0xFFFF;
+    Rule->GroupMask = 0xFFFF;
+    Rule->ChannelMask = 0xFFFF;
+    Rule->MapGroup = -1;
+    Rule->MapChannel = -1;
+
+    Token = strtok_r (Line, " \t", &Save);
+    if (strcmp (Token, "in")==0) Rule->Direction = ROUTE_IN;
+    else if (strcmp (Token, "out")==0) Rule->Direction = ROUTE_OUT;
+    else return false;
+
+    while ((Token = strtok_r (0, " \t", &Save))!=0)
+    {
+        if (strcmp (Token, "drop")==0)
+        {
+            Rule->SetPorts = true;
+            Rule->PortMask = 0;
+            continue;
+        }
+
+        Value = strchr (Token, '=');
+        if (Value==0) return false;
+        *Value++ = 0;
+
+        if (strcmp (Token, "mt")==0)
+        {
+            if (!ParseList (Value, 0, 15, 0, &Rule->MTMask)) return false;
+        }
+        else if (strcmp (Token, "group")==0)
+        {
+            if (!ParseList (Value, 1, 16, 10, &Rule->GroupMask)) return false;
+        }
+        else if (strcmp (Token, "channel")==0)
+        {
+            if (!ParseList (Value, 1, 16, 10, &Rule->ChannelMask)) return false;
+            Rule->MatchChannel = true;
+        }
+        else if (strcmp (Token, "status")==0)
+        {
+            if (!ParseStatus (Value, Rule)) return false;
+        }
+        else if (strcmp (Token, "port")==0)
+        {
+            // Messages from JACK all go to the same session
+            if (Rule->Direction!=ROUTE_IN) return false;
+            if (!ParsePorts (Value, Rule)) return false;
+        }
+        else if ((strcmp (Token, "map-group")==0)||(strcmp (Token, "map-channel")==0))
+        {
+            if (!ParseList (Value, 1, 16, 10, &Mask)) return false;
+            if ((Mask&(Mask-1))!=0) return false;       // Only one value
+            if (Token[4]=='g')
+                Rule->MapGroup = __builtin_ctz (Mask);
+            else
+                Rule->MapChannel = __builtin_ctz (Mask);
+        }
+        else
+            return false;
+    }
+    return true;
+}  // ParseRule
+// -------------------------------------------------------------
+
+bool LoadRoutes (const char* Path)
+{
+    FILE* File;
+    char Line [ROUTE_MAX_LINE];
+    char* Start;
+    char* Name;
+    unsigned int LineNumber = 0;
+    unsigned int NumRules = 0;
+    unsigned int FirstPort = NumPorts;
+    TRouteRule Rule;
+
+    File = fopen (Path, "r");
+    if (File==0)
+    {
+        fprintf (stderr, "jacknetumpd : can not open routes file %s\n", Path);
+        return false;
+    }
+
+    while (fgets (Line, sizeof(Line), File))
+    {
+        LineNumber++;
+        Line[strcspn (Line, "#\r\n")] = 0;
+        Start = Line+strspn (Line, " \t");
+        if (*Start==0) continue;
+
+        if (strncmp (Start, "port ", 5)==0)
+        {
+            Name = Start+5+strspn (Start+5, " \t");
+            Name[strcspn (Name, " \t")] = 0;
+            if (AddRoutePort (Name)<0)
+            {
+                fprintf (stderr, "jacknetumpd : %s line %u : invalid port or too many ports (max %d)\n", Path, LineNumber, ROUTE_MAX_PORTS-1);
+                fclose (File);
+                return false;
+            }
+            continue;
+        }
+
+        if (!ParseRule (Start, &Rule))
+        {
+            fprintf (stderr, "jacknetumpd : %s line %u : invalid rule\n", Path, LineNumber);
+            fclose (File);
+            return false;
+        }
+        CompileRule (&Rule);
+        NumRules++;
+    }
+
+    fclose (File);
+    fprintf (stdout, "jacknetumpd : %u route(s) and %u extra port(s) loaded from %s\n", NumRules, NumPorts-FirstPort, Path);
+    return true;
+}  // LoadRoutes
+// -------------------------------------------------------------
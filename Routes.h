@@ -0,0 +1,71 @@
+#ifndef __ROUTES_H__
+#define __ROUTES_H__
+
+/*
+ * Routes.h
+ * Routing and filtering of UMP messages between NetUMP and JACK (--routes)
+ *
+ * Rules are read from a text file and compiled into one table per direction, indexed by
+ * the upper half of the first UMP word (message type, group, status, channel). Each entry
+ * holds the new upper half (remapped group/channel) and the mask of JACK output ports the
+ * message goes to, so a message is routed with one table lookup.
+ * Without a routes file, tables pass every message unchanged to the main port.
+ *
+ * File syntax, one rule per line, applied in order (a later rule overrides an earlier one) :
+ *   port <name>                                 declare an extra JACK output port
+ *   <in|out> [match...] <action...>
+ * in : network to JACK, out : JACK to network
+ * Match (any if absent, lists separated by commas, ranges with '-') :
+ *   mt=<n>  group=<1-16>  channel=<1-16>  status=<hex>
+ *   status is the status byte of a channel message (80, 90... channel ignored) or a system status (F8, FE...)
+ * Actions :
+ *   drop    port=<name>[,<name>...] ("main" is netump_out)    map-group=<1-16>    map-channel=<1-16>
+ * Ports of the Function Blocks (--function-block) are declared before the file is read and can be used in port=
+ * Example :
+ *   in status=F8,FE drop               # no clock and active sensing
+ *   in status=A0,D0 drop               # no aftertouch
+ *   port drums
+ *   in channel=10 port=drums map-channel=1
+ */
+
+#include <stdint.h>
+
+#define ROUTE_MAX_PORTS         8           // Main port included
+#define ROUTE_MAX_NAME          24
+#define ROUTE_TABLE_SIZE        65536
+
+enum {
+    ROUTE_IN,                   // Network to JACK
+    ROUTE_OUT,                  // JACK to network
+    NUM_ROUTE_DIRECTIONS
+};
+
+//! Entry : bits 0-15 new upper half of the first word, bits 16-23 port mask (0 : dropped)
+extern uint32_t RouteTables [NUM_ROUTE_DIRECTIONS][ROUTE_TABLE_SIZE];
+
+//! Set the tables to pass everything to the main port
+void InitRoutes (void);
+
+//! Read and compile a routes file. Returns false (with a message) if the file is invalid
+bool LoadRoutes (const char* Path);
+
+//! Declare an extra JACK output port. Returns its index, -1 if the name is invalid, already used or there are too many ports
+int AddRoutePort (const char* Name);
+
+//! Send the messages of groups FirstGroup to FirstGroup+NumGroups-1 (0 based) to Port only (Function Blocks)
+void RouteGroupsToPort (unsigned int FirstGroup, unsigned int NumGroups, unsigned int Port);
+
+//! JACK output ports of a session : port 0 (mask bit 0) is the main one, others are Function Blocks or declared in the routes file
+unsigned int GetRoutePortCount (void);
+const char* GetRoutePortName (unsigned int Port);
+
+//! Remap the first word of a message. Returns the port mask, 0 if the message is filtered out
+static inline uint32_t RouteMessage (unsigned int Direction, uint32_t* Word)
+{
+    uint32_t Entry = RouteTables[Direction][*Word>>16];
+
+    *Word = (Entry<<16)|(*Word&0xFFFF);
+    return (Entry>>16)&0xFF;
+}
+
+#endif // __ROUTES_H__
@@ -0,0 +1,69 @@
+/*
+ * SessionSocket.cpp
+ * Tuning of the UDP sockets owned by the NetUMP library
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "SessionSocket.h"
+
+static unsigned int SocketBufferBytes = 0;
+static unsigned int SocketBusyPollUs = 0;
+
+void ConfigureSessionSockets (unsigned int BufferBytes, unsigned int BusyPollUs)
+{
+    SocketBufferBytes = BufferBytes;
+    SocketBusyPollUs = BusyPollUs;
+}  // ConfigureSessionSockets
+// -------------------------------------------------------------
+
+//! Set SO_RCVBUF or SO_SNDBUF. Above net.core.rmem_max / wmem_max, the FORCE variant is tried (needs CAP_NET_ADMIN)
+static void SetBufferSize (int fd, int Option, int ForceOption, const char* Name)
+{
+    int Size = SocketBufferBytes;
+    int Granted = 0;
+    socklen_t Len = sizeof(Granted);
+
+    setsockopt (fd, SOL_SOCKET, Option, &Size, sizeof(Size));
+    getsockopt (fd, SOL_SOCKET, Option, &Granted, &Len);
+    // Kernel reports twice the value set, the other half is for its bookkeeping
+    if (Granted/2>=Size) return;
+
+    if (setsockopt (fd, SOL_SOCKET, ForceOption, &Size, sizeof(Size))<0)
+        fprintf (stderr, "jacknetumpd : %s buffer limited to %d bytes by the system (%s)\n", Name, Granted/2, strerror(errno));
+}  // SetBufferSize
+// -------------------------------------------------------------
+
+void TuneSessionSocket (int fd)
+{
+    int BusyPoll = SocketBusyPollUs;
+
+    if (fd<0) return;
+
+    if (SocketBufferBytes>0)
+    {
+        SetBufferSize (fd, SO_RCVBUF, SO_RCVBUFFORCE, "receive");
+        SetBufferSize (fd, SO_SNDBUF, SO_SNDBUFFORCE, "send");
+    }
+
+    if (SocketBusyPollUs>0)
+    {
+        if (setsockopt (fd, SOL_SOCKET, SO_BUSY_POLL, &BusyPoll, sizeof(BusyPoll))<0)
+            fprintf (stderr, "jacknetumpd : can not enable busy polling (%s)\n", strerror(errno));
+    }
+}  // TuneSessionSocket
+// -------------------------------------------------------------
+
+bool HasPendingDatagram (int fd)
+{
+    pollfd Poll;
+
+    Poll.fd = fd;
+    Poll.events = POLLIN;
+    Poll.revents = 0;
+    return (poll (&Poll, 1, 0)>0)&&(Poll.revents&POLLIN);
+}  // HasPendingDatagram
+// -------------------------------------------------------------
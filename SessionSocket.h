@@ -0,0 +1,24 @@
+#ifndef __SESSIONSOCKET_H__
+#define __SESSIONSOCKET_H__
+
+/*
+ * SessionSocket.h
+ * Tuning of the UDP sockets owned by the NetUMP library (--socket-buffer, --busy-poll)
+ *
+ * The library reads one datagram per RunSession() call and sends from inside
+ * RunSession() / SendUMPMessage(), so the datagrams can not be moved in batches
+ * here. What can be done from outside is sizing the kernel buffers, so bursts
+ * from several peers are not dropped by the kernel, and telling the caller
+ * whether more datagrams are queued, so they are all read in one wake-up
+ */
+
+//! Kernel buffer size (0 : system default) and busy poll time (0 : disabled) for the sockets tuned afterwards
+void ConfigureSessionSockets (unsigned int BufferBytes, unsigned int BusyPollUs);
+
+//! Apply the configuration to a session socket. Errors are reported, the socket stays usable
+void TuneSessionSocket (int fd);
+
+//! True if a datagram is waiting in the socket receive queue
+bool HasPendingDatagram (int fd);
+
+#endif // __SESSIONSOCKET_H__
@@ -0,0 +1,417 @@
+/*
+ * Stats.cpp
+ * Runtime statistics export on a Unix socket
+ *
+ * Clients connect, send one request line and get one answer, then the socket is closed :
+ *   echo json | socat - UNIX-CONNECT:/run/jacknetumpd.sock
+ *   curl --unix-socket /run/jacknetumpd.sock http://localhost/metrics
+ * Packet rates are computed every second by a timer of the event loop, which also closes clients
+ * that sent no request within two seconds. Sockets are non blocking : a client that does not read
+ * its answer gets it truncated
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "EventLoop.h"
+#include "Stats.h"
+
+#define STATS_RATE_PERIOD_MS    1000
+#define STATS_REQUEST_SIZE      256
+#define STATS_ANSWER_SIZE       65536
+#define STATS_MAX_CLIENTS       4
+#define STATS_CLIENT_TIMEOUT    2           // Rate periods without a request before a client is closed
+
+typedef struct {
+    uint64_t LastRxPackets;
+    uint64_t LastTxPackets;
+    uint32_t RxPacketRate;      // Packets per second over last period
+    uint32_t TxPacketRate;
+} TSessionRates;
+
+static TSessionStats SessionStats [STATS_MAX_SESSIONS];
+static TSessionRates SessionRates [STATS_MAX_SESSIONS];
+static std::atomic<uint64_t> Xruns (0);
+static std::atomic<uint64_t> ProcessPeriods (0);        // JACK thread
+static std::atomic<uint64_t> ProcessTimeNs (0);
+static std::atomic<uint32_t> ProcessTimeMaxNs (0);
+static unsigned int NumStatsSessions = 0;
+static int ListenFD = -1;
+static int RateTimerFD = -1;
+static char SocketPath [sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+// Client sockets are non blocking : the network thread never waits for a slow or idle client
+typedef struct {
+    int FD;                     // -1 when the slot is free
+    unsigned int Age;           // Rate periods since accept
+} TStatsClient;
+
+static TStatsClient Clients [STATS_MAX_CLIENTS];
+
+static char Answer [STATS_ANSWER_SIZE];
+static size_t AnswerLen;
+
+static const char* DropNames [NUM_DROP_REASONS] = {"rx_fifo_full", "jack_buffer_full", "tx_fifo_full", "rx_fifo_oldest"};
+
+TSessionStats* GetSessionStats (unsigned int Index)
+{
+    return &SessionStats[Index];
+}  // GetSessionStats
+// -------------------------------------------------------------
+
+void StatsXrun (void)
+{
+    // xrun callback may not run in the process thread : this one is a real atomic increment
+    Xruns.fetch_add (1, std::memory_order_relaxed);
+}  // StatsXrun
+// -------------------------------------------------------------
+
+void StatsProcessTime (uint64_t Ns)
+{
+    StatAdd (ProcessPeriods, 1);
+    StatAdd (ProcessTimeNs, Ns);
+    StatMax (ProcessTimeMaxNs, (Ns>0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)Ns);
+}  // StatsProcessTime
+// -------------------------------------------------------------
+
+static void Append (const char* Format, ...)
+{
+    va_list Args;
+    int Len;
+
+    if (AnswerLen>=STATS_ANSWER_SIZE) return;
+
+    va_start (Args, Format);
+    Len = vsnprintf (&Answer[AnswerLen], STATS_ANSWER_SIZE-AnswerLen, Format, Args);
+    va_end (Args);
+
+    if (Len>0) AnswerLen+=Len;
+    if (AnswerLen>STATS_ANSWER_SIZE) AnswerLen=STATS_ANSWER_SIZE;
+}  // Append
+// -------------------------------------------------------------
+
+static uint64_t Get (const std::atomic<uint64_t>& Counter)
+{
+    return Counter.load (std::memory_order_relaxed);
+}  // Get
+// -------------------------------------------------------------
+
+static void AppendPrometheusCounter (const char* Name, const char* Help, std::atomic<uint64_t> TSessionStats::* Field)
+{
+    Append ("# HELP jacknetumpd_%s %s\n# TYPE jacknetumpd_%s counter\n", Name, Help, Name);
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+    {
+        Append ("jacknetumpd_%s{session=\"%u\"} %llu\n", Name, s+1, (unsigned long long)Get (SessionStats[s].*Field));
+    }
+}  // AppendPrometheusCounter
+// -------------------------------------------------------------
+
+static void MakePrometheusAnswer (void)
+{
+    TSessionStats* Stats;
+
+    Append ("# HELP jacknetumpd_xruns_total JACK xruns\n# TYPE jacknetumpd_xruns_total counter\n");
+    Append ("jacknetumpd_xruns_total %llu\n", (unsigned long long)Get (Xruns));
+
+    Append ("# HELP jacknetumpd_process_periods_total JACK periods processed\n# TYPE jacknetumpd_process_periods_total counter\n");
+    Append ("jacknetumpd_process_periods_total %llu\n", (unsigned long long)Get (ProcessPeriods));
+    Append ("# HELP jacknetumpd_process_time_ns_total Time spent in the JACK process callback\n# TYPE jacknetumpd_process_time_ns_total counter\n");
+    Append ("jacknetumpd_process_time_ns_total %llu\n", (unsigned long long)Get (ProcessTimeNs));
+    Append ("# HELP jacknetumpd_process_time_max_ns Longest JACK process callback since start\n# TYPE jacknetumpd_process_time_max_ns gauge\n");
+    Append ("jacknetumpd_process_time_max_ns %u\n", ProcessTimeMaxNs.load (std::memory_order_relaxed));
+
+    Append ("# HELP jacknetumpd_connected Peer connected to the session\n# TYPE jacknetumpd_connected gauge\n");
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+        Append ("jacknetumpd_connected{session=\"%u\"} %d\n", s+1, SessionStats[s].Connected.load (std::memory_order_relaxed) ? 1 : 0);
+
+    Append ("# HELP jacknetumpd_protocol UMP Protocol selected by the peer (1 : MIDI 1.0, 2 : MIDI 2.0)\n# TYPE jacknetumpd_protocol gauge\n");
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+        Append ("jacknetumpd_protocol{session=\"%u\"} %u\n", s+1, SessionStats[s].Protocol.load (std::memory_order_relaxed));
+
+    Append ("# HELP jacknetumpd_rx_messages_total UMP messages received from the network\n# TYPE jacknetumpd_rx_messages_total counter\n");
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+        for (unsigned int mt=0; mt<16; mt++)
+            if (Get (SessionStats[s].RxMessages[mt])!=0)
+                Append ("jacknetumpd_rx_messages_total{session=\"%u\",mt=\"%u\"} %llu\n", s+1, mt, (unsigned long long)Get (SessionStats[s].RxMessages[mt]));
+
+    Append ("# HELP jacknetumpd_tx_messages_total UMP messages sent to the network\n# TYPE jacknetumpd_tx_messages_total counter\n");
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+        for (unsigned int mt=0; mt<16; mt++)
+            if (Get (SessionStats[s].TxMessages[mt])!=0)
+                Append ("jacknetumpd_tx_messages_total{session=\"%u\",mt=\"%u\"} %llu\n", s+1, mt, (unsigned long long)Get (SessionStats[s].TxMessages[mt]));
+
+    AppendPrometheusCounter ("rx_bytes_total", "UMP bytes received from the network", &TSessionStats::RxBytes);
+    AppendPrometheusCounter ("tx_bytes_total", "UMP bytes sent to the network", &TSessionStats::TxBytes);
+    AppendPrometheusCounter ("rx_packets_total", "Datagrams received on the session socket", &TSessionStats::RxPackets);
+    AppendPrometheusCounter ("tx_packets_total", "Bursts of messages flushed to the network", &TSessionStats::TxPackets);
+    AppendPrometheusCounter ("jack_events_in_total", "Events read from the JACK input port", &TSessionStats::JackEventsIn);
+    AppendPrometheusCounter ("jack_events_out_total", "Events written to the JACK output port", &TSessionStats::JackEventsOut);
+    AppendPrometheusCounter ("transcode_failures_total", "Messages which could not be converted", &TSessionStats::TranscodeFailures);
+    AppendPrometheusCounter ("rx_filtered_total", "Messages from the network removed by the routing table", &TSessionStats::RxFiltered);
+    AppendPrometheusCounter ("tx_filtered_total", "Messages from JACK removed by the routing table", &TSessionStats::TxFiltered);
+    AppendPrometheusCounter ("rx_collapsed_total", "Controller updates replaced before being queued, FIFO nearly full", &TSessionStats::RxCollapsed);
+    AppendPrometheusCounter ("coalesced_total", "Controller updates replaced by a later one in the same period", &TSessionStats::Coalesced);
+    AppendPrometheusCounter ("deferred_periods_total", "Periods where the JACK buffer was full and messages were kept for next period", &TSessionStats::Deferred);
+    AppendPrometheusCounter ("fec_copies_total", "Redundant copies of protected messages sent", &TSessionStats::FECCopies);
+    AppendPrometheusCounter ("fec_duplicates_total", "Redundant copies received and dropped", &TSessionStats::FECDuplicates);
+
+    Append ("# HELP jacknetumpd_drops_total Messages dropped\n# TYPE jacknetumpd_drops_total counter\n");
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+        for (unsigned int r=0; r<NUM_DROP_REASONS; r++)
+            Append ("jacknetumpd_drops_total{session=\"%u\",reason=\"%s\"} %llu\n", s+1, DropNames[r], (unsigned long long)Get (SessionStats[s].Drops[r]));
+
+    Append ("# HELP jacknetumpd_fifo_high_water_words Highest FIFO occupancy since start\n# TYPE jacknetumpd_fifo_high_water_words gauge\n");
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+    {
+        Stats = &SessionStats[s];
+        Append ("jacknetumpd_fifo_high_water_words{session=\"%u\",fifo=\"ump2jack\"} %u\n", s+1, Stats->UMP2JACKHighWater.load (std::memory_order_relaxed));
+        Append ("jacknetumpd_fifo_high_water_words{session=\"%u\",fifo=\"jack2net\"} %u\n", s+1, Stats->JACK2NETHighWater.load (std::memory_order_relaxed));
+    }
+
+    Append ("# HELP jacknetumpd_packets_per_second Packet rate over the last second\n# TYPE jacknetumpd_packets_per_second gauge\n");
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+    {
+        Append ("jacknetumpd_packets_per_second{session=\"%u\",direction=\"rx\"} %u\n", s+1, SessionRates[s].RxPacketRate);
+        Append ("jacknetumpd_packets_per_second{session=\"%u\",direction=\"tx\"} %u\n", s+1, SessionRates[s].TxPacketRate);
+    }
+}  // MakePrometheusAnswer
+// -------------------------------------------------------------
+
+static void AppendJSONArray (const char* Name, const std::atomic<uint64_t>* Counters, unsigned int Count)
+{
+    Append ("\"%s\": [", Name);
+    for (unsigned int i=0; i<Count; i++)
+        Append ("%s%llu", (i==0) ? "" : ", ", (unsigned long long)Get (Counters[i]));
+    Append ("]");
+}  // AppendJSONArray
+// -------------------------------------------------------------
+
+static void MakeJSONAnswer (void)
+{
+    TSessionStats* Stats;
+
+    Append ("{\"xruns\": %llu, \"process_periods\": %llu, \"process_time_ns\": %llu, \"process_time_max_ns\": %u, \"sessions\": [",
+            (unsigned long long)Get (Xruns), (unsigned long long)Get (ProcessPeriods), (unsigned long long)Get (ProcessTimeNs),
+            ProcessTimeMaxNs.load (std::memory_order_relaxed));
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+    {
+        Stats = &SessionStats[s];
+        Append ("%s\n  {\"session\": %u, \"connected\": %s, \"protocol\": %u, ", (s==0) ? "" : ",", s+1,
+                Stats->Connected.load (std::memory_order_relaxed) ? "true" : "false", Stats->Protocol.load (std::memory_order_relaxed));
+        AppendJSONArray ("rx_messages_by_mt", &Stats->RxMessages[0], 16);
+        Append (", ");
+        AppendJSONArray ("tx_messages_by_mt", &Stats->TxMessages[0], 16);
+        Append (", \"rx_bytes\": %llu, \"tx_bytes\": %llu, \"rx_packets\": %llu, \"tx_packets\": %llu, ",
+                (unsigned long long)Get (Stats->RxBytes), (unsigned long long)Get (Stats->TxBytes),
+                (unsigned long long)Get (Stats->RxPackets), (unsigned long long)Get (Stats->TxPackets));
+        Append ("\"rx_packets_per_sec\": %u, \"tx_packets_per_sec\": %u, ", SessionRates[s].RxPacketRate, SessionRates[s].TxPacketRate);
+        Append ("\"jack_events_in\": %llu, \"jack_events_out\": %llu, \"transcode_failures\": %llu, ",
+                (unsigned long long)Get (Stats->JackEventsIn), (unsigned long long)Get (Stats->JackEventsOut),
+                (unsigned long long)Get (Stats->TranscodeFailures));
+        Append ("\"rx_filtered\": %llu, \"tx_filtered\": %llu, \"rx_collapsed\": %llu, \"coalesced\": %llu, \"deferred_periods\": %llu, ",
+                (unsigned long long)Get (Stats->RxFiltered), (unsigned long long)Get (Stats->TxFiltered), (unsigned long long)Get (Stats->RxCollapsed),
+                (unsigned long long)Get (Stats->Coalesced), (unsigned long long)Get (Stats->Deferred));
+        Append ("\"fec_copies\": %llu, \"fec_duplicates\": %llu, ",
+                (unsigned long long)Get (Stats->FECCopies), (unsigned long long)Get (Stats->FECDuplicates));
+        Append ("\"ump2jack_high_water\": %u, \"jack2net_high_water\": %u, \"drops\": {",
+                Stats->UMP2JACKHighWater.load (std::memory_order_relaxed), Stats->JACK2NETHighWater.load (std::memory_order_relaxed));
+        for (unsigned int r=0; r<NUM_DROP_REASONS; r++)
+            Append ("%s\"%s\": %llu", (r==0) ? "" : ", ", DropNames[r], (unsigned long long)Get (Stats->Drops[r]));
+        Append ("}}");
+    }
+    Append ("\n]}\n");
+}  // MakeJSONAnswer
+// -------------------------------------------------------------
+
+static void CloseStatsClient (TStatsClient* Client)
+{
+    RemoveEventSource (Client->FD);
+    close (Client->FD);
+    Client->FD = -1;
+}  // CloseStatsClient
+// -------------------------------------------------------------
+
+static void OnStatsClient (void* UserInstance, uint64_t Count)
+{
+    TStatsClient* Client = (TStatsClient*)UserInstance;
+    int ClientFD = Client->FD;
+    char Request [STATS_REQUEST_SIZE];
+    ssize_t Len;
+    bool IsHTTP;
+    bool IsJSON;
+    size_t Sent;
+    char Header [128];
+    int HeaderLen;
+
+    Len = read (ClientFD, &Request[0], sizeof(Request)-1);
+    if ((Len<0)&&((errno==EAGAIN)||(errno==EINTR))) return;     // Spurious wake-up, request not there yet
+    if (Len<=0)
+    {   // Closed by the client before any request
+        CloseStatsClient (Client);
+        return;
+    }
+    Request[Len]=0;
+
+    IsHTTP = (strncmp (Request, "GET ", 4)==0);
+    IsJSON = (strncmp (Request, "json", 4)==0)||(strstr (Request, ".json")!=0);
+
+    AnswerLen=0;
+    if (IsJSON)
+        MakeJSONAnswer();
+    else
+        MakePrometheusAnswer();
+
+    if (IsHTTP)
+    {
+        HeaderLen = snprintf (Header, sizeof(Header), "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %u\r\n\r\n",
+                              IsJSON ? "application/json" : "text/plain; version=0.0.4", (unsigned int)AnswerLen);
+        if (send (ClientFD, Header, HeaderLen, MSG_NOSIGNAL)<0) { }
+    }
+
+    // The answer fits in the socket buffer of any client reading it : one that does not empty it
+    // gets a truncated answer (send fails with EAGAIN) rather than stalling the network thread
+    Sent=0;
+    while (Sent<AnswerLen)
+    {
+        Len = send (ClientFD, &Answer[Sent], AnswerLen-Sent, MSG_NOSIGNAL|MSG_DONTWAIT);
+        if (Len<=0) break;
+        Sent+=Len;
+    }
+
+    CloseStatsClient (Client);
+}  // OnStatsClient
+// -------------------------------------------------------------
+
+static void OnStatsConnection (void* UserInstance, uint64_t Count)
+{
+    int ClientFD;
+    TStatsClient* Client = 0;
+
+    ClientFD = accept4 (ListenFD, 0, 0, SOCK_CLOEXEC|SOCK_NONBLOCK);
+    if (ClientFD<0) return;
+
+    for (unsigned int c=0; c<STATS_MAX_CLIENTS; c++)
+    {
+        if (Clients[c].FD<0)
+        {
+            Client = &Clients[c];
+            break;
+        }
+    }
+    if (Client==0)
+    {   // All slots used by clients waiting for their request
+        close (ClientFD);
+        return;
+    }
+
+    // The answer is sent when the request line arrives
+    Client->FD = ClientFD;
+    Client->Age = 0;
+    if (!AddEventSource (ClientFD, &OnStatsClient, Client))
+    {
+        close (ClientFD);
+        Client->FD = -1;
+    }
+}  // OnStatsConnection
+// -------------------------------------------------------------
+
+static void OnRateTimer (void* UserInstance, uint64_t Count)
+{
+    uint64_t Packets;
+
+    for (unsigned int s=0; s<NumStatsSessions; s++)
+    {
+        Packets = Get (SessionStats[s].RxPackets);
+        SessionRates[s].RxPacketRate = (Packets-SessionRates[s].LastRxPackets)*1000/(STATS_RATE_PERIOD_MS*Count);
+        SessionRates[s].LastRxPackets = Packets;
+
+        Packets = Get (SessionStats[s].TxPackets);
+        SessionRates[s].TxPacketRate = (Packets-SessionRates[s].LastTxPackets)*1000/(STATS_RATE_PERIOD_MS*Count);
+        SessionRates[s].LastTxPackets = Packets;
+    }
+
+    // Close clients which connected and never sent a request
+    for (unsigned int c=0; c<STATS_MAX_CLIENTS; c++)
+    {
+        if (Clients[c].FD<0) continue;
+        Clients[c].Age+=Count;
+        if (Clients[c].Age>=STATS_CLIENT_TIMEOUT)
+            CloseStatsClient (&Clients[c]);
+    }
+}  // OnRateTimer
+// -------------------------------------------------------------
+
+bool OpenStatsSocket (const char* Path, unsigned int NumSessions)
+{
+    struct sockaddr_un Addr;
+
+    if (strlen (Path)>=sizeof(Addr.sun_path))
+    {
+        fprintf (stderr, "jacknetumpd : statistics socket path is too long\n");
+        return false;
+    }
+
+    NumStatsSessions = (NumSessions>STATS_MAX_SESSIONS) ? STATS_MAX_SESSIONS : NumSessions;
+    for (unsigned int c=0; c<STATS_MAX_CLIENTS; c++)
+        Clients[c].FD = -1;
+
+    ListenFD = socket (AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (ListenFD<0)
+    {
+        fprintf (stderr, "jacknetumpd : can not create statistics socket (%s)\n", strerror(errno));
+        return false;
+    }
+
+    memset (&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    strcpy (Addr.sun_path, Path);
+    strcpy (SocketPath, Path);
+    unlink (Path);      // Left by a previous instance
+
+    if ((bind (ListenFD, (struct sockaddr*)&Addr, sizeof(Addr))<0)||(listen (ListenFD, 4)<0))
+    {
+        fprintf (stderr, "jacknetumpd : can not listen on statistics socket %s (%s)\n", Path, strerror(errno));
+        close (ListenFD);
+        ListenFD = -1;
+        return false;
+    }
+
+    if (!AddEventSource (ListenFD, &OnStatsConnection, 0))
+    {
+        CloseStatsSocket();
+        return false;
+    }
+
+    RateTimerFD = AddEventTimer (STATS_RATE_PERIOD_MS, &OnRateTimer, 0);
+    fprintf (stdout, "jacknetumpd : statistics available on %s\n", Path);
+    return true;
+}  // OpenStatsSocket
+// -------------------------------------------------------------
+
+void CloseStatsSocket (void)
+{
+    if (RateTimerFD>=0)
+    {
+        RemoveEventTimer (RateTimerFD);
+        RateTimerFD = -1;
+    }
+
+    if (ListenFD>=0)
+    {
+        // Client slots are only valid once the socket has been opened
+        for (unsigned int c=0; c<STATS_MAX_CLIENTS; c++)
+        {
+            if (Clients[c].FD>=0)
+                CloseStatsClient (&Clients[c]);
+        }
+        RemoveEventSource (ListenFD);
+        close (ListenFD);
+        ListenFD = -1;
+        unlink (SocketPath);
+    }
+}  // CloseStatsSocket
+// -------------------------------------------------------------
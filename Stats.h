@@ -0,0 +1,79 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+/*
+ * Stats.h
+ * Runtime statistics of the daemon, exported on a Unix socket (--stats-socket)
+ *
+ * Every counter has a single writer thread (network thread or JACK thread, as noted
+ * below), so it is updated with a relaxed load and store : no locked instruction in
+ * the realtime path. The export runs in the network thread and only reads them
+ */
+
+#include <stdint.h>
+#include <atomic>
+
+#define STATS_MAX_SESSIONS      8
+
+enum {
+    DROP_RX_FIFO_FULL,          // Network thread : UMP2JACK FIFO full
+    DROP_JACK_BUFFER_FULL,      // JACK thread : message larger than an empty JACK output buffer
+    DROP_TX_FIFO_FULL,          // JACK thread : JACK2NET FIFO full, network thread late
+    DROP_RX_FIFO_OLDEST,        // JACK thread : oldest messages of UMP2JACK dropped to make room (--fifo-policy drop-oldest)
+    NUM_DROP_REASONS
+};
+
+typedef struct {
+    // Network thread
+    std::atomic<uint64_t> RxMessages [16];      // By message type
+    std::atomic<uint64_t> RxBytes;
+    std::atomic<uint64_t> RxPackets;            // Datagrams read after a socket wake-up (several per wake-up when queued)
+    std::atomic<uint64_t> TxMessages [16];
+    std::atomic<uint64_t> TxBytes;
+    std::atomic<uint64_t> TxPackets;            // RunSession() calls flushing queued messages
+    std::atomic<uint32_t> JACK2NETHighWater;    // In words
+    std::atomic<uint64_t> FECCopies;            // Redundant copies sent
+    std::atomic<uint64_t> FECDuplicates;        // Redundant copies received and dropped
+    std::atomic<uint64_t> RxFiltered;           // Messages from the network removed by the routing table
+    std::atomic<uint64_t> RxCollapsed;          // Controller updates replaced before being queued, UMP2JACK nearly full
+    // JACK thread
+    std::atomic<uint64_t> JackEventsIn;
+    std::atomic<uint64_t> JackEventsOut;
+    std::atomic<uint64_t> TranscodeFailures;
+    std::atomic<uint64_t> TxFiltered;           // Messages from JACK removed by the routing table
+    std::atomic<uint32_t> UMP2JACKHighWater;    // In words
+    std::atomic<uint64_t> Coalesced;            // Controller updates replaced by a later one in the same period
+    std::atomic<uint64_t> Deferred;             // Periods ending with due messages left in the FIFO (JACK buffer full)
+    // Network thread or JACK thread, see reasons above
+    std::atomic<uint64_t> Drops [NUM_DROP_REASONS];
+    // Session state
+    std::atomic<bool> Connected;
+    std::atomic<uint8_t> Protocol;
+} TSessionStats;
+
+static inline void StatAdd (std::atomic<uint64_t>& Counter, uint64_t Value)
+{
+    Counter.store (Counter.load (std::memory_order_relaxed)+Value, std::memory_order_relaxed);
+}
+
+static inline void StatMax (std::atomic<uint32_t>& Mark, uint32_t Value)
+{
+    if (Value>Mark.load (std::memory_order_relaxed))
+        Mark.store (Value, std::memory_order_relaxed);
+}
+
+//! Get the statistics of a session (Index < STATS_MAX_SESSIONS)
+TSessionStats* GetSessionStats (unsigned int Index);
+
+//! Called by the JACK xrun callback
+void StatsXrun (void);
+
+//! Called by the JACK thread at the end of each period with the time spent in the process callback
+void StatsProcessTime (uint64_t Ns);
+
+//! Listen for statistics requests on a Unix socket, served by the event loop
+//! A request line "json" or "GET /stats.json" gets JSON, anything else Prometheus text
+bool OpenStatsSocket (const char* Path, unsigned int NumSessions);
+void CloseStatsSocket (void);
+
+#endif // __STATS_H__
@@ -0,0 +1,291 @@
+/*
+ * SysEx.cpp
+ * Streaming SYSEX conversion between UMP (MT 3 / MT 5) and MIDI 1.0 byte stream
+ *
+ * Nothing is allocated after Init(), so both directions can run in the JACK process callback
+ */
+
+#include <string.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "SysEx.h"
+
+#define SYSEX_STATUS_COMPLETE   0
+#define SYSEX_STATUS_START      1
+#define SYSEX_STATUS_CONTINUE   2
+#define SYSEX_STATUS_END        3
+
+CSysExAssembler::CSysExAssembler (void)
+{
+    for (unsigned int g=0; g<SYSEX_NUM_GROUPS; g++)
+    {
+        Groups[g].Data = 0;
+        Groups[g].Length = 0;
+        Groups[g].EmitPos = 0;
+        Groups[g].InProgress = false;
+        Groups[g].Ready = false;
+        Groups[g].Overflow = false;
+        Groups[g].PortMask = 1;
+    }
+    NumReady = 0;
+}  // CSysExAssembler::CSysExAssembler
+// -------------------------------------------------------------
+
+CSysExAssembler::~CSysExAssembler (void)
+{
+    for (unsigned int g=0; g<SYSEX_NUM_GROUPS; g++)
+    {
+        delete[] Groups[g].Data;
+        Groups[g].Data = 0;
+    }
+}  // CSysExAssembler::~CSysExAssembler
+// -------------------------------------------------------------
+
+bool CSysExAssembler::Init (void)
+{
+    for (unsigned int g=0; g<SYSEX_NUM_GROUPS; g++)
+    {
+        if (Groups[g].Data==0)
+            Groups[g].Data = new uint8_t [SYSEX_BUFFER_SIZE];
+        if (Groups[g].Data==0)
+            return false;
+    }
+    return true;
+}  // CSysExAssembler::Init
+// -------------------------------------------------------------
+
+void CSysExAssembler::AddByte (TSysExBuffer* Buffer, uint8_t Byte)
+{
+    if (Buffer->Length>=SYSEX_BUFFER_SIZE)
+    {
+        Buffer->Overflow = true;
+        return;
+    }
+    Buffer->Data[Buffer->Length++] = Byte;
+}  // CSysExAssembler::AddByte
+// -------------------------------------------------------------
+
+bool CSysExAssembler::AddPacket (const uint32_t* UMP, uint32_t PortMask)
+{
+    TSysExBuffer* Buffer;
+    uint8_t Bytes [13];
+    unsigned int NumBytes;
+    unsigned int Status;
+    unsigned int MT;
+    unsigned int Group;
+
+    MT = UMP[0]>>28;
+    Status = (UMP[0]>>20)&0x0F;
+    NumBytes = (UMP[0]>>16)&0x0F;
+    Group = (UMP[0]>>24)&0x0F;
+    Buffer = &Groups[Group];
+    if (Buffer->Data==0) return false;
+    if (Buffer->Ready) return false;        // Previous message of the group has not been emitted yet
+
+    if (MT==0x03)
+    {  // SYSEX7 : up to 6 bytes in 64 bits
+        if (NumBytes>6) NumBytes = 6;
+        Bytes[0] = (UMP[0]>>8)&0xFF;
+        Bytes[1] = UMP[0]&0xFF;
+        Bytes[2] = (UMP[1]>>24)&0xFF;
+        Bytes[3] = (UMP[1]>>16)&0xFF;
+        Bytes[4] = (UMP[1]>>8)&0xFF;
+        Bytes[5] = UMP[1]&0xFF;
+    }
+    else if (MT==0x05)
+    {  // SYSEX8 : stream ID + up to 13 bytes in 128 bits. Mixed Data Sets are not supported
+        if (Status>SYSEX_STATUS_END) return false;
+        if (NumBytes>0) NumBytes -= 1;      // Stream ID is counted in the number of bytes
+        if (NumBytes>13) NumBytes = 13;
+        Bytes[0] = UMP[0]&0xFF;
+        for (unsigned int i=0; i<12; i++)
+            Bytes[i+1] = (UMP[1+(i>>2)]>>(24-8*(i&3)))&0xFF;
+    }
+    else return false;
+
+    if ((Status==SYSEX_STATUS_COMPLETE)||(Status==SYSEX_STATUS_START))
+    {
+        Buffer->Length = 0;
+        Buffer->EmitPos = 0;
+        Buffer->Overflow = false;
+        Buffer->InProgress = true;
+        AddByte (Buffer, 0xF0);
+    }
+    else if (!Buffer->InProgress)
+    {
+        return false;       // Continue or End without Start
+    }
+
+    for (unsigned int i=0; i<NumBytes; i++)
+    {
+        // MIDI 1.0 can only carry 7-bit data : SYSEX8 messages using 8 bits are dropped
+        if (Bytes[i]&0x80)
+            Buffer->Overflow = true;
+        AddByte (Buffer, Bytes[i]);
+    }
+
+    if ((Status==SYSEX_STATUS_COMPLETE)||(Status==SYSEX_STATUS_END))
+    {
+        AddByte (Buffer, 0xF7);
+        Buffer->InProgress = false;
+        if (!Buffer->Overflow)
+        {
+            Buffer->Ready = true;
+            Buffer->PortMask = PortMask;
+            ReadyOrder[NumReady++] = Group;
+            return true;
+        }
+    }
+
+    return false;
+}  // CSysExAssembler::AddPacket
+// -------------------------------------------------------------
+
+bool CSysExAssembler::EmitReady (void** PortBuffers, uint32_t Offset)
+{
+    TSysExBuffer* Buffer;
+    jack_midi_data_t* Event;
+    size_t MaxSize;
+    unsigned int Remaining;
+    unsigned int Chunk;
+    unsigned int Port;
+
+    // Oldest message first : a message which has to wait keeps the next ones waiting too
+    while (NumReady>0)
+    {
+        Buffer = &Groups[ReadyOrder[0]];
+        Remaining = Buffer->Length-Buffer->EmitPos;
+        Chunk = Remaining;
+
+        // All the ports get the same part of the message, it must fit in each of them
+        for (uint32_t Ports=Buffer->PortMask; Ports!=0; Ports&=Ports-1)
+        {
+            Port = __builtin_ctz (Ports);
+            MaxSize = jack_midi_max_event_size (PortBuffers[Port]);
+            if (MaxSize<Remaining)
+            {
+                // Wait for next period, unless the message can not fit even in an empty buffer
+                if (jack_midi_get_event_count (PortBuffers[Port])>0)
+                    return false;
+                if (MaxSize<Chunk) Chunk = MaxSize;
+            }
+        }
+        if (Chunk==0)
+            return false;
+
+        for (uint32_t Ports=Buffer->PortMask; Ports!=0; Ports&=Ports-1)
+        {
+            Event = jack_midi_event_reserve (PortBuffers[__builtin_ctz (Ports)], Offset, Chunk);
+            if (Event)
+                memcpy (Event, &Buffer->Data[Buffer->EmitPos], Chunk);
+        }
+        Buffer->EmitPos += Chunk;
+        if (Buffer->EmitPos<Buffer->Length)
+            return false;
+
+        Buffer->Ready = false;
+        Buffer->Length = 0;
+        Buffer->EmitPos = 0;
+        NumReady--;
+        memmove (&ReadyOrder[0], &ReadyOrder[1], NumReady);
+    }
+
+    return true;
+}  // CSysExAssembler::EmitReady
+// -------------------------------------------------------------
+
+void InitSysExTx (TSysExTxState* State)
+{
+    State->InProgress = false;
+    State->StartSent = false;
+    State->Dropped = false;
+    State->NumPending = 0;
+}  // InitSysExTx
+// -------------------------------------------------------------
+
+bool IsSysExEvent (const TSysExTxState* State, const uint8_t* Data, size_t Size)
+{
+    if (Size==0) return false;
+    if (Data[0]==0xF0) return true;
+
+    // Continuation of a SYSEX split over several JACK events
+    if ((State->InProgress)&&((Data[0]<0x80)||(Data[0]==0xF7))) return true;
+    return false;
+}  // IsSysExEvent
+// -------------------------------------------------------------
+
+static void MakeSysExPacket (uint8_t Group, unsigned int Status, const uint8_t* Bytes, unsigned int NumBytes, uint32_t* Words)
+{
+    uint8_t Padded [6] = {0, 0, 0, 0, 0, 0};
+
+    memcpy (Padded, Bytes, NumBytes);
+    Words[0] = 0x30000000|((Group&0x0F)<<24)|(Status<<20)|(NumBytes<<16)|(Padded[0]<<8)|Padded[1];
+    Words[1] = (Padded[2]<<24)|(Padded[3]<<16)|(Padded[4]<<8)|Padded[5];
+}  // MakeSysExPacket
+// -------------------------------------------------------------
+
+unsigned int SegmentSysEx (TSysExTxState* State, uint8_t Group, const uint8_t* Data, size_t Size, size_t* Pos,
+                           uint32_t* Words, unsigned int MaxWords)
+{
+    unsigned int NumWords = 0;
+    uint8_t Byte;
+
+    while (*Pos<Size)
+    {
+        Byte = Data[*Pos];
+
+        if (Byte==0xF0)
+        {  // New message (an unterminated previous one is abandoned)
+            InitSysExTx (State);
+            State->InProgress = true;
+            (*Pos)++;
+            continue;
+        }
+
+        if (!State->InProgress)
+        {
+            (*Pos)++;
+            continue;
+        }
+
+        if (State->Dropped)
+        {  // Part of the message is lost : the peer would only get an orphan Continue or End
+            if (Byte==0xF7) InitSysExTx (State);
+            (*Pos)++;
+            continue;
+        }
+
+        if (Byte==0xF7)
+        {  // Pending bytes are the last ones of the message
+            if (NumWords+2>MaxWords) break;
+            MakeSysExPacket (Group, State->StartSent ? SYSEX_STATUS_END : SYSEX_STATUS_COMPLETE,
+                             State->Pending, State->NumPending, &Words[NumWords]);
+            NumWords += 2;
+            InitSysExTx (State);
+            (*Pos)++;
+            continue;
+        }
+
+        if (Byte>=0x80)
+        {  // Realtime messages inside SYSEX are not forwarded
+            (*Pos)++;
+            continue;
+        }
+
+        // Packets are sent only when the next byte is known, so we know which one is the last
+        if (State->NumPending==6)
+        {
+            if (NumWords+2>MaxWords) break;
+            MakeSysExPacket (Group, State->StartSent ? SYSEX_STATUS_CONTINUE : SYSEX_STATUS_START,
+                             State->Pending, 6, &Words[NumWords]);
+            NumWords += 2;
+            State->StartSent = true;
+            State->NumPending = 0;
+        }
+        State->Pending[State->NumPending++] = Byte;
+        (*Pos)++;
+    }
+
+    return NumWords;
+}  // SegmentSysEx
+// -------------------------------------------------------------
@@ -0,0 +1,74 @@
+#ifndef __SYSEX_H__
+#define __SYSEX_H__
+
+/*
+ * SysEx.h
+ * Streaming SYSEX conversion between UMP (MT 3 / MT 5) and MIDI 1.0 byte stream
+ *
+ * Reception : UMP SYSEX packets are reassembled in one preallocated buffer per group
+ * and a complete F0...F7 message is given to JACK as a single event
+ * Transmission : JACK SYSEX events (complete or fragmented) are segmented into MT 3 packets
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SYSEX_BUFFER_SIZE   65536       // Maximum SYSEX size received from the network, per group
+#define SYSEX_NUM_GROUPS    16
+
+typedef struct {
+    uint8_t* Data;
+    unsigned int Length;
+    unsigned int EmitPos;       // Bytes already given to JACK
+    bool InProgress;            // Start packet received, waiting for the end
+    bool Ready;                 // Complete message waiting to be emitted
+    bool Overflow;              // Message too long, dropped until next start
+    uint32_t PortMask;          // JACK ports the message goes to (routing table of the end packet)
+} TSysExBuffer;
+
+class CSysExAssembler
+{
+public:
+    CSysExAssembler (void);
+    ~CSysExAssembler (void);
+
+    //! Allocate the group buffers. Must be called before the realtime thread uses the object
+    bool Init (void);
+
+    //! Add a MT 3 or MT 5 UMP packet going to the JACK ports of PortMask (bit n : PortBuffers[n] of EmitReady)
+    //! Returns true when a message has been completed and must be emitted
+    bool AddPacket (const uint32_t* UMP, uint32_t PortMask);
+
+    //! Emit the completed messages, in the order they were completed, into the JACK MIDI buffers of their
+    //! port mask. Messages which do not fit in the buffers are kept (or split if larger than an empty buffer).
+    //! Returns false if something is still pending
+    bool EmitReady (void** PortBuffers, uint32_t Offset);
+
+private:
+    TSysExBuffer Groups [SYSEX_NUM_GROUPS];
+    uint8_t ReadyOrder [SYSEX_NUM_GROUPS];      // Groups of the completed messages, oldest first
+    unsigned int NumReady;
+
+    void AddByte (TSysExBuffer* Buffer, uint8_t Byte);
+};
+
+typedef struct {
+    bool InProgress;            // F0 received, waiting for F7
+    bool StartSent;             // Start packet sent, next ones are Continue or End
+    bool Dropped;               // A packet of the message has been dropped : the rest is skipped up to F7
+    uint8_t Pending [6];        // Bytes waiting to complete a packet
+    unsigned int NumPending;
+} TSysExTxState;
+
+void InitSysExTx (TSysExTxState* State);
+
+//! Check if a JACK MIDI event is (part of) a SYSEX message
+bool IsSysExEvent (const TSysExTxState* State, const uint8_t* Data, size_t Size);
+
+//! Segment a SYSEX event into MT 3 UMP packets (2 words each)
+//! Data is consumed from *Pos, stops when MaxWords is reached. Returns the number of words generated
+//! Nothing is generated for the rest of a message once State->Dropped is set
+unsigned int SegmentSysEx (TSysExTxState* State, uint8_t Group, const uint8_t* Data, size_t Size, size_t* Pos,
+                           uint32_t* Words, unsigned int MaxWords);
+
+#endif // __SYSEX_H__
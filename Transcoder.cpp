@@ -0,0 +1,71 @@
+/*
+ * Transcoder.cpp
+ * Table driven conversion between UMP (MT 1 / MT 2) and MIDI 1.0 byte stream
+ *
+ * For MT 1 and MT 2, the second byte of the UMP word is the MIDI 1.0 status byte and
+ * the message bytes are the three lower bytes of the word, so conversion is a table
+ * lookup on (MT, status) followed by a byte copy.
+ */
+
+#include <string.h>
+#include "Transcoder.h"
+
+typedef struct {
+    uint8_t UMPToMIDI1 [0x300];     // Index : MT<<8 | status byte, only MT 1 and MT 2 are valid
+} TTranscoderTables;
+
+static constexpr TTranscoderTables MakeTranscoderTables (void)
+{
+    TTranscoderTables Tables {};
+
+    for (unsigned int Status=0; Status<0x100; Status++)
+    {
+        // Channel Voice messages must be MT 2, System messages MT 1
+        Tables.UMPToMIDI1[0x100|Status] = (Status>=0xF0) ? GetMIDI1Length (Status) : 0;
+        Tables.UMPToMIDI1[0x200|Status] = (Status<0xF0) ? GetMIDI1Length (Status) : 0;
+    }
+    return Tables;
+}  // MakeTranscoderTables
+// -------------------------------------------------------------
+
+static constexpr TTranscoderTables Tables = MakeTranscoderTables ();
+
+//! Table index for a UMP word, 0 (invalid) for other message types than MT 1 / MT 2
+static inline unsigned int GetTableIndex (uint32_t Word)
+{
+    unsigned int MT = Word>>28;
+
+    if ((MT-1)>1) return 0;
+    return (MT<<8)|((Word>>16)&0xFF);
+}  // GetTableIndex
+// -------------------------------------------------------------
+
+unsigned int TranscodeUMPMessage_MIDI1 (const uint32_t* UMP, uint8_t* MIDIMsg)
+{
+    unsigned int Length = Tables.UMPToMIDI1[GetTableIndex (UMP[0])];
+
+    MIDIMsg[0] = (UMP[0]>>16)&0xFF;
+    MIDIMsg[1] = (UMP[0]>>8)&0xFF;
+    MIDIMsg[2] = UMP[0]&0xFF;
+    return Length;
+}  // TranscodeUMPMessage_MIDI1
+// -------------------------------------------------------------
+
+bool TranscodeMIDI1Message_UMP (const uint8_t* MIDIMsg, size_t Size, uint8_t Group, uint32_t* UMP)
+{
+    uint8_t Status;
+    unsigned int Length;
+    uint32_t MT;
+
+    if (Size==0) return false;
+    Status = MIDIMsg[0];
+    Length = MIDI1LengthTable.Length[Status];
+    if ((Length==0)||(Size<Length)) return false;
+
+    MT = (Status>=0xF0) ? 0x1 : 0x2;
+    UMP[0] = (MT<<28)|((Group&0x0F)<<24)|(Status<<16);
+    if (Length>=2) UMP[0] |= (MIDIMsg[1]&0x7F)<<8;
+    if (Length==3) UMP[0] |= MIDIMsg[2]&0x7F;
+    return true;
+}  // TranscodeMIDI1Message_UMP
+// -------------------------------------------------------------
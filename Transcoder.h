@@ -0,0 +1,62 @@
+#ifndef __TRANSCODER_H__
+#define __TRANSCODER_H__
+
+/*
+ * Transcoder.h
+ * Table driven conversion between UMP (MT 1 / MT 2) and MIDI 1.0 byte stream
+ *
+ * Lengths come from lookup tables generated at compile time, indexed by message type
+ * and status byte, so a message is converted without branching on its type.
+ * The MIDI 1.0 length table is shared with the other modules parsing MIDI 1.0 bytes.
+ * SYSEX (MT 3) and MIDI 2.0 (MT 4) are handled by SysEx.cpp and MIDI2Convert.cpp
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+//! Number of 32-bit words of a UMP message, from its message type
+static constexpr unsigned int UMPWordCount [16] = {1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4};
+
+// Length of MIDI 1.0 messages which can be carried by MT 1 / MT 2, 0 otherwise
+static constexpr uint8_t GetMIDI1Length (unsigned int Status)
+{
+    return (Status<0x80) ? 0 :
+           (Status<0xC0) ? 3 :
+           (Status<0xE0) ? 2 :
+           (Status<0xF0) ? 3 :
+           (Status==0xF1) ? 2 :
+           (Status==0xF2) ? 3 :
+           (Status==0xF3) ? 2 :
+           (Status==0xF6) ? 1 :
+           (Status>=0xF8) ? ((Status==0xF9)||(Status==0xFD) ? 0 : 1) :
+           0;       // SYSEX (F0 / F7) and undefined F4 / F5
+}
+
+typedef struct {
+    uint8_t Length [0x100];         // Index : status byte
+} TMIDI1LengthTable;
+
+static constexpr TMIDI1LengthTable MakeMIDI1LengthTable (void)
+{
+    TMIDI1LengthTable Table {};
+
+    for (unsigned int Status=0; Status<0x100; Status++)
+        Table.Length[Status] = GetMIDI1Length (Status);
+    return Table;
+}
+
+static constexpr TMIDI1LengthTable MIDI1LengthTable = MakeMIDI1LengthTable ();
+
+//! Length of a MIDI 1.0 message from its status byte (0 for SYSEX, undefined status and data bytes)
+static inline unsigned int GetMIDI1MessageLength (uint8_t Status)
+{
+    return MIDI1LengthTable.Length[Status];
+}
+
+//! Convert one MT 1 / MT 2 message. Returns the number of MIDI 1.0 bytes, 0 if not convertible
+unsigned int TranscodeUMPMessage_MIDI1 (const uint32_t* UMP, uint8_t* MIDIMsg);
+
+//! Convert one complete MIDI 1.0 message (not SYSEX) into MT 1 / MT 2. Returns false if not convertible
+bool TranscodeMIDI1Message_UMP (const uint8_t* MIDIMsg, size_t Size, uint8_t Group, uint32_t* UMP);
+
+#endif // __TRANSCODER_H__
@@ -0,0 +1,199 @@
+#ifndef __UMPRING_H__
+#define __UMPRING_H__
+
+/*
+ * UMPRing.h
+ * Lock-free single producer / single consumer ring of 32-bit words
+ *
+ * Indices are free running counters, masked on access, so the whole buffer
+ * can be used. The producer publishes data with a release store on WriteIndex,
+ * the consumer frees space with a release store on ReadIndex : each side only
+ * writes its own index, which is kept on its own cache line.
+ * The consumer reads whole messages with Read(), and can move a block of messages
+ * to another ring with PushFrom() : both copy contiguous spans of the buffer
+ * (at most one split at the wrap point) rather than single words.
+ *
+ * CUMPRing has its buffer inside the object, with a size set at compile time.
+ * CUMPDynamicRing allocates it once, with a size given at startup (must be done
+ * before the producer and the consumer run).
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#define UMPRING_CACHE_LINE  64
+
+class CUMPRingBase
+{
+public:
+    //! Number of words the ring can hold
+    unsigned int GetSize (void) const { return Size; }
+
+    //! Empty the ring. Must not be called while a producer or consumer is running
+    void Reset (void)
+    {
+        WriteIndex.store (0, std::memory_order_relaxed);
+        ReadIndex.store (0, std::memory_order_relaxed);
+    }
+
+    //! Producer side : number of words which can be pushed
+    unsigned int GetFreeSpace (void) const
+    {
+        return Size-(WriteIndex.load(std::memory_order_relaxed)-ReadIndex.load(std::memory_order_acquire));
+    }
+
+    //! Producer side : store NumWords words and publish them with a single index update
+    //! Nothing is written if there is not enough space
+    bool Push (const uint32_t* Words, unsigned int NumWords)
+    {
+        uint32_t Write = WriteIndex.load (std::memory_order_relaxed);
+        unsigned int Start;
+        unsigned int FirstPart;
+
+        if (NumWords>Size-(Write-ReadIndex.load(std::memory_order_acquire)))
+            return false;
+
+        Start = Write&(Size-1);
+        FirstPart = Size-Start;
+        if (FirstPart>=NumWords)
+        {
+            memcpy (&Buffer[Start], Words, NumWords*sizeof(uint32_t));
+        }
+        else
+        {
+            memcpy (&Buffer[Start], Words, FirstPart*sizeof(uint32_t));
+            memcpy (&Buffer[0], Words+FirstPart, (NumWords-FirstPart)*sizeof(uint32_t));
+        }
+
+        WriteIndex.store (Write+NumWords, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer side : number of words available. Words up to this count can be read with Peek()
+    unsigned int GetReadAvailable (void) const
+    {
+        return WriteIndex.load(std::memory_order_acquire)-ReadIndex.load(std::memory_order_relaxed);
+    }
+
+    //! Consumer side : read a word at Offset from the read position, without consuming it
+    uint32_t Peek (unsigned int Offset) const
+    {
+        return Buffer[(ReadIndex.load(std::memory_order_relaxed)+Offset)&(Size-1)];
+    }
+
+    //! Consumer side : get the contiguous block of readable words starting at Offset from the read position
+    //! Returns the number of words in the block (may be less than available at the wrap point)
+    unsigned int GetReadSpan (unsigned int Offset, const uint32_t** Span) const
+    {
+        uint32_t Read = ReadIndex.load (std::memory_order_relaxed)+Offset;
+        unsigned int Available = WriteIndex.load(std::memory_order_acquire)-Read;
+        unsigned int Start = Read&(Size-1);
+
+        *Span = &Buffer[Start];
+        if (Available>Size-Start)
+            return Size-Start;
+        return Available;
+    }
+
+    //! Consumer side : copy NumWords words at Offset from the read position, without consuming them
+    //! Offset+NumWords must not be more than GetReadAvailable()
+    void Read (unsigned int Offset, uint32_t* Words, unsigned int NumWords) const
+    {
+        unsigned int Start = (ReadIndex.load(std::memory_order_relaxed)+Offset)&(Size-1);
+        unsigned int FirstPart = Size-Start;
+
+        if (FirstPart>=NumWords)
+        {
+            memcpy (Words, &Buffer[Start], NumWords*sizeof(uint32_t));
+        }
+        else
+        {
+            memcpy (Words, &Buffer[Start], FirstPart*sizeof(uint32_t));
+            memcpy (Words+FirstPart, &Buffer[0], (NumWords-FirstPart)*sizeof(uint32_t));
+        }
+    }
+
+    //! Consumer side : release NumWords words to the producer
+    void Consume (unsigned int NumWords)
+    {
+        ReadIndex.store (ReadIndex.load(std::memory_order_relaxed)+NumWords, std::memory_order_release);
+    }
+
+    //! Producer side of this ring, consumer side of Source : move the first NumWords words of Source, copied
+    //! span by span, and publish them with a single index update. Nothing is moved if they do not fit
+    bool PushFrom (CUMPRingBase& Source, unsigned int NumWords)
+    {
+        uint32_t Write = WriteIndex.load (std::memory_order_relaxed);
+        const uint32_t* Span;
+        unsigned int SpanLen;
+        unsigned int Start;
+        unsigned int Done = 0;
+
+        if ((NumWords>Size-(Write-ReadIndex.load(std::memory_order_acquire)))||(NumWords>Source.GetReadAvailable()))
+            return false;
+
+        // Each copy stops at the wrap point of either ring
+        while (Done<NumWords)
+        {
+            SpanLen = Source.GetReadSpan (Done, &Span);
+            if (SpanLen>NumWords-Done) SpanLen = NumWords-Done;
+            Start = (Write+Done)&(Size-1);
+            if (SpanLen>Size-Start) SpanLen = Size-Start;
+            memcpy (&Buffer[Start], Span, SpanLen*sizeof(uint32_t));
+            Done += SpanLen;
+        }
+
+        WriteIndex.store (Write+NumWords, std::memory_order_release);
+        Source.Consume (NumWords);
+        return true;
+    }
+
+protected:
+    CUMPRingBase (uint32_t* Data, unsigned int DataSize) : WriteIndex(0), ReadIndex(0), Buffer(Data), Size(DataSize) { }
+
+    alignas(UMPRING_CACHE_LINE) std::atomic<uint32_t> WriteIndex;
+    alignas(UMPRING_CACHE_LINE) std::atomic<uint32_t> ReadIndex;
+    alignas(UMPRING_CACHE_LINE) uint32_t* Buffer;      // Read only once the ring is in use
+    unsigned int Size;
+};
+
+template <unsigned int RingSize> class CUMPRing : public CUMPRingBase
+{
+    static_assert ((RingSize&(RingSize-1))==0, "CUMPRing size must be a power of two");
+
+public:
+    CUMPRing (void) : CUMPRingBase(&Storage[0], RingSize) { }
+
+private:
+    alignas(UMPRING_CACHE_LINE) uint32_t Storage [RingSize];
+};
+
+class CUMPDynamicRing : public CUMPRingBase
+{
+public:
+    CUMPDynamicRing (void) : CUMPRingBase(0, 0) { }
+    ~CUMPDynamicRing (void) { free (Buffer); }
+
+    //! Allocate the buffer for at least NumWords words (rounded up to a power of two) and empty the ring.
+    //! The buffer is cleared, so its pages are mapped before the realtime threads use it. Returns false if out of memory
+    bool Allocate (unsigned int NumWords)
+    {
+        unsigned int NewSize = 1;
+        uint32_t* Data;
+
+        while (NewSize<NumWords) NewSize<<=1;
+        Data = (uint32_t*)aligned_alloc (UMPRING_CACHE_LINE, (NewSize*sizeof(uint32_t)+UMPRING_CACHE_LINE-1)&~(UMPRING_CACHE_LINE-1));
+        if (Data==0) return false;
+        memset (Data, 0, NewSize*sizeof(uint32_t));
+
+        free (Buffer);
+        Buffer = Data;
+        Size = NewSize;
+        Reset ();
+        return true;
+    }
+};
+
+#endif // __UMPRING_H__
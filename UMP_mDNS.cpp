@@ -3,15 +3,84 @@
  *
  *  Created on: 2 avr. 2023
  *      Author: Benoit
+ *
+ * mDNS responder for the _midi2._udp service (RFC 6762 / RFC 6763)
+ * - the host name is the first label of the system host name, with the characters not allowed in a host label
+ *   replaced by '-'
+ * - one service instance is advertised per session, with the port of the session. All of them share the host name
+ *   and the UMPEndpointName, each one has its own ProductInstanceId (base ID, then base ID-1, -2... for the next sessions)
+ * - the service instance name is probed when starting (3 queries, 250 ms apart) then announced twice, 1 s apart.
+ *   If another device answers with different data, the name is changed and probed again
+ * - PTR/SRV/TXT/A/AAAA queries are answered as soon as they are received. Records the querier already knows
+ *   (known answers with at least half the TTL left) are not sent again
+ * - the group is joined on every interface which is up (NetInterfaces), and packets are sent on each of them with
+ *   the A/AAAA records of that interface. Queries are answered with the addresses of the interface they came from.
+ *   When a link or an address changes, the interfaces are read again and the records are announced at once
+ * - records are announced again every MDNS_REANNOUNCE_MS for devices which never send queries
+ * - a goodbye packet (TTL = 0) is sent by TerminatemDNS
+ * Browser (StartmDNSBrowse) : _midi2._udp services announced by other devices are kept in a table until their
+ * TTL expires. PTR queries are sent with an interval doubling from 1 s to 1 minute, with the services already
+ * known as known answers, and services with missing SRV/TXT/A records are resolved with direct queries
+ * If port 5353 can not be used, records are only announced (no probing, no answers)
+ * Packets are built in a fixed buffer : every write is checked, and a record which does not fit is left out with
+ * all the records after it. A unicast answer which misses answer records has the TC bit set
  */
 
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <arpa/inet.h>
-#include <linux/if.h>
-#include <sys/ioctl.h>
 #include <stdio.h>
 #include <errno.h>
 #include "network.h"
+#include "RTSafe.h"
+#include "NetInterfaces.h"
+#include "UMP_mDNS.h"
+
+#define MDNS_PORT                   5353
+#define MDNS_GROUP                  0xE00000FB      // 224.0.0.251
+#define MDNS_TTL                    120             // 2 minutes (8 hours can be problematic for refreshing mDNS table on some devices)
+#define MDNS_LEGACY_TTL             10              // Answers to one-shot queries (not sent from port 5353)
+#define MDNS_MAX_PACKET             1500
+#define MDNS_LEGACY_MAX_QUESTIONS   4               // One-shot queries with more questions are not answered
+#define MDNS_LEGACY_MAX_QUESTION_BYTES  512         // Questions are sent back in the answer
+#define MDNS_MAX_NAME               256             // Uncompressed name, DNS wire format
+#define MDNS_MAX_POINTERS           16              // Compression pointers followed in one name
+#define MDNS_PROBE_COUNT            3
+#define MDNS_PROBE_INTERVAL_MS      250
+#define MDNS_ANNOUNCE_COUNT         2
+#define MDNS_ANNOUNCE_INTERVAL_MS   1000
+#define MDNS_REANNOUNCE_MS          60000           // Half the TTL
+#define MDNS_MAX_CONFLICTS          9
+#define MDNS_MAX_SERVICES           16              // Services kept by the browser
+#define MDNS_BROWSE_FIRST_MS        1000
+#define MDNS_BROWSE_MAX_MS          60000
+#define MDNS_RESOLVE_INTERVAL_MS    1000
+#define MDNS_GOODBYE_DELAY_MS       1000            // Records received with TTL = 0 are removed after one second
+
+#define DNS_TYPE_A          1
+#define DNS_TYPE_PTR        12
+#define DNS_TYPE_TXT        16
+#define DNS_TYPE_AAAA       28
+#define DNS_TYPE_SRV        33
+#define DNS_TYPE_ANY        255
+#define DNS_CLASS_IN        0x0001
+#define DNS_CLASS_FLUSH     0x8000          // Cache flush bit in answers, unicast response (QU) bit in questions
+#define DNS_FLAG_TC         0x0200          // Truncated
+
+// Records of the responder. PTR/SRV/TXT bits of service instance i are shifted by i*RR_INSTANCE_BITS
+#define RR_PTR              0x01
+#define RR_SRV              0x02
+#define RR_TXT              0x04
+#define RR_INSTANCE_BITS    3
+#define RR_ADDRESS          0x01000000      // A and AAAA records of the interface (above the bits of MDNS_MAX_INSTANCES)
+#define RR_SERVICES         0x02000000      // DNS-SD service type enumeration
+#define RR_OF(Instance, Records)    ((Records)<<((Instance)*RR_INSTANCE_BITS))
 
 typedef struct {
     unsigned short TransactionID;
@@ -22,21 +91,87 @@ typedef struct {
     unsigned short AdditionalRRs;
 } TMDNS_Header;
 
+typedef struct {
+    uint8_t Data [MDNS_MAX_PACKET];
+    unsigned int Len;
+    bool Full;                  // A write did not fit : nothing else is added
+} TMDNS_Packet;
+
+// Service found by the browser
+typedef struct {
+    bool Used;
+    uint8_t Instance [MDNS_MAX_NAME];
+    unsigned int InstanceLen;
+    uint32_t TTL;                   // Of the PTR record, for known-answer suppression
+    uint64_t ExpiryMs;
+    uint8_t Host [MDNS_MAX_NAME];
+    unsigned int HostLen;           // 0 until the SRV record is received
+    bool HasTXT;
+    bool HasAddress;
+    uint64_t LastResolveMs;
+    TmDNSService Info;
+} TBrowsedService;
+
+enum {
+    MDNS_PROBING,
+    MDNS_ANNOUNCING,
+    MDNS_ANNOUNCED,
+    MDNS_STOPPED                // Too many conflicts
+};
+
 static char MIDI2ProtocolName [] = "_midi2";
 static char UDPProtocolName [] = "_udp";
 static char LocalDomainName [] = "local";
-static char TargetName [] = "Zynthian V5";
-static char EndpointName [] = "Zynthian V5";
+#define HOST_LABEL_MAX              60              // Room left for the "-<n>" suffix of a conflict
+static char TargetName [HOST_LABEL_MAX+1] = "zynthian";
 #define PRODUCT_INSTANCE_ID_LEN     17
 static char ProductInstanceID [PRODUCT_INSTANCE_ID_LEN+1] = "ZYV5_000000000000";
 
 static char ProductInstanceIdTagStr [] = "ProductInstanceId=";
-#define PRODUCT_INSTANCEID_TAG_LEN 18       // Length of ProductInstanceIdStr
+static char EndpointNameTagStr [] = "UMPEndpointName=";
+#define MAX_TXT_STRING              200
+
+// Service instance advertised for one session
+typedef struct {
+    char ProductInstanceID [PRODUCT_INSTANCE_ID_LEN+5];     // Base ID, "-<session>" added after the first session
+    uint8_t Name [MDNS_MAX_NAME];
+    unsigned int NameLen;
+    uint8_t TXTData [2*(MAX_TXT_STRING+1)];
+    unsigned int TXTLen;
+    unsigned short Port;
+} TServiceInstance;
 
-static unsigned int mDNSPacketLen;
-static unsigned char mDNSPacket_ [512];
+// Names are kept in DNS wire format (length prefixed labels)
+static uint8_t ServiceName [MDNS_MAX_NAME];
+static unsigned int ServiceNameLen;
+static uint8_t ServicesName [MDNS_MAX_NAME];
+static unsigned int ServicesNameLen;
+static uint8_t HostName [MDNS_MAX_NAME];
+static unsigned int HostNameLen;
+static char EndpointName [MAX_TXT_STRING+1];
+static TServiceInstance Instances [MDNS_MAX_INSTANCES];
+static unsigned int NumInstances = 0;
 
 static TSOCKTYPE mDNSSocket = INVALID_SOCKET;
+static bool Responder = false;          // Socket is bound to port 5353 and receives queries
+static unsigned int State = MDNS_PROBING;
+static unsigned int StepCount = 0;      // Probes or announces sent in current state
+static uint64_t NextStepMs = 0;
+static unsigned int Conflicts = 0;
+
+static TNetInterface Interfaces [NET_MAX_INTERFACES];
+static unsigned int NumInterfaces = 0;
+static int JoinedIndexes [NET_MAX_INTERFACES];      // Interfaces on which the mDNS group is joined
+static unsigned int NumJoined = 0;
+static int InterfaceMonitor = -1;
+
+static bool Browsing = false;
+static char BrowsePattern [MDNS_MAX_SERVICE_NAME];
+static TBrowsedService Browsed [MDNS_MAX_SERVICES];
+static uint64_t NextBrowseMs = 0;
+static unsigned int BrowseIntervalMs = MDNS_BROWSE_FIRST_MS;
+
+static void RunBrowser (uint64_t NowMs);
 
 //! Transforms hex digit into ASCII
 static unsigned char hex2asc (unsigned char hex)
@@ -46,225 +181,1219 @@ static unsigned char hex2asc (unsigned char hex)
 }  // hex2asc
 // -------------------------------------------------------------
 
-void initUMP_mDNS(void)
-{
-    unsigned char* mDNSPacket;
-    char ProductName[64] = "UMPEndpointName=";
-    char* ProductInstanceIDPtr;
-    struct ifreq ifr{};
-    uint8_t mac_address [6];
-
-    CreateUDPSocket (&mDNSSocket, 0, false);
-
-    // Generate product instance ID from MAC Address of ETH0
-    strcpy (ifr.ifr_name, "eth0");
-    ioctl (mDNSSocket, SIOCGIFHWADDR, &ifr);
-    memcpy (mac_address, ifr.ifr_hwaddr.sa_data, 6);
-
-    ProductInstanceID[5] = hex2asc(mac_address[0]>>4);
-    ProductInstanceID[6] = hex2asc(mac_address[0]&0x0F);
-    ProductInstanceID[7] = hex2asc(mac_address[1]>>4);
-    ProductInstanceID[8] = hex2asc(mac_address[1]&0x0F);
-    ProductInstanceID[9] = hex2asc(mac_address[2]>>4);
-    ProductInstanceID[10] = hex2asc(mac_address[2]&0x0F);
-    ProductInstanceID[11] = hex2asc(mac_address[3]>>4);
-    ProductInstanceID[12] = hex2asc(mac_address[3]&0x0F);
-    ProductInstanceID[13] = hex2asc(mac_address[4]>>4);
-    ProductInstanceID[14] = hex2asc(mac_address[4]&0x0F);
-    ProductInstanceID[15] = hex2asc(mac_address[5]>>4);
-    ProductInstanceID[16] = hex2asc(mac_address[5]&0x0F);
-
-    mDNSPacket = &mDNSPacket_[0];
-    strcat (&ProductName[0], &EndpointName[0]);
-    ProductInstanceIDPtr=(char*)&ProductInstanceID[0];
-
-    TMDNS_Header* Header = (TMDNS_Header*)mDNSPacket;
-
-    // Compute size of the various strings
-    unsigned int MIDI2ProtocolNameLen = strlen (&MIDI2ProtocolName[0]);
-    unsigned int UDPProtocolNameLen = strlen (&UDPProtocolName[0]);
-    unsigned int LocalDomainNameLen = strlen (&LocalDomainName[0]);
-    //unsigned int KBServiceNameLen = strlen (&KBServiceName[0]);
-    unsigned int TargetNameLen = strlen (&TargetName[0]);
-    unsigned int ProductNameLen = strlen (&ProductName[0]);
-    unsigned int BufferPos;
-
-    Header->TransactionID = 0;
-    Header->Flags = htons (0x8400);
-    Header->Questions = 0;
-    Header->AnswerRRs = htons(4);    // Change depending on what follows
-    Header->AuthorityRRs = 0;
-    Header->AdditionalRRs = htons (0);       // Change depending on what follows
-
-    // Add the AnswerRR (from byte 12)
-    // Build the Name
-    BufferPos = 13;
-    mDNSPacket[12] = MIDI2ProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &MIDI2ProtocolName[0], MIDI2ProtocolNameLen);
-    BufferPos+=MIDI2ProtocolNameLen;
-    mDNSPacket[BufferPos++] = UDPProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &UDPProtocolName[0], UDPProtocolNameLen);
-    BufferPos+=UDPProtocolNameLen;
-    mDNSPacket[BufferPos++] = LocalDomainNameLen;
-    memcpy (&mDNSPacket[BufferPos], &LocalDomainName[0], LocalDomainNameLen);
-    BufferPos+=LocalDomainNameLen;
-    mDNSPacket[BufferPos++] = 0;        // NULL terminator after the string
-
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x0C;        // 0x000C = Type PTR
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x01;        // 0x0001 = Class IN
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x78;        // TTL = 120 seconds
-    mDNSPacket [BufferPos++] = 0x00;        // Length MSB
-    mDNSPacket [BufferPos++] = PRODUCT_INSTANCE_ID_LEN+MIDI2ProtocolNameLen+UDPProtocolNameLen+LocalDomainNameLen+4+1;   // Add length byte + NULL terminator
-
-    mDNSPacket [BufferPos++] = PRODUCT_INSTANCE_ID_LEN;
-    memcpy (&mDNSPacket[BufferPos], ProductInstanceIDPtr, PRODUCT_INSTANCE_ID_LEN);
-    BufferPos+=PRODUCT_INSTANCE_ID_LEN;
-    mDNSPacket[BufferPos++] = MIDI2ProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &MIDI2ProtocolName[0], MIDI2ProtocolNameLen);
-    BufferPos+=MIDI2ProtocolNameLen;
-    mDNSPacket[BufferPos++] = UDPProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &UDPProtocolName[0], UDPProtocolNameLen);
-    BufferPos+=UDPProtocolNameLen;
-    mDNSPacket[BufferPos++] = LocalDomainNameLen;
-    memcpy (&mDNSPacket[BufferPos], &LocalDomainName[0], LocalDomainNameLen);
-    BufferPos+=LocalDomainNameLen;
-    mDNSPacket[BufferPos++] = 0;        // NULL terminator after the string
-
-    // Add the Additional Records
-    // Add the SRV block
-    mDNSPacket [BufferPos++] = PRODUCT_INSTANCE_ID_LEN;
-    memcpy (&mDNSPacket[BufferPos], ProductInstanceIDPtr, PRODUCT_INSTANCE_ID_LEN);
-    BufferPos+=PRODUCT_INSTANCE_ID_LEN;
-    mDNSPacket[BufferPos++] = MIDI2ProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &MIDI2ProtocolName[0], MIDI2ProtocolNameLen);
-    BufferPos+=MIDI2ProtocolNameLen;
-    mDNSPacket[BufferPos++] = UDPProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &UDPProtocolName[0], UDPProtocolNameLen);
-    BufferPos+=UDPProtocolNameLen;
-    mDNSPacket[BufferPos++] = LocalDomainNameLen;
-    memcpy (&mDNSPacket[BufferPos], &LocalDomainName[0], LocalDomainNameLen);
-    BufferPos+=LocalDomainNameLen;
-    mDNSPacket[BufferPos++] = 0;        // NULL terminator after the string
-
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x21;        // 0x000C = Type SRV
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x01;        // 0x0001 = Class IN
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x78;        // TTL = 120 seconds
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 6+TargetNameLen+2;        // Data length
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;        // Priority
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;        // Weight
-    mDNSPacket [BufferPos++] = 0x15;
-    mDNSPacket [BufferPos++] = 0x80;        // Port 5504
-    mDNSPacket [BufferPos++] = TargetNameLen;
-    memcpy (&mDNSPacket[BufferPos], &TargetName[0], TargetNameLen);
-    BufferPos+=TargetNameLen;
-    mDNSPacket[BufferPos++] = 0;     // NULL terminator after the string
-
-    // Add the TXT block
-    // Name is built in the same way as for SRV
-    mDNSPacket [BufferPos++] = PRODUCT_INSTANCE_ID_LEN;
-    memcpy (&mDNSPacket[BufferPos], ProductInstanceIDPtr, PRODUCT_INSTANCE_ID_LEN);
-    BufferPos+=PRODUCT_INSTANCE_ID_LEN;
-    mDNSPacket[BufferPos++] = MIDI2ProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &MIDI2ProtocolName[0], MIDI2ProtocolNameLen);
-    BufferPos+=MIDI2ProtocolNameLen;
-    mDNSPacket[BufferPos++] = UDPProtocolNameLen;
-    memcpy (&mDNSPacket[BufferPos], &UDPProtocolName[0], UDPProtocolNameLen);
-    BufferPos+=UDPProtocolNameLen;
-    mDNSPacket[BufferPos++] = LocalDomainNameLen;
-    memcpy (&mDNSPacket[BufferPos], &LocalDomainName[0], LocalDomainNameLen);
-    BufferPos+=LocalDomainNameLen;
-    mDNSPacket[BufferPos++] = 0;        // NULL terminator after the string
-
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x10;        // 0x0010 = Type TXT
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x01;        // 0x0001 = Class IN
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x78;        // TTL = 120 seconds
-    mDNSPacket [BufferPos++] = 0x00;        // Length MSB
-
-	mDNSPacket [BufferPos++] = ProductNameLen+1+PRODUCT_INSTANCE_ID_LEN+1+PRODUCT_INSTANCEID_TAG_LEN;        // Data length (18 = size of "ProductInstanceID=" string)
-    mDNSPacket [BufferPos++] = ProductNameLen;      // First string
-    memcpy (&mDNSPacket[BufferPos], &ProductName[0], ProductNameLen);
-    BufferPos+=ProductNameLen;
-
-    mDNSPacket [BufferPos++] = PRODUCT_INSTANCE_ID_LEN+PRODUCT_INSTANCEID_TAG_LEN;      // Second string
-
-    memcpy (&mDNSPacket[BufferPos], &ProductInstanceIdTagStr, PRODUCT_INSTANCEID_TAG_LEN);
-    BufferPos+=PRODUCT_INSTANCEID_TAG_LEN;
-    memcpy (&mDNSPacket[BufferPos], ProductInstanceIDPtr, PRODUCT_INSTANCE_ID_LEN);
-    BufferPos+=PRODUCT_INSTANCE_ID_LEN;
-
-    // Add the A block (IP v4 address)
-    mDNSPacket [BufferPos++] = TargetNameLen;
-    memcpy (&mDNSPacket[BufferPos], &TargetName[0], TargetNameLen);
-    BufferPos+=TargetNameLen;
-    mDNSPacket [BufferPos++] = 0x00;    // Add NULL terminator
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x01;        // 0x0010 = Type A
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x01;        // 0x0001 = Class IN
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x78;        // TTL = 120 seconds
-    mDNSPacket [BufferPos++] = 0x00;
-    mDNSPacket [BufferPos++] = 0x04;        // Length = 4
-
-    // Get system IP address for eth0
-    strcpy (ifr.ifr_name, "eth0");
-    ifr.ifr_addr.sa_family = AF_INET;       // We want IPv4 address
-    ioctl (mDNSSocket, SIOCGIFADDR, &ifr);
-
-    // Add IP address
-    struct in_addr in = ((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr;
-    uint32_t IPV4Addr = htonl(in.s_addr);
-
-    mDNSPacket [BufferPos++] = (IPV4Addr>>24)&0xFF;
-    mDNSPacket [BufferPos++] = (IPV4Addr>>16)&0xFF;
-    mDNSPacket [BufferPos++] = (IPV4Addr>>8)&0xFF;
-    mDNSPacket [BufferPos++] = IPV4Addr&0xFF;
-
-    mDNSPacketLen = BufferPos;
-}  // initUMP_MDNS
+//! Build a DNS name from an optional first label (kept as one label, dots included) and a dotted domain. Returns the length
+static unsigned int BuildName (uint8_t* Name, const char* FirstLabel, const char* Domain)
+{
+    unsigned int Pos = 0;
+    unsigned int Len;
+
+    if (FirstLabel)
+    {
+        Len = strlen (FirstLabel);
+        if (Len>63) Len = 63;
+        Name[Pos++] = Len;
+        memcpy (&Name[Pos], FirstLabel, Len);
+        Pos += Len;
+    }
+
+    while (*Domain)
+    {
+        Len = strcspn (Domain, ".");
+        Name[Pos++] = Len;
+        memcpy (&Name[Pos], Domain, Len);
+        Pos += Len;
+        Domain += Len;
+        if (*Domain=='.') Domain++;
+    }
+    Name[Pos++] = 0;
+    return Pos;
+}  // BuildName
 // -------------------------------------------------------------
 
-void TerminatemDNS (void)
+//! Host label from a host name : first label only, characters other than letters, digits and '-' replaced by '-',
+//! no '-' at the ends. The current label is kept if nothing is left
+static void SetHostLabel (const char* Host)
 {
-    if (mDNSSocket!=INVALID_SOCKET)
+    char Label [HOST_LABEL_MAX+1];
+    unsigned int Len = 0;
+    unsigned int Start = 0;
+
+    for (unsigned int c=0; (Host[c]!=0)&&(Host[c]!='.')&&(Len<HOST_LABEL_MAX); c++)
+        Label[Len++] = ((isalnum ((unsigned char)Host[c]))&&(isascii (Host[c]))) ? Host[c] : '-';
+    while ((Len>0)&&(Label[Len-1]=='-')) Len--;
+    while ((Start<Len)&&(Label[Start]=='-')) Start++;
+    if (Start==Len) return;
+
+    memcpy (TargetName, &Label[Start], Len-Start);
+    TargetName[Len-Start] = 0;
+}  // SetHostLabel
+// -------------------------------------------------------------
+
+static void ReadHostLabel (void)
+{
+    char Host [256];
+
+    if (gethostname (Host, sizeof(Host))!=0)
     {
-        CloseSocket(&mDNSSocket);
+        fprintf (stderr, "jacknetumpd : can not read host name (%s), mDNS host is %s.local\n", strerror(errno), TargetName);
+        return;
+    }
+    Host[sizeof(Host)-1] = 0;
+    SetHostLabel (Host);
+}  // ReadHostLabel
+// -------------------------------------------------------------
+
+//! Give each session its service instance : port and ProductInstanceId. ProductInstanceID must be set before
+static void InitInstances (unsigned short FirstPort, unsigned int NumServices)
+{
+    if (NumServices<1) NumServices = 1;
+    if (NumServices>MDNS_MAX_INSTANCES) NumServices = MDNS_MAX_INSTANCES;
+
+    for (unsigned int i=0; i<NumServices; i++)
+    {
+        if (i==0)
+            snprintf (Instances[i].ProductInstanceID, sizeof(Instances[i].ProductInstanceID), "%s", ProductInstanceID);
+        else
+            snprintf (Instances[i].ProductInstanceID, sizeof(Instances[i].ProductInstanceID), "%s-%u", ProductInstanceID, i);
+        Instances[i].Port = FirstPort+i;
+    }
+    NumInstances = NumServices;
+}  // InitInstances
+// -------------------------------------------------------------
+
+//! Build the names and the TXT records. A suffix is added to the instance and host names after a conflict
+static void BuildRecords (void)
+{
+    char Label [64];
+    char Domain [32];
+    unsigned int Len;
+    TServiceInstance* Instance;
+
+    snprintf (Domain, sizeof(Domain), "%s.%s.%s", MIDI2ProtocolName, UDPProtocolName, LocalDomainName);
+    ServiceNameLen = BuildName (ServiceName, 0, Domain);
+    ServicesNameLen = BuildName (ServicesName, 0, "_services._dns-sd._udp.local");
+
+    if (Conflicts==0)
+        snprintf (Label, sizeof(Label), "%s", TargetName);
+    else
+        snprintf (Label, sizeof(Label), "%s-%u", TargetName, Conflicts+1);
+    HostNameLen = BuildName (HostName, Label, LocalDomainName);
+
+    for (unsigned int i=0; i<NumInstances; i++)
+    {
+        Instance = &Instances[i];
+        if (Conflicts==0)
+            snprintf (Label, sizeof(Label), "%.*s", PRODUCT_INSTANCE_ID_LEN+4, Instance->ProductInstanceID);
+        else
+            snprintf (Label, sizeof(Label), "%.*s (%u)", PRODUCT_INSTANCE_ID_LEN+4, Instance->ProductInstanceID, Conflicts+1);
+        Instance->NameLen = BuildName (Instance->Name, Label, Domain);
+
+        // TXT : UMPEndpointName=<name> ProductInstanceId=<id>
+        Len = snprintf ((char*)&Instance->TXTData[1], MAX_TXT_STRING+1, "%s%s", EndpointNameTagStr, EndpointName);
+        if (Len>MAX_TXT_STRING) Len = MAX_TXT_STRING;
+        Instance->TXTData[0] = Len;
+        Instance->TXTLen = Len+1;
+        Len = snprintf ((char*)&Instance->TXTData[Instance->TXTLen+1], MAX_TXT_STRING+1, "%s%s", ProductInstanceIdTagStr, Instance->ProductInstanceID);
+        Instance->TXTData[Instance->TXTLen] = Len;
+        Instance->TXTLen += Len+1;
+    }
+}  // BuildRecords
+// -------------------------------------------------------------
+
+//! Open port 5353. The mDNS group is joined per interface by JoinInterfaces. Returns false if the port can not be used
+static bool OpenResponderSocket (void)
+{
+    sockaddr_in Addr;
+    int One = 1;
+    unsigned char TTL = 255;
+
+    mDNSSocket = socket (AF_INET, SOCK_DGRAM, 0);
+    if (mDNSSocket==INVALID_SOCKET) return false;
+
+    // Other responders (avahi...) usually run on the same host
+    setsockopt (mDNSSocket, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One));
+    setsockopt (mDNSSocket, SOL_SOCKET, SO_REUSEPORT, &One, sizeof(One));
+
+    memset (&Addr, 0, sizeof(sockaddr_in));
+    Addr.sin_family = AF_INET;
+    Addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    Addr.sin_port = htons(MDNS_PORT);
+    if (bind (mDNSSocket, (const sockaddr*)&Addr, sizeof(sockaddr_in))<0)
+    {
+        close (mDNSSocket);
         mDNSSocket = INVALID_SOCKET;
+        return false;
     }
-}  // TerminatemDNS
+
+    // Interface of each query, to answer with its addresses
+    setsockopt (mDNSSocket, IPPROTO_IP, IP_PKTINFO, &One, sizeof(One));
+    setsockopt (mDNSSocket, IPPROTO_IP, IP_MULTICAST_TTL, &TTL, sizeof(TTL));
+    return true;
+}  // OpenResponderSocket
+// -------------------------------------------------------------
+
+static const TNetInterface* FindInterface (int Index)
+{
+    for (unsigned int i=0; i<NumInterfaces; i++)
+    {
+        if (Interfaces[i].Index==Index)
+            return &Interfaces[i];
+    }
+    return 0;
+}  // FindInterface
+// -------------------------------------------------------------
+
+//! Read the interfaces. Without netlink (or without any interface up), packets go to the default multicast interface
+//! with no address record
+static void ReadInterfaces (void)
+{
+    NumInterfaces = ReadNetInterfaces (Interfaces, NET_MAX_INTERFACES);
+    if (NumInterfaces==0)
+    {
+        memset (&Interfaces[0], 0, sizeof(TNetInterface));
+        NumInterfaces = 1;
+    }
+}  // ReadInterfaces
+// -------------------------------------------------------------
+
+//! Join the mDNS group on new interfaces and leave it on those which are gone
+static void JoinInterfaces (void)
+{
+    ip_mreqn Group;
+    bool Joined;
+
+    if (!Responder) return;
+
+    memset (&Group, 0, sizeof(Group));
+    Group.imr_multiaddr.s_addr = htonl(MDNS_GROUP);
+
+    for (unsigned int j=0; j<NumJoined; )
+    {
+        if (FindInterface (JoinedIndexes[j]))
+        {
+            j++;
+            continue;
+        }
+        // Fails if the link has been removed : the kernel has dropped the membership already
+        Group.imr_ifindex = JoinedIndexes[j];
+        setsockopt (mDNSSocket, IPPROTO_IP, IP_DROP_MEMBERSHIP, &Group, sizeof(Group));
+        JoinedIndexes[j] = JoinedIndexes[--NumJoined];
+    }
+
+    for (unsigned int i=0; i<NumInterfaces; i++)
+    {
+        Joined = false;
+        for (unsigned int j=0; j<NumJoined; j++)
+        {
+            if (JoinedIndexes[j]==Interfaces[i].Index)
+                Joined = true;
+        }
+        if ((Joined)||(NumJoined>=NET_MAX_INTERFACES)) continue;
+
+        Group.imr_ifindex = Interfaces[i].Index;
+        if ((setsockopt (mDNSSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &Group, sizeof(Group))<0)&&(errno!=EADDRINUSE))
+        {
+            fprintf (stderr, "jacknetumpd : can not join mDNS group on %s (%s)\n", Interfaces[i].Name, strerror(errno));
+            continue;
+        }
+        JoinedIndexes[NumJoined++] = Interfaces[i].Index;
+    }
+}  // JoinInterfaces
+// -------------------------------------------------------------
+
+void initUMP_mDNS(const char* Name, unsigned short FirstPort, unsigned int NumServices)
+{
+    Responder = OpenResponderSocket ();
+    if (!Responder)
+    {
+        fprintf (stderr, "jacknetumpd : can not listen on mDNS port (%s), only announcing\n", strerror(errno));
+        CreateUDPSocket (&mDNSSocket, 0, false);
+    }
+
+    ReadInterfaces ();
+    NumJoined = 0;
+    JoinInterfaces ();
+    InterfaceMonitor = OpenNetInterfaceMonitor ();
+    if (InterfaceMonitor<0)
+        fprintf (stderr, "jacknetumpd : can not monitor network interfaces, mDNS records will not follow address changes\n");
+
+    // Generate product instance ID from MAC address of the first interface. It is not changed afterwards,
+    // so the service keeps its name when interfaces come and go
+    for (unsigned int i=0; i<NumInterfaces; i++)
+    {
+        if (!Interfaces[i].HasMAC) continue;
+        for (unsigned int b=0; b<6; b++)
+        {
+            ProductInstanceID[5+b*2] = hex2asc(Interfaces[i].MAC[b]>>4);
+            ProductInstanceID[6+b*2] = hex2asc(Interfaces[i].MAC[b]&0x0F);
+        }
+        break;
+    }
+
+    InitInstances (FirstPort, NumServices);
+    ReadHostLabel ();
+    snprintf (EndpointName, sizeof(EndpointName), "%s", Name);
+    Conflicts = 0;
+    BuildRecords ();
+
+    // Without port 5353, nothing can be probed
+    State = Responder ? MDNS_PROBING : MDNS_ANNOUNCING;
+    StepCount = 0;
+    NextStepMs = 0;
+}  // initUMP_MDNS
+// -------------------------------------------------------------
+
+const char* GetmDNSProductInstanceID (unsigned int Index)
+{
+    if (Index>=NumInstances) return ProductInstanceID;
+    return Instances[Index].ProductInstanceID;
+}  // GetmDNSProductInstanceID
+// -------------------------------------------------------------
+
+int GetmDNSSocket (void)
+{
+    if (!Responder) return -1;
+    return mDNSSocket;
+}  // GetmDNSSocket
 // -------------------------------------------------------------
 
-void SendUMPmDNS (void)
+int GetmDNSMonitorSocket (void)
+{
+    return InterfaceMonitor;
+}  // GetmDNSMonitorSocket
+// -------------------------------------------------------------
+
+//! Append Len bytes. Returns false (and the packet is marked full) if they do not fit
+static bool PutBytes (TMDNS_Packet* Packet, const void* Data, unsigned int Len)
+{
+    if ((Packet->Full)||(Len>MDNS_MAX_PACKET-Packet->Len))
+    {
+        Packet->Full = true;
+        return false;
+    }
+    memcpy (&Packet->Data[Packet->Len], Data, Len);
+    Packet->Len += Len;
+    return true;
+}  // PutBytes
+// -------------------------------------------------------------
+
+static bool PutU16 (TMDNS_Packet* Packet, unsigned int Value)
+{
+    uint8_t Bytes [2];
+
+    Bytes[0] = (Value>>8)&0xFF;
+    Bytes[1] = Value&0xFF;
+    return PutBytes (Packet, Bytes, 2);
+}  // PutU16
+// -------------------------------------------------------------
+
+static bool PutU32 (TMDNS_Packet* Packet, uint32_t Value)
+{
+    return (PutU16 (Packet, Value>>16))&&(PutU16 (Packet, Value&0xFFFF));
+}  // PutU32
+// -------------------------------------------------------------
+
+static bool PutRecordHeader (TMDNS_Packet* Packet, const uint8_t* Name, unsigned int NameLen, unsigned int Type, unsigned int Class, uint32_t TTL, unsigned int DataLen)
+{
+    return (PutBytes (Packet, Name, NameLen))&&(PutU16 (Packet, Type))&&(PutU16 (Packet, Class))&&
+           (PutU32 (Packet, TTL))&&(PutU16 (Packet, DataLen));
+}  // PutRecordHeader
+// -------------------------------------------------------------
+
+static bool PutQuestion (TMDNS_Packet* Packet, const uint8_t* Name, unsigned int NameLen, unsigned int Type, unsigned int Class)
+{
+    return (PutBytes (Packet, Name, NameLen))&&(PutU16 (Packet, Type))&&(PutU16 (Packet, Class));
+}  // PutQuestion
+// -------------------------------------------------------------
+
+//! Keep a record only if it has been written completely (Start : packet length before the record)
+static bool EndRecord (TMDNS_Packet* Packet, unsigned int Start, bool Written)
+{
+    if (!Written)
+        Packet->Len = Start;
+    return Written;
+}  // EndRecord
+// -------------------------------------------------------------
+
+//! Selected records (RR_PTR, RR_SRV, RR_TXT) of all the service instances
+static unsigned int AllInstances (unsigned int Records)
+{
+    unsigned int Mask = 0;
+
+    for (unsigned int i=0; i<NumInstances; i++)
+        Mask |= RR_OF(i, Records);
+    return Mask;
+}  // AllInstances
+// -------------------------------------------------------------
+
+//! Append the records selected by mask, with the addresses of Interface. Flush sets the cache flush bit on unique
+//! records (SRV, TXT, A, AAAA). Records which do not fit are left out. Returns the number of records written
+static unsigned int PutRecords (TMDNS_Packet* Packet, unsigned int Records, uint32_t TTL, bool Flush, const TNetInterface* Interface)
+{
+    unsigned int UniqueClass = Flush ? DNS_CLASS_IN|DNS_CLASS_FLUSH : DNS_CLASS_IN;
+    unsigned int Count = 0;
+    unsigned int Start;
+    const TServiceInstance* Instance;
+
+    if (Records&RR_SERVICES)
+    {
+        Start = Packet->Len;
+        if (!EndRecord (Packet, Start, (PutRecordHeader (Packet, ServicesName, ServicesNameLen, DNS_TYPE_PTR, DNS_CLASS_IN, TTL, ServiceNameLen))&&
+                                       (PutBytes (Packet, ServiceName, ServiceNameLen))))
+            return Count;
+        Count++;
+    }
+    for (unsigned int i=0; i<NumInstances; i++)
+    {
+        Instance = &Instances[i];
+        if (Records&RR_OF(i, RR_PTR))
+        {
+            Start = Packet->Len;
+            if (!EndRecord (Packet, Start, (PutRecordHeader (Packet, ServiceName, ServiceNameLen, DNS_TYPE_PTR, DNS_CLASS_IN, TTL, Instance->NameLen))&&
+                                           (PutBytes (Packet, Instance->Name, Instance->NameLen))))
+                return Count;
+            Count++;
+        }
+        if (Records&RR_OF(i, RR_SRV))
+        {
+            Start = Packet->Len;
+            if (!EndRecord (Packet, Start, (PutRecordHeader (Packet, Instance->Name, Instance->NameLen, DNS_TYPE_SRV, UniqueClass, TTL, 6+HostNameLen))&&
+                                           (PutU16 (Packet, 0))&&           // Priority
+                                           (PutU16 (Packet, 0))&&           // Weight
+                                           (PutU16 (Packet, Instance->Port))&&
+                                           (PutBytes (Packet, HostName, HostNameLen))))
+                return Count;
+            Count++;
+        }
+        if (Records&RR_OF(i, RR_TXT))
+        {
+            Start = Packet->Len;
+            if (!EndRecord (Packet, Start, (PutRecordHeader (Packet, Instance->Name, Instance->NameLen, DNS_TYPE_TXT, UniqueClass, TTL, Instance->TXTLen))&&
+                                           (PutBytes (Packet, Instance->TXTData, Instance->TXTLen))))
+                return Count;
+            Count++;
+        }
+    }
+    if (Records&RR_ADDRESS)
+    {
+        for (unsigned int a=0; a<Interface->NumIPv4; a++)
+        {
+            Start = Packet->Len;
+            if (!EndRecord (Packet, Start, (PutRecordHeader (Packet, HostName, HostNameLen, DNS_TYPE_A, UniqueClass, TTL, 4))&&
+                                           (PutU32 (Packet, Interface->IPv4[a]))))
+                return Count;
+            Count++;
+        }
+        for (unsigned int a=0; a<Interface->NumIPv6; a++)
+        {
+            Start = Packet->Len;
+            if (!EndRecord (Packet, Start, (PutRecordHeader (Packet, HostName, HostNameLen, DNS_TYPE_AAAA, UniqueClass, TTL, 16))&&
+                                           (PutBytes (Packet, Interface->IPv6[a], 16))))
+                return Count;
+            Count++;
+        }
+    }
+    return Count;
+}  // PutRecords
+// -------------------------------------------------------------
+
+static void InitPacket (TMDNS_Packet* Packet, unsigned short TransactionID, unsigned short Flags)
+{
+    TMDNS_Header* Header = (TMDNS_Header*)&Packet->Data[0];
+
+    memset (Header, 0, sizeof(TMDNS_Header));
+    Header->TransactionID = TransactionID;
+    Header->Flags = htons(Flags);
+    Packet->Len = sizeof(TMDNS_Header);
+    Packet->Full = false;
+}  // InitPacket
+// -------------------------------------------------------------
+
+//! Send to the mDNS group on Interface, or to the querier if To is not null
+static void SendPacket (const TMDNS_Packet* Packet, const sockaddr_in* To, const TNetInterface* Interface)
 {
 	sockaddr_in AdrEmit;
+    ip_mreqn MulticastInterface;
+
+    if (mDNSSocket==INVALID_SOCKET) return;
+    RTSafeAssert("mDNS SendPacket");
+
+    if (To==0)
+    {
+        memset (&MulticastInterface, 0, sizeof(MulticastInterface));
+        MulticastInterface.imr_ifindex = Interface->Index;
+        setsockopt (mDNSSocket, IPPROTO_IP, IP_MULTICAST_IF, &MulticastInterface, sizeof(MulticastInterface));
+
+        memset (&AdrEmit, 0, sizeof(sockaddr_in));
+        AdrEmit.sin_family=AF_INET;
+        AdrEmit.sin_addr.s_addr=htonl(MDNS_GROUP);
+        AdrEmit.sin_port=htons(MDNS_PORT);
+        To = &AdrEmit;
+    }
+	sendto(mDNSSocket, (const char*)&Packet->Data[0], Packet->Len, 0, (const sockaddr*)To, sizeof(sockaddr_in));
+}  // SendPacket
+// -------------------------------------------------------------
+
+//! Unsolicited response with all records, on each interface and in one packet per service instance.
+//! TTL = 0 is a goodbye packet
+static void SendAnnounce (uint32_t TTL)
+{
+    TMDNS_Packet Packet;
+    TMDNS_Header* Header = (TMDNS_Header*)&Packet.Data[0];
+
+    for (unsigned int i=0; i<NumInterfaces; i++)
+    {
+        for (unsigned int s=0; s<NumInstances; s++)
+        {
+            InitPacket (&Packet, 0, 0x8400);        // Response, authoritative answer
+            Header->AnswerRRs = htons(PutRecords (&Packet, RR_OF(s, RR_PTR|RR_SRV|RR_TXT)|RR_ADDRESS, TTL, true, &Interfaces[i]));
+            SendPacket (&Packet, 0, &Interfaces[i]);
+        }
+    }
+}  // SendAnnounce
+// -------------------------------------------------------------
+
+//! Ask for the names we want to use on each interface, with the records we would give in the authority section.
+//! Each service instance is probed in its own packet, with the host name
+static void SendProbe (void)
+{
+    TMDNS_Packet Packet;
+    TMDNS_Header* Header = (TMDNS_Header*)&Packet.Data[0];
+    unsigned int QuestionsEnd;
+
+    for (unsigned int s=0; s<NumInstances; s++)
+    {
+        InitPacket (&Packet, 0, 0x0000);
+        PutQuestion (&Packet, Instances[s].Name, Instances[s].NameLen, DNS_TYPE_ANY, DNS_CLASS_IN|DNS_CLASS_FLUSH);  // Unicast response requested
+        PutQuestion (&Packet, HostName, HostNameLen, DNS_TYPE_ANY, DNS_CLASS_IN|DNS_CLASS_FLUSH);
+        Header->Questions = htons(2);
+        QuestionsEnd = Packet.Len;
 
+        for (unsigned int i=0; i<NumInterfaces; i++)
+        {
+            Packet.Len = QuestionsEnd;
+            Packet.Full = false;
+            Header->AuthorityRRs = htons(PutRecords (&Packet, RR_OF(s, RR_SRV|RR_TXT)|RR_ADDRESS, MDNS_TTL, false, &Interfaces[i]));
+            SendPacket (&Packet, 0, &Interfaces[i]);
+        }
+    }
+}  // SendProbe
+// -------------------------------------------------------------
+
+void RunmDNS (uint64_t NowMs)
+{
     if (mDNSSocket==INVALID_SOCKET) return;
+    RunBrowser (NowMs);
+    if (NowMs<NextStepMs) return;
+
+    switch (State)
+    {
+        case MDNS_PROBING :
+            if (StepCount<MDNS_PROBE_COUNT)
+            {
+                SendProbe ();
+                StepCount++;
+                NextStepMs = NowMs+MDNS_PROBE_INTERVAL_MS;
+                break;
+            }
+            // Nobody objected during the last interval : names are ours
+            State = MDNS_ANNOUNCING;
+            StepCount = 0;
+            // No break : first announce is sent now
+        case MDNS_ANNOUNCING :
+            SendAnnounce (MDNS_TTL);
+            StepCount++;
+            if (StepCount<MDNS_ANNOUNCE_COUNT)
+                NextStepMs = NowMs+MDNS_ANNOUNCE_INTERVAL_MS;
+            else
+            {
+                State = MDNS_ANNOUNCED;
+                NextStepMs = NowMs+MDNS_REANNOUNCE_MS;
+            }
+            break;
+        case MDNS_ANNOUNCED :
+            SendAnnounce (MDNS_TTL);
+            NextStepMs = NowMs+MDNS_REANNOUNCE_MS;
+            break;
+        default :
+            break;
+    }
+}  // RunmDNS
+// -------------------------------------------------------------
+
+//! Read a (possibly compressed) name at *Pos into Name, in uncompressed wire format. *Pos is moved after the name
+static bool ReadName (const uint8_t* Packet, unsigned int Len, unsigned int* Pos, uint8_t* Name, unsigned int* NameLen)
+{
+    unsigned int Read = *Pos;
+    unsigned int Out = 0;
+    unsigned int Pointers = 0;
+    unsigned int LabelLen;
+    bool Jumped = false;
+
+    while (true)
+    {
+        if (Read>=Len) return false;
+        LabelLen = Packet[Read];
+
+        if ((LabelLen&0xC0)==0xC0)
+        {  // Compression pointer
+            if ((Read+1>=Len)||(++Pointers>MDNS_MAX_POINTERS)) return false;
+            if (!Jumped) *Pos = Read+2;
+            Jumped = true;
+            Read = ((LabelLen&0x3F)<<8)|Packet[Read+1];
+            continue;
+        }
+        if (LabelLen>63) return false;
+        if ((Read+1+LabelLen>Len)||(Out+1+LabelLen>=MDNS_MAX_NAME)) return false;
+
+        memcpy (&Name[Out], &Packet[Read], LabelLen+1);
+        Out += LabelLen+1;
+        Read += LabelLen+1;
+        if (LabelLen==0) break;
+    }
 
-    memset (&AdrEmit, 0, sizeof(sockaddr_in));
-	AdrEmit.sin_family=AF_INET;
-	AdrEmit.sin_addr.s_addr=htonl(0xE00000FB);
-	//AdrEmit.sin_addr.s_addr=htonl(0xC0A80028);
-	AdrEmit.sin_port=htons(5353);
-	sendto(mDNSSocket, (const char*)&mDNSPacket_, mDNSPacketLen, 0, (const sockaddr*)&AdrEmit, sizeof(sockaddr_in));
-}  //SendUMPmDNS
+    if (!Jumped) *Pos = Read;
+    *NameLen = Out;
+    return true;
+}  // ReadName
+// -------------------------------------------------------------
+
+//! DNS names are case insensitive (label length bytes are below 'A', so they are not changed by tolower)
+static bool SameName (const uint8_t* Name1, unsigned int Len1, const uint8_t* Name2, unsigned int Len2)
+{
+    if (Len1!=Len2) return false;
+    for (unsigned int i=0; i<Len1; i++)
+        if (tolower (Name1[i])!=tolower (Name2[i])) return false;
+    return true;
+}  // SameName
+// -------------------------------------------------------------
+
+static inline unsigned int GetU16 (const uint8_t* Data)
+{
+    return (Data[0]<<8)|Data[1];
+}  // GetU16
+// -------------------------------------------------------------
+
+//! Records asked by a question
+static unsigned int MatchQuestion (const uint8_t* Name, unsigned int NameLen, unsigned int Type)
+{
+    bool Any = (Type==DNS_TYPE_ANY);
+
+    if (SameName (Name, NameLen, ServiceName, ServiceNameLen))
+        return ((Any)||(Type==DNS_TYPE_PTR)) ? AllInstances (RR_PTR) : 0;
+    if (SameName (Name, NameLen, ServicesName, ServicesNameLen))
+        return ((Any)||(Type==DNS_TYPE_PTR)) ? RR_SERVICES : 0;
+    for (unsigned int i=0; i<NumInstances; i++)
+    {
+        if (!SameName (Name, NameLen, Instances[i].Name, Instances[i].NameLen)) continue;
+        if (Any) return RR_OF(i, RR_SRV|RR_TXT);
+        if (Type==DNS_TYPE_SRV) return RR_OF(i, RR_SRV);
+        if (Type==DNS_TYPE_TXT) return RR_OF(i, RR_TXT);
+        return 0;
+    }
+    if (SameName (Name, NameLen, HostName, HostNameLen))
+        return ((Any)||(Type==DNS_TYPE_A)||(Type==DNS_TYPE_AAAA)) ? RR_ADDRESS : 0;
+    return 0;
+}  // MatchQuestion
+// -------------------------------------------------------------
+
+//! True if the A (DataLen = 4) or AAAA (DataLen = 16) record data is one of the addresses of Interface
+static bool IsInterfaceAddress (const TNetInterface* Interface, const uint8_t* Data, unsigned int DataLen)
+{
+    uint32_t Address;
+
+    if (DataLen==4)
+    {
+        Address = ((uint32_t)GetU16 (&Data[0])<<16)|GetU16 (&Data[2]);
+        for (unsigned int a=0; a<Interface->NumIPv4; a++)
+            if (Interface->IPv4[a]==Address) return true;
+    }
+    else if (DataLen==16)
+    {
+        for (unsigned int a=0; a<Interface->NumIPv6; a++)
+            if (memcmp (Interface->IPv6[a], Data, 16)==0) return true;
+    }
+    return false;
+}  // IsInterfaceAddress
+// -------------------------------------------------------------
+
+//! Records of ours given in the known-answer section of a query received on Interface
+static unsigned int MatchKnownAnswer (const uint8_t* Packet, unsigned int Len, const uint8_t* Name, unsigned int NameLen,
+                                      unsigned int Type, unsigned int DataPos, unsigned int DataLen, const TNetInterface* Interface)
+{
+    uint8_t Target [MDNS_MAX_NAME];
+    unsigned int TargetLen;
+    unsigned int Pos = DataPos;
+
+    if (Type==DNS_TYPE_PTR)
+    {
+        if (!ReadName (Packet, Len, &Pos, Target, &TargetLen)) return 0;
+        if (SameName (Name, NameLen, ServicesName, ServicesNameLen))
+            return SameName (Target, TargetLen, ServiceName, ServiceNameLen) ? RR_SERVICES : 0;
+        if (!SameName (Name, NameLen, ServiceName, ServiceNameLen)) return 0;
+        for (unsigned int i=0; i<NumInstances; i++)
+            if (SameName (Target, TargetLen, Instances[i].Name, Instances[i].NameLen)) return RR_OF(i, RR_PTR);
+        return 0;
+    }
+    for (unsigned int i=0; i<NumInstances; i++)
+    {
+        if (!SameName (Name, NameLen, Instances[i].Name, Instances[i].NameLen)) continue;
+        if ((Type==DNS_TYPE_SRV)&&(DataLen>=6))
+            return (GetU16 (&Packet[DataPos+4])==Instances[i].Port) ? RR_OF(i, RR_SRV) : 0;
+        if (Type==DNS_TYPE_TXT)
+            return RR_OF(i, RR_TXT);
+        return 0;
+    }
+    // Address records are sent together : only suppressed when the interface has a single address
+    if (((Type==DNS_TYPE_A)||(Type==DNS_TYPE_AAAA))&&(SameName (Name, NameLen, HostName, HostNameLen)))
+    {
+        if (Interface->NumIPv4+Interface->NumIPv6!=1) return 0;
+        return IsInterfaceAddress (Interface, &Packet[DataPos], DataLen) ? RR_ADDRESS : 0;
+    }
+    return 0;
+}  // MatchKnownAnswer
+// -------------------------------------------------------------
+
+static void ProcessQuery (const uint8_t* Packet, unsigned int Len, const sockaddr_in* From, const TNetInterface* Interface)
+{
+    const TMDNS_Header* Query = (const TMDNS_Header*)Packet;
+    TMDNS_Packet Reply;
+    TMDNS_Header* Header = (TMDNS_Header*)&Reply.Data[0];
+    uint8_t Name [MDNS_MAX_NAME];
+    unsigned int NameLen;
+    unsigned int Pos = sizeof(TMDNS_Header);
+    unsigned int Type, Class, DataLen;
+    uint32_t TTL;
+    unsigned int Answers = 0;
+    unsigned int Additional;
+    unsigned int NumAnswers;
+    unsigned int QuestionsEnd;
+    bool Unicast = false;
+    bool Legacy;
+
+    // Names are not ours until probing is over
+    if ((State!=MDNS_ANNOUNCING)&&(State!=MDNS_ANNOUNCED)) return;
+
+    for (unsigned int q=0; q<ntohs(Query->Questions); q++)
+    {
+        if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) return;
+        if (Pos+4>Len) return;
+        Type = GetU16 (&Packet[Pos]);
+        Class = GetU16 (&Packet[Pos+2]);
+        Pos += 4;
+
+        if (Class&DNS_CLASS_FLUSH) Unicast = true;      // QU question
+        if (((Class&0x7FFF)!=DNS_CLASS_IN)&&((Class&0x7FFF)!=DNS_TYPE_ANY)) continue;
+        Answers |= MatchQuestion (Name, NameLen, Type);
+    }
+    if (Answers==0) return;
+    QuestionsEnd = Pos;
+
+    // Known-answer suppression : do not repeat records the querier has with at least half their TTL
+    for (unsigned int a=0; a<ntohs(Query->AnswerRRs); a++)
+    {
+        if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) break;
+        if (Pos+10>Len) break;
+        Type = GetU16 (&Packet[Pos]);
+        TTL = ((uint32_t)GetU16 (&Packet[Pos+4])<<16)|GetU16 (&Packet[Pos+6]);
+        DataLen = GetU16 (&Packet[Pos+8]);
+        Pos += 10;
+        if (Pos+DataLen>Len) break;
+
+        if (TTL>=MDNS_TTL/2)
+            Answers &= ~MatchKnownAnswer (Packet, Len, Name, NameLen, Type, Pos, DataLen, Interface);
+        Pos += DataLen;
+    }
+    if (Answers==0) return;
+
+    // One-shot resolvers do not use port 5353 : they expect a classic DNS answer, with the questions.
+    // They ask one question at a time, the questions of larger queries are not sent back
+    Legacy = (ntohs(From->sin_port)!=MDNS_PORT);
+    if (Legacy)
+    {
+        if (ntohs(Query->Questions)>MDNS_LEGACY_MAX_QUESTIONS) return;
+        if (QuestionsEnd-sizeof(TMDNS_Header)>MDNS_LEGACY_MAX_QUESTION_BYTES) return;
+        InitPacket (&Reply, Query->TransactionID, 0x8400);
+        // Questions are copied at the same position, so their compression pointers stay valid
+        PutBytes (&Reply, &Packet[sizeof(TMDNS_Header)], QuestionsEnd-sizeof(TMDNS_Header));
+        Header->Questions = Query->Questions;
+    }
+    else
+        InitPacket (&Reply, 0, 0x8400);
+
+    TTL = Legacy ? MDNS_LEGACY_TTL : MDNS_TTL;
+    NumAnswers = PutRecords (&Reply, Answers, TTL, !Legacy, Interface);
+    Header->AnswerRRs = htons(NumAnswers);
+    if (NumAnswers==0) return;
+    // Querier may ask again over TCP (RFC 6762 : TC bit is never set in multicast responses)
+    if ((Reply.Full)&&((Legacy)||(Unicast)))
+        Header->Flags |= htons(DNS_FLAG_TC);
+
+    // Save the next queries : SRV/TXT/A/AAAA come with the PTR, A/AAAA with the SRV
+    Additional = 0;
+    for (unsigned int i=0; i<NumInstances; i++)
+    {
+        if (Answers&RR_OF(i, RR_PTR)) Additional |= RR_OF(i, RR_SRV|RR_TXT)|RR_ADDRESS;
+        if (Answers&RR_OF(i, RR_SRV)) Additional |= RR_ADDRESS;
+    }
+    Additional &= ~Answers;
+    Header->AdditionalRRs = htons(PutRecords (&Reply, Additional, TTL, !Legacy, Interface));
+
+    SendPacket (&Reply, ((Legacy)||(Unicast)) ? From : 0, Interface);
+}  // ProcessQuery
+// -------------------------------------------------------------
+
+//! Another device using our names with different data : take another name and probe again
+static void ProcessResponse (const uint8_t* Packet, unsigned int Len)
+{
+    const TMDNS_Header* Response = (const TMDNS_Header*)Packet;
+    uint8_t Name [MDNS_MAX_NAME];
+    unsigned int NameLen;
+    unsigned int Pos = sizeof(TMDNS_Header);
+    unsigned int Type, DataLen;
+    unsigned int NumRecords;
+    bool Conflict = false;
+
+    if (State==MDNS_STOPPED) return;
+
+    for (unsigned int q=0; q<ntohs(Response->Questions); q++)
+    {
+        if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) return;
+        Pos += 4;
+    }
+
+    NumRecords = ntohs(Response->AnswerRRs)+ntohs(Response->AuthorityRRs)+ntohs(Response->AdditionalRRs);
+    for (unsigned int r=0; (r<NumRecords)&&(!Conflict); r++)
+    {
+        if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) return;
+        if (Pos+10>Len) return;
+        Type = GetU16 (&Packet[Pos]);
+        DataLen = GetU16 (&Packet[Pos+8]);
+        Pos += 10;
+        if (Pos+DataLen>Len) return;
+
+        // Our own announces come back : same data is not a conflict
+        if ((Type==DNS_TYPE_SRV)&&(DataLen>=6))
+        {
+            for (unsigned int i=0; i<NumInstances; i++)
+                if (SameName (Name, NameLen, Instances[i].Name, Instances[i].NameLen))
+                    Conflict = (GetU16 (&Packet[Pos+4])!=Instances[i].Port);
+        }
+        else if ((((Type==DNS_TYPE_A)&&(DataLen==4))||((Type==DNS_TYPE_AAAA)&&(DataLen==16)))&&
+                 (SameName (Name, NameLen, HostName, HostNameLen)))
+        {
+            Conflict = true;
+            for (unsigned int i=0; i<NumInterfaces; i++)
+                if (IsInterfaceAddress (&Interfaces[i], &Packet[Pos], DataLen)) Conflict = false;
+        }
+        Pos += DataLen;
+    }
+    if (!Conflict) return;
+
+    Conflicts++;
+    if (Conflicts>MDNS_MAX_CONFLICTS)
+    {
+        fprintf (stderr, "jacknetumpd : too many mDNS name conflicts, service is not advertised\n");
+        State = MDNS_STOPPED;
+        return;
+    }
+
+    BuildRecords ();
+    fprintf (stdout, "jacknetumpd : mDNS name conflict, trying %.*s\n", Instances[0].Name[0], &Instances[0].Name[1]);
+    State = MDNS_PROBING;
+    StepCount = 0;
+    NextStepMs = 0;
+}  // ProcessResponse
+// -------------------------------------------------------------
+
+static uint64_t GetNowMs (void)
+{
+    struct timespec Now;
+
+    clock_gettime (CLOCK_MONOTONIC, &Now);
+    return (uint64_t)Now.tv_sec*1000+Now.tv_nsec/1000000;
+}  // GetNowMs
+// -------------------------------------------------------------
+
+void StartmDNSBrowse (const char* Pattern)
+{
+    if (!Responder)
+    {
+        fprintf (stderr, "jacknetumpd : mDNS port is not available, can not browse for peers\n");
+        return;
+    }
+
+    snprintf (BrowsePattern, sizeof(BrowsePattern), "%s", Pattern);
+    memset (&Browsed[0], 0, sizeof(Browsed));
+    NextBrowseMs = 0;
+    BrowseIntervalMs = MDNS_BROWSE_FIRST_MS;
+    Browsing = true;
+}  // StartmDNSBrowse
+// -------------------------------------------------------------
+
+//! Ask for all _midi2._udp services, giving those we know with more than half their TTL left
+static void SendBrowseQuery (uint64_t NowMs)
+{
+    TMDNS_Packet Packet;
+    TMDNS_Header* Header = (TMDNS_Header*)&Packet.Data[0];
+    TBrowsedService* Service;
+    unsigned int KnownAnswers = 0;
+
+    unsigned int Start;
+
+    InitPacket (&Packet, 0, 0x0000);
+    PutQuestion (&Packet, ServiceName, ServiceNameLen, DNS_TYPE_PTR, DNS_CLASS_IN);
+    Header->Questions = htons(1);
+
+    for (unsigned int s=0; s<MDNS_MAX_SERVICES; s++)
+    {
+        Service = &Browsed[s];
+        if ((!Service->Used)||(Service->ExpiryMs<=NowMs+Service->TTL*500)) continue;
+
+        Start = Packet.Len;
+        if (!EndRecord (&Packet, Start, (PutRecordHeader (&Packet, ServiceName, ServiceNameLen, DNS_TYPE_PTR, DNS_CLASS_IN, (Service->ExpiryMs-NowMs)/1000, Service->InstanceLen))&&
+                                        (PutBytes (&Packet, Service->Instance, Service->InstanceLen))))
+            break;
+        KnownAnswers++;
+    }
+    Header->AnswerRRs = htons(KnownAnswers);
+    for (unsigned int i=0; i<NumInterfaces; i++)
+        SendPacket (&Packet, 0, &Interfaces[i]);
+}  // SendBrowseQuery
+// -------------------------------------------------------------
+
+//! Ask for the records of a service which are still missing
+static void SendResolveQuery (const TBrowsedService* Service)
+{
+    TMDNS_Packet Packet;
+    TMDNS_Header* Header = (TMDNS_Header*)&Packet.Data[0];
+    unsigned int Questions = 2;
+
+    InitPacket (&Packet, 0, 0x0000);
+    PutQuestion (&Packet, Service->Instance, Service->InstanceLen, DNS_TYPE_SRV, DNS_CLASS_IN);
+    PutQuestion (&Packet, Service->Instance, Service->InstanceLen, DNS_TYPE_TXT, DNS_CLASS_IN);
+    if ((Service->HostLen>0)&&(!Service->HasAddress))
+    {
+        PutQuestion (&Packet, Service->Host, Service->HostLen, DNS_TYPE_A, DNS_CLASS_IN);
+        Questions++;
+    }
+    Header->Questions = htons(Questions);
+    for (unsigned int i=0; i<NumInterfaces; i++)
+        SendPacket (&Packet, 0, &Interfaces[i]);
+}  // SendResolveQuery
+// -------------------------------------------------------------
+
+static void RunBrowser (uint64_t NowMs)
+{
+    TBrowsedService* Service;
+
+    if (!Browsing) return;
+
+    if (NowMs>=NextBrowseMs)
+    {
+        SendBrowseQuery (NowMs);
+        NextBrowseMs = NowMs+BrowseIntervalMs;
+        BrowseIntervalMs *= 2;
+        if (BrowseIntervalMs>MDNS_BROWSE_MAX_MS) BrowseIntervalMs = MDNS_BROWSE_MAX_MS;
+    }
+
+    for (unsigned int s=0; s<MDNS_MAX_SERVICES; s++)
+    {
+        Service = &Browsed[s];
+        if (!Service->Used) continue;
+        if (NowMs>=Service->ExpiryMs)
+        {
+            Service->Used = false;
+            continue;
+        }
+        if ((Service->HostLen>0)&&(Service->HasTXT)&&(Service->HasAddress)) continue;
+        if (NowMs-Service->LastResolveMs<MDNS_RESOLVE_INTERVAL_MS) continue;
+        SendResolveQuery (Service);
+        Service->LastResolveMs = NowMs;
+    }
+}  // RunBrowser
+// -------------------------------------------------------------
+
+static TBrowsedService* FindBrowsedService (const uint8_t* Instance, unsigned int InstanceLen)
+{
+    for (unsigned int s=0; s<MDNS_MAX_SERVICES; s++)
+    {
+        if ((Browsed[s].Used)&&(SameName (Instance, InstanceLen, Browsed[s].Instance, Browsed[s].InstanceLen)))
+            return &Browsed[s];
+    }
+    return 0;
+}  // FindBrowsedService
+// -------------------------------------------------------------
+
+static uint64_t GetExpiry (uint64_t NowMs, uint32_t TTL)
+{
+    if (TTL==0) return NowMs+MDNS_GOODBYE_DELAY_MS;
+    return NowMs+(uint64_t)TTL*1000;
+}  // GetExpiry
+// -------------------------------------------------------------
+
+//! New service, or refreshed PTR record
+static void AddBrowsedService (const uint8_t* Instance, unsigned int InstanceLen, uint32_t TTL, uint64_t NowMs)
+{
+    TBrowsedService* Service;
+    unsigned int LabelLen;
+
+    for (unsigned int i=0; i<NumInstances; i++)
+        if (SameName (Instance, InstanceLen, Instances[i].Name, Instances[i].NameLen)) return;     // Ourselves
+
+    Service = FindBrowsedService (Instance, InstanceLen);
+    if (Service==0)
+    {
+        if (TTL==0) return;
+        for (unsigned int s=0; s<MDNS_MAX_SERVICES; s++)
+        {
+            if (!Browsed[s].Used)
+            {
+                Service = &Browsed[s];
+                break;
+            }
+        }
+        if (Service==0) return;         // Table is full
+
+        memset (Service, 0, sizeof(TBrowsedService));
+        memcpy (Service->Instance, Instance, InstanceLen);
+        Service->InstanceLen = InstanceLen;
+        // Instance label is used as identifier until TXT record gives the ProductInstanceId
+        LabelLen = Instance[0];
+        if (LabelLen>=sizeof(Service->Info.ProductInstanceID)) LabelLen = sizeof(Service->Info.ProductInstanceID)-1;
+        memcpy (Service->Info.ProductInstanceID, &Instance[1], LabelLen);
+        Service->Used = true;
+    }
+    Service->TTL = TTL;
+    Service->ExpiryMs = GetExpiry (NowMs, TTL);
+}  // AddBrowsedService
+// -------------------------------------------------------------
+
+static void ParseTXT (TBrowsedService* Service, const uint8_t* Data, unsigned int Len)
+{
+    unsigned int Pos = 0;
+    unsigned int StringLen;
+    const char* String;
+    unsigned int TagLen;
+
+    while (Pos<Len)
+    {
+        StringLen = Data[Pos];
+        String = (const char*)&Data[Pos+1];
+        Pos += StringLen+1;
+        if (Pos>Len) break;
+
+        TagLen = strlen (EndpointNameTagStr);
+        if ((StringLen>TagLen)&&(strncasecmp (String, EndpointNameTagStr, TagLen)==0))
+            snprintf (Service->Info.EndpointName, sizeof(Service->Info.EndpointName), "%.*s", StringLen-TagLen, String+TagLen);
+        TagLen = strlen (ProductInstanceIdTagStr);
+        if ((StringLen>TagLen)&&(strncasecmp (String, ProductInstanceIdTagStr, TagLen)==0))
+            snprintf (Service->Info.ProductInstanceID, sizeof(Service->Info.ProductInstanceID), "%.*s", StringLen-TagLen, String+TagLen);
+    }
+    Service->HasTXT = true;
+}  // ParseTXT
+// -------------------------------------------------------------
+
+//! Update the browsed services from any response seen on the network. Addresses are read in a second pass,
+//! so they are found whatever the order of the records
+static void BrowseResponse (const uint8_t* Packet, unsigned int Len)
+{
+    const TMDNS_Header* Response = (const TMDNS_Header*)Packet;
+    uint8_t Name [MDNS_MAX_NAME];
+    unsigned int NameLen;
+    uint8_t Target [MDNS_MAX_NAME];
+    unsigned int TargetLen;
+    unsigned int Pos;
+    unsigned int DataPos;
+    unsigned int Type, DataLen;
+    unsigned int NumRecords;
+    uint32_t TTL;
+    uint32_t Address;
+    TBrowsedService* Service;
+    uint64_t NowMs = GetNowMs ();
+
+    NumRecords = ntohs(Response->AnswerRRs)+ntohs(Response->AuthorityRRs)+ntohs(Response->AdditionalRRs);
+    for (unsigned int Pass=0; Pass<2; Pass++)
+    {
+        Pos = sizeof(TMDNS_Header);
+        for (unsigned int q=0; q<ntohs(Response->Questions); q++)
+        {
+            if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) return;
+            Pos += 4;
+        }
+
+        for (unsigned int r=0; r<NumRecords; r++)
+        {
+            if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) return;
+            if (Pos+10>Len) return;
+            Type = GetU16 (&Packet[Pos]);
+            TTL = ((uint32_t)GetU16 (&Packet[Pos+4])<<16)|GetU16 (&Packet[Pos+6]);
+            DataLen = GetU16 (&Packet[Pos+8]);
+            DataPos = Pos+10;
+            Pos = DataPos+DataLen;
+            if (Pos>Len) return;
+
+            if (Pass==0)
+            {
+                if ((Type==DNS_TYPE_PTR)&&(SameName (Name, NameLen, ServiceName, ServiceNameLen)))
+                {
+                    if (ReadName (Packet, Len, &DataPos, Target, &TargetLen))
+                        AddBrowsedService (Target, TargetLen, TTL, NowMs);
+                    continue;
+                }
+
+                Service = FindBrowsedService (Name, NameLen);
+                if (Service==0) continue;
+
+                if ((Type==DNS_TYPE_SRV)&&(DataLen>6))
+                {
+                    Service->Info.Port = GetU16 (&Packet[DataPos+4]);
+                    DataPos += 6;
+                    if (!ReadName (Packet, Len, &DataPos, Service->Host, &Service->HostLen))
+                        Service->HostLen = 0;
+                    if (TTL==0) Service->ExpiryMs = GetExpiry (NowMs, 0);
+                }
+                else if (Type==DNS_TYPE_TXT)
+                    ParseTXT (Service, &Packet[DataPos], DataLen);
+            }
+            else if ((Type==DNS_TYPE_A)&&(DataLen==4))
+            {
+                Address = ((uint32_t)GetU16 (&Packet[DataPos])<<16)|GetU16 (&Packet[DataPos+2]);
+                for (unsigned int s=0; s<MDNS_MAX_SERVICES; s++)
+                {
+                    Service = &Browsed[s];
+                    if ((!Service->Used)||(!SameName (Name, NameLen, Service->Host, Service->HostLen))) continue;
+
+                    if (TTL==0)
+                    {  // Address removed
+                        if ((Service->HasAddress)&&(Service->Info.IPV4Addr==Address))
+                            Service->HasAddress = false;
+                    }
+                    else
+                    {
+                        Service->Info.IPV4Addr = Address;
+                        Service->HasAddress = true;
+                    }
+                }
+            }
+        }
+    }
+}  // BrowseResponse
+// -------------------------------------------------------------
+
+unsigned int GetmDNSServices (TmDNSService* Services, unsigned int MaxServices)
+{
+    TBrowsedService* Service;
+    unsigned int Count = 0;
+    uint64_t NowMs = GetNowMs ();
+
+    if (!Browsing) return 0;
+
+    for (unsigned int s=0; (s<MDNS_MAX_SERVICES)&&(Count<MaxServices); s++)
+    {
+        Service = &Browsed[s];
+        if ((!Service->Used)||(NowMs>=Service->ExpiryMs)) continue;
+        if ((Service->HostLen==0)||(!Service->HasTXT)||(!Service->HasAddress)) continue;
+        if ((fnmatch (BrowsePattern, Service->Info.EndpointName, 0)!=0)&&(fnmatch (BrowsePattern, Service->Info.ProductInstanceID, 0)!=0))
+            continue;
+
+        Services[Count++] = Service->Info;
+    }
+    return Count;
+}  // GetmDNSServices
+// -------------------------------------------------------------
+
+void ProcessmDNSPackets (void)
+{
+    uint8_t Packet [MDNS_MAX_PACKET];
+    sockaddr_in From;
+    iovec Buffer;
+    msghdr Message;
+    uint8_t Control [CMSG_SPACE(sizeof(in_pktinfo))];
+    cmsghdr* ControlMessage;
+    const TNetInterface* Interface;
+    ssize_t Len;
+
+    if ((!Responder)||(mDNSSocket==INVALID_SOCKET)) return;
+
+    while (true)
+    {
+        Buffer.iov_base = &Packet[0];
+        Buffer.iov_len = sizeof(Packet);
+        memset (&Message, 0, sizeof(Message));
+        Message.msg_name = &From;
+        Message.msg_namelen = sizeof(From);
+        Message.msg_iov = &Buffer;
+        Message.msg_iovlen = 1;
+        Message.msg_control = Control;
+        Message.msg_controllen = sizeof(Control);
+        Len = recvmsg (mDNSSocket, &Message, MSG_DONTWAIT);
+        if (Len<0) break;
+        if ((size_t)Len<sizeof(TMDNS_Header)) continue;
+
+        // Interface the packet came from, first one if unknown
+        Interface = 0;
+        for (ControlMessage = CMSG_FIRSTHDR(&Message); ControlMessage!=0; ControlMessage = CMSG_NXTHDR(&Message, ControlMessage))
+        {
+            if ((ControlMessage->cmsg_level==IPPROTO_IP)&&(ControlMessage->cmsg_type==IP_PKTINFO))
+                Interface = FindInterface (((const in_pktinfo*)CMSG_DATA(ControlMessage))->ipi_ifindex);
+        }
+        if (Interface==0) Interface = &Interfaces[0];
+
+        if (Packet[2]&0x80)
+        {
+            if (Browsing)
+                BrowseResponse (&Packet[0], Len);
+            ProcessResponse (&Packet[0], Len);
+        }
+        else
+            ProcessQuery (&Packet[0], Len, &From, Interface);
+    }
+}  // ProcessmDNSPackets
+// -------------------------------------------------------------
+
+void ProcessmDNSInterfaceChange (void)
+{
+    TNetInterface Previous [NET_MAX_INTERFACES];
+    unsigned int PreviousCount = NumInterfaces;
+
+    if (!DrainNetInterfaceMonitor (InterfaceMonitor)) return;
+
+    // Links going up and down without address change do not change the records
+    memcpy (Previous, Interfaces, sizeof(Interfaces));
+    ReadInterfaces ();
+    if ((NumInterfaces==PreviousCount)&&(memcmp (Previous, Interfaces, NumInterfaces*sizeof(TNetInterface))==0))
+        return;
+
+    fprintf (stdout, "jacknetumpd : network interfaces changed, announcing mDNS records again\n");
+    JoinInterfaces ();
+
+    // New addresses are announced straight away (cache flush bit replaces the old ones). While probing,
+    // the next probes carry the new addresses
+    if ((State==MDNS_ANNOUNCING)||(State==MDNS_ANNOUNCED))
+    {
+        State = MDNS_ANNOUNCING;
+        StepCount = 0;
+        NextStepMs = 0;
+    }
+    // Peers may be reachable on the new links
+    NextBrowseMs = 0;
+    BrowseIntervalMs = MDNS_BROWSE_FIRST_MS;
+    RunmDNS (GetNowMs ());
+}  // ProcessmDNSInterfaceChange
+// -------------------------------------------------------------
+
+void TerminatemDNS (void)
+{
+    if (mDNSSocket!=INVALID_SOCKET)
+    {
+        // Goodbye : peers remove the records at once instead of waiting for the TTL
+        if ((State==MDNS_ANNOUNCING)||(State==MDNS_ANNOUNCED))
+            SendAnnounce (0);
+        CloseSocket(&mDNSSocket);
+        mDNSSocket = INVALID_SOCKET;
+    }
+    CloseNetInterfaceMonitor (InterfaceMonitor);
+    InterfaceMonitor = -1;
+}  // TerminatemDNS
 // -------------------------------------------------------------
@@ -1,8 +1,49 @@
 #ifndef __UMP_MDNS_H__
 #define __UMP_MDNS_H__
 
-void initUMP_mDNS(void);
-void SendUMPmDNS (void);
+#include <stdint.h>
+
+#define MDNS_TICK_MS            250         // RunmDNS() period (probe interval)
+#define MDNS_MAX_SERVICE_NAME   100
+#define MDNS_MAX_INSTANCES      8           // Service instances advertised, one per session
+
+//! NetUMP endpoint found by the browser
+typedef struct {
+    char EndpointName [MDNS_MAX_SERVICE_NAME];
+    char ProductInstanceID [MDNS_MAX_SERVICE_NAME];
+    uint32_t IPV4Addr;          // Host byte order
+    unsigned short Port;
+} TmDNSService;
+
+//! Open the mDNS socket, join the group on all interfaces and build the records advertising NumServices NetUMP
+//! endpoints, on ports FirstPort to FirstPort+NumServices-1
+void initUMP_mDNS(const char* EndpointName, unsigned short FirstPort, unsigned int NumServices);
+
+//! ProductInstanceId advertised for service Index (session Index), to be given in endpoint discovery too
+const char* GetmDNSProductInstanceID (unsigned int Index);
+
+//! Socket receiving mDNS queries, -1 if the responder could not bind port 5353
+int GetmDNSSocket (void);
+
+//! Netlink socket notified of link and address changes, -1 if not available
+int GetmDNSMonitorSocket (void);
+
+//! Read the interfaces again after a change, join the group on new ones and announce the new addresses
+void ProcessmDNSInterfaceChange (void);
+
+//! Answer the queries and read the responses (conflicts, browsed services) waiting on the mDNS socket
+void ProcessmDNSPackets (void);
+
+//! Probe / announce sequence and periodic announces, to be called every MDNS_TICK_MS
+void RunmDNS (uint64_t NowMs);
+
+//! Look for _midi2._udp services whose UMPEndpointName or ProductInstanceId matches Pattern (shell wildcards)
+void StartmDNSBrowse (const char* Pattern);
+
+//! Copy the matching services with a known address and port. Returns the number of services
+unsigned int GetmDNSServices (TmDNSService* Services, unsigned int MaxServices);
+
+//! Send goodbye packet and close the socket
 void TerminatemDNS(void);
 
 #endif // __UMP_MDNS_H__
@@ -0,0 +1,391 @@
+/*
+ * Bench.cpp
+ * Micro-benchmarks of the jacknetumpd realtime paths
+ *
+ * The daemon is compiled in this program (its main() renamed) and linked with
+ * DummyJack.cpp instead of libjack, so the real callbacks run on in-memory JACK
+ * buffers. NetUMP packetization is measured between two handlers over loopback UDP.
+ *
+ * Each benchmark is run for a number of samples of BENCH_BATCH messages. Results
+ * (ns/message percentiles over the samples, and messages/second at the median) are
+ * printed on stdout as JSON
+ *
+ * Usage : jacknetumpd-bench [--samples <n>] [--only <benchmark name>]
+ */
+
+#define main jacknetumpd_main
+#include "../jacknetumpd.cpp"
+#undef main
+
+#include <time.h>
+#include <sys/utsname.h>
+#include <algorithm>
+#include <vector>
+#include "DummyJack.h"
+
+#define BENCH_BATCH             256         // Messages per sample
+#define BENCH_DEFAULT_SAMPLES   2000
+#define BENCH_WARMUP_SAMPLES    50
+#define BENCH_NFRAMES           DUMMY_BUFFER_SIZE
+#define BENCH_LOOPBACK_PORT     15504
+#define BENCH_CONNECT_TIMEOUT   3000        // In ms
+
+typedef void (*TBenchFunction) (void);
+
+typedef struct {
+    const char* Name;
+    TBenchFunction Setup;           // Called before each sample, not measured
+    TBenchFunction Run;             // Processes BENCH_BATCH messages
+} TBenchmark;
+
+static unsigned int NumSamples=BENCH_DEFAULT_SAMPLES;
+static bool FirstResult=true;
+
+static uint32_t UMPMessages [BENCH_BATCH*2];        // MT 2 notes and CCs
+static uint32_t MIDI2Messages [BENCH_BATCH*2];      // Same messages as MT 4
+static uint32_t CCFloodMessages [BENCH_BATCH];     // Mostly controller updates, merged in the period
+static uint8_t MIDI1Bytes [BENCH_BATCH*3];
+static volatile unsigned int Sink;
+
+static CNetUMPHandler* LoopbackSender=0;
+static CNetUMPHandler* LoopbackReceiver=0;
+static volatile bool LoopbackConnected=false;
+static volatile unsigned int LoopbackReceived=0;
+
+static inline uint64_t GetNanoseconds (void)
+{
+    struct timespec Now;
+
+    clock_gettime (CLOCK_MONOTONIC, &Now);
+    return ((uint64_t)Now.tv_sec*1000000000)+Now.tv_nsec;
+}  // GetNanoseconds
+// ----------------------------------------------------
+
+static void InitMessages (void)
+{
+    uint8_t Status;
+
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+    {
+        // Alternate Note On, Note Off and Control Change, as a keyboard with a modulation wheel
+        Status = (i%3==0) ? 0x90 : (i%3==1) ? 0x80 : 0xB0;
+        Status |= i&0x0F;
+        UMPMessages[i]=0x20000000|(Status<<16)|((36+(i%48))<<8)|(i&0x7F);
+        MIDI1Bytes[i*3]=Status;
+        MIDI1Bytes[i*3+1]=36+(i%48);
+        MIDI1Bytes[i*3+2]=i&0x7F;
+        UpgradeMIDI1_MIDI2 (&UMPMessages[i], &MIDI2Messages[i*2]);
+
+        // Modulation wheel and pitch bend on 4 channels, with a note every 16 messages
+        if (i%16==0)
+            CCFloodMessages[i]=0x20900000|((36+(i%48))<<8)|0x40;
+        else if (i%2==0)
+            CCFloodMessages[i]=0x20B00100|((i&0x03)<<16)|(i&0x7F);
+        else
+            CCFloodMessages[i]=0x20E00000|((i&0x03)<<16)|(i&0x7F);
+    }
+}  // InitMessages
+// ----------------------------------------------------
+
+static void InitBenchSession (void)
+{
+    TNetUMPSession* Session=&Sessions[0];
+
+    client=jack_client_open ("bench", JackNullOption, 0);
+    PeriodFrames=BENCH_NFRAMES;
+    NumSessions=1;
+    Session->Index=0;
+    Session->Handler=0;
+    Session->Stats=GetSessionStats(0);
+    Session->Protocol=UMP_PROTOCOL_MIDI1;
+    Session->UMP2JACK.Allocate (UMP2JACK_FIFO_SIZE);
+    Session->JACK2NET.Reset();
+    Session->RxStagingLen=0;
+    Session->RxPending.Reset();
+    Session->UMP2JACKDropRequest=0;
+    Session->RxSysExQueued[0]=Session->RxSysExQueued[1]=0;
+    Session->RxSysExDropped[0]=Session->RxSysExDropped[1]=0;
+    Session->SysExRx.Init();
+    InitSysExTx (&Session->SysExTx);
+    InitOutputScheduler (&Session->Output);
+    InitRoutes ();
+    InitJitterBuffer (&Session->Jitter, DUMMY_SAMPLE_RATE, 0, false);
+    RegisterSessionPorts (Session);
+}  // InitBenchSession
+// ----------------------------------------------------
+
+// *** NetUMP callback : messages received from the network pushed to UMP2JACK
+
+static void SetupEmptyFIFO (void)
+{
+    Sessions[0].UMP2JACK.Reset();
+}
+
+static void RunNetUMPCallback (void)
+{
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+        NetUMPCallback (&Sessions[0], &UMPMessages[i]);
+    FlushRxStaging (&Sessions[0]);
+}
+
+// *** FIFO drain in the process callback
+
+static void FillFIFO (uint32_t* Messages, unsigned int MessageSize)
+{
+    TNetUMPSession* Session=&Sessions[0];
+
+    // Messages arrived during previous period, due at frame 0 of this one
+    SetDummyFrameTime (BENCH_NFRAMES, BENCH_NFRAMES);
+    Session->UMP2JACK.Reset();
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+        NetUMPCallback (Session, &Messages[i*MessageSize]);
+    FlushRxStaging (Session);
+    SetDummyFrameTime (BENCH_NFRAMES*2, BENCH_NFRAMES*2);
+}
+
+static void SetupDrainMIDI1 (void)
+{
+    FillFIFO (&UMPMessages[0], 1);
+}
+
+static void SetupDrainMIDI2 (void)
+{
+    FillFIFO (&MIDI2Messages[0], 2);
+}
+
+static void SetupDrainCCFlood (void)
+{
+    FillFIFO (&CCFloodMessages[0], 1);
+}
+
+static void RunDrain (void)
+{
+    ProcessNetToJack (&Sessions[0], Sessions[0].OutputPort.load(), BENCH_NFRAMES, BENCH_NFRAMES*2);
+}
+
+// *** Transcoders
+
+static void RunTranscodeUMP_MIDI1 (void)
+{
+    uint8_t MIDIMsg [3];
+    unsigned int Total=0;
+
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+        Total+=TranscodeUMPMessage_MIDI1 (&UMPMessages[i], &MIDIMsg[0]);
+    Sink=Total+MIDIMsg[0];
+}
+
+static void RunTranscodeMIDI1_UMP (void)
+{
+    uint32_t UMPMsg;
+    unsigned int Total=0;
+
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+    {
+        if (TranscodeMIDI1Message_UMP (&MIDI1Bytes[i*3], 3, 0, &UMPMsg))
+            Total+=UMPMsg;
+    }
+    Sink=Total;
+}
+
+static void RunTranscodeMIDI2_MIDI1 (void)
+{
+    uint8_t MIDIMsg [MIDI2_MAX_MIDI1_BYTES];
+    unsigned int Total=0;
+
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+        Total+=TranscodeMIDI2_MIDI1 (&MIDI2Messages[i*2], &MIDIMsg[0]);
+    Sink=Total;
+}
+
+// *** JACK input queued to JACK2NET
+
+static void SetupJackInput (void)
+{
+    jack_port_t* Port=Sessions[0].InputPort.load();
+
+    ResetDummyPort (Port);
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+        jack_midi_event_write (Port, i%BENCH_NFRAMES, &MIDI1Bytes[i*3], 3);
+    Sessions[0].JACK2NET.Reset();
+}
+
+static void RunJackToNet (void)
+{
+    ProcessJackToNet (&Sessions[0], Sessions[0].InputPort.load(), &Sessions[0].SysExTx, 0, BENCH_NFRAMES, 0);
+}
+
+// *** NetUMP packetization over loopback
+
+static void LoopbackCallback (void* UserInstance, uint32_t* DataBlock)
+{
+    LoopbackReceived++;
+}
+
+static void LoopbackConnectedCallback (const char* EndpointName, unsigned int size)
+{
+    LoopbackConnected=true;
+}
+
+static bool InitLoopback (void)
+{
+    uint64_t StartMs;
+
+    LoopbackReceiver=new CNetUMPHandler (&LoopbackCallback, 0);
+    LoopbackSender=new CNetUMPHandler (&LoopbackCallback, 0);
+    LoopbackReceiver->SetEndpointName ((char*)"Bench Receiver");
+    LoopbackReceiver->SetProductInstanceID ((char*)"BENCH_RX");
+    LoopbackSender->SetEndpointName ((char*)"Bench Sender");
+    LoopbackSender->SetProductInstanceID ((char*)"BENCH_TX");
+    LoopbackSender->SetConnectionCallback (&LoopbackConnectedCallback);
+
+    if (LoopbackReceiver->InitiateSession (0, 0, BENCH_LOOPBACK_PORT, false)<0) return false;
+    if (LoopbackSender->InitiateSession (0x7F000001, BENCH_LOOPBACK_PORT, BENCH_LOOPBACK_PORT+1, true)<0) return false;
+
+    StartMs=GetMonotonicMs();
+    while ((!LoopbackConnected)&&(GetMonotonicMs()-StartMs<BENCH_CONNECT_TIMEOUT))
+    {
+        LoopbackSender->RunSession();
+        LoopbackReceiver->RunSession();
+        usleep (1000);
+    }
+    return LoopbackConnected;
+}  // InitLoopback
+// ----------------------------------------------------
+
+static void CloseLoopback (void)
+{
+    if (LoopbackSender)
+    {
+        LoopbackSender->CloseSession();
+        delete LoopbackSender;
+        LoopbackSender=0;
+    }
+    if (LoopbackReceiver)
+    {
+        LoopbackReceiver->CloseSession();
+        delete LoopbackReceiver;
+        LoopbackReceiver=0;
+    }
+}  // CloseLoopback
+// ----------------------------------------------------
+
+static void SetupLoopback (void)
+{
+    // Drain the receiver socket so it does not drop packets, not measured
+    LoopbackReceiver->RunSession();
+}
+
+static void RunSendUMPMessage (void)
+{
+    // Same burst size as FlushJackToNet, followed by the RunSession() which sends the packet
+    for (unsigned int i=0; i<BENCH_BATCH; i++)
+    {
+        LoopbackSender->SendUMPMessage (&UMPMessages[i]);
+        if ((i+1)%MAX_TX_WORDS_PER_RUN==0)
+            LoopbackSender->RunSession();
+    }
+    LoopbackSender->RunSession();
+}
+
+static const TBenchmark Benchmarks [] = {
+    {"netump_callback_enqueue", &SetupEmptyFIFO, &RunNetUMPCallback},
+    {"fifo_drain_midi1", &SetupDrainMIDI1, &RunDrain},
+    {"fifo_drain_midi2", &SetupDrainMIDI2, &RunDrain},
+    {"fifo_drain_cc_flood", &SetupDrainCCFlood, &RunDrain},
+    {"transcode_ump_midi1", 0, &RunTranscodeUMP_MIDI1},
+    {"transcode_midi1_ump", 0, &RunTranscodeMIDI1_UMP},
+    {"transcode_midi2_midi1", 0, &RunTranscodeMIDI2_MIDI1},
+    {"jack_to_net_queue", &SetupJackInput, &RunJackToNet},
+    {"netump_send_packetize", &SetupLoopback, &RunSendUMPMessage},
+};
+#define NUM_BENCHMARKS  (sizeof(Benchmarks)/sizeof(Benchmarks[0]))
+
+static double GetPercentile (const std::vector<double>& Sorted, double Percent)
+{
+    size_t Index = (size_t)(Percent/100.0*(Sorted.size()-1)+0.5);
+    return Sorted[Index];
+}  // GetPercentile
+// ----------------------------------------------------
+
+static void PrintResult (const char* Name, std::vector<double>& NsPerMsg)
+{
+    double P50;
+
+    std::sort (NsPerMsg.begin(), NsPerMsg.end());
+    P50=GetPercentile (NsPerMsg, 50);
+
+    fprintf (stdout, "%s    {\"name\": \"%s\", \"messages_per_sample\": %u, \"samples\": %u, "
+             "\"ns_per_msg\": {\"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}, "
+             "\"msgs_per_sec\": {\"p50\": %.0f, \"p99\": %.0f}}",
+             FirstResult ? "" : ",\n", Name, BENCH_BATCH, (unsigned int)NsPerMsg.size(),
+             NsPerMsg.front(), P50, GetPercentile (NsPerMsg, 90), GetPercentile (NsPerMsg, 99), NsPerMsg.back(),
+             1e9/P50, 1e9/GetPercentile (NsPerMsg, 99));
+    FirstResult=false;
+}  // PrintResult
+// ----------------------------------------------------
+
+static void RunBenchmark (const TBenchmark* Benchmark)
+{
+    std::vector<double> NsPerMsg;
+    uint64_t Start;
+
+    NsPerMsg.reserve (NumSamples);
+    for (unsigned int s=0; s<BENCH_WARMUP_SAMPLES+NumSamples; s++)
+    {
+        if (Benchmark->Setup) Benchmark->Setup();
+        Start=GetNanoseconds();
+        Benchmark->Run();
+        if (s>=BENCH_WARMUP_SAMPLES)
+            NsPerMsg.push_back ((double)(GetNanoseconds()-Start)/BENCH_BATCH);
+    }
+
+    PrintResult (Benchmark->Name, NsPerMsg);
+}  // RunBenchmark
+// ----------------------------------------------------
+
+int main (int argc, char** argv)
+{
+    const char* Only=0;
+    struct utsname System;
+    bool HasLoopback;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], "--samples")==0 && i+1<argc)
+        {
+            NumSamples=atoi(argv[i+1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--only")==0 && i+1<argc)
+        {
+            Only=argv[i+1];
+            i++;
+        }
+        else
+        {
+            fprintf (stderr, "Usage : %s [--samples <n>] [--only <benchmark name>]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (NumSamples==0) NumSamples=1;
+
+    InitMessages();
+    InitBenchSession();
+    HasLoopback=InitLoopback();
+    if (!HasLoopback)
+        fprintf (stderr, "jacknetumpd-bench : loopback session not established, packetization benchmark skipped\n");
+
+    uname (&System);
+    fprintf (stdout, "{\n  \"machine\": \"%s\",\n  \"benchmarks\": [\n", System.machine);
+    for (unsigned int b=0; b<NUM_BENCHMARKS; b++)
+    {
+        if ((Only)&&(strcmp(Only, Benchmarks[b].Name)!=0)) continue;
+        if ((Benchmarks[b].Run==&RunSendUMPMessage)&&(!HasLoopback)) continue;
+        RunBenchmark (&Benchmarks[b]);
+    }
+    fprintf (stdout, "\n  ]\n}\n");
+
+    CloseLoopback();
+    return 0;
+}  // main
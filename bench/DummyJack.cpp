@@ -0,0 +1,205 @@
+/*
+ * DummyJack.cpp
+ * Minimal in-process replacement of libjack used by the benchmarks
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/metadata.h>
+#include "DummyJack.h"
+
+struct _jack_client {
+    JackProcessCallback ProcessCallback;
+    void* ProcessArg;
+};
+
+struct _jack_port {
+    unsigned int NumEvents;
+    size_t DataUsed;
+    jack_nframes_t LastTime;
+    jack_midi_event_t Events [DUMMY_MIDI_MAX_EVENTS];
+    jack_midi_data_t Data [DUMMY_MIDI_BUFFER_SIZE];
+};
+
+static jack_client_t DummyClient;
+static jack_nframes_t DummyFrameTime=0;
+static jack_nframes_t DummyCycleStart=0;
+
+void SetDummyFrameTime (jack_nframes_t FrameTime, jack_nframes_t CycleStart)
+{
+    DummyFrameTime=FrameTime;
+    DummyCycleStart=CycleStart;
+}  // SetDummyFrameTime
+// ----------------------------------------------------
+
+void ResetDummyPort (jack_port_t* Port)
+{
+    jack_midi_clear_buffer (Port);
+}  // ResetDummyPort
+// ----------------------------------------------------
+
+jack_client_t* jack_client_open (const char* client_name, jack_options_t options, jack_status_t* status, ...)
+{
+    memset (&DummyClient, 0, sizeof(DummyClient));
+    return &DummyClient;
+}
+
+int jack_client_close (jack_client_t* client)
+{
+    return 0;
+}
+
+int jack_set_process_callback (jack_client_t* client, JackProcessCallback process_callback, void* arg)
+{
+    client->ProcessCallback=process_callback;
+    client->ProcessArg=arg;
+    return 0;
+}
+
+void jack_on_shutdown (jack_client_t* client, JackShutdownCallback function, void* arg)
+{
+}
+
+int jack_set_xrun_callback (jack_client_t* client, JackXRunCallback xrun_callback, void* arg)
+{
+    return 0;
+}
+
+int jack_set_buffer_size_callback (jack_client_t* client, JackBufferSizeCallback bufsize_callback, void* arg)
+{
+    return 0;
+}
+
+jack_nframes_t jack_get_buffer_size (jack_client_t* client)
+{
+    return DUMMY_BUFFER_SIZE;
+}
+
+jack_nframes_t jack_get_sample_rate (jack_client_t* client)
+{
+    return DUMMY_SAMPLE_RATE;
+}
+
+int jack_activate (jack_client_t* client)
+{
+    return 0;
+}
+
+jack_native_thread_t jack_client_thread_id (jack_client_t* client)
+{
+    return pthread_self ();
+}
+
+jack_port_t* jack_port_register (jack_client_t* client, const char* port_name, const char* port_type, unsigned long flags, unsigned long buffer_size)
+{
+    jack_port_t* Port = (jack_port_t*)calloc (1, sizeof(jack_port_t));
+    return Port;
+}
+
+int jack_port_unregister (jack_client_t* client, jack_port_t* port)
+{
+    free (port);
+    return 0;
+}
+
+void* jack_port_get_buffer (jack_port_t* port, jack_nframes_t nframes)
+{
+    return port;
+}
+
+jack_uuid_t jack_port_uuid (const jack_port_t* port)
+{
+    return (jack_uuid_t)(uintptr_t)port;
+}
+
+jack_nframes_t jack_frame_time (const jack_client_t* client)
+{
+    return DummyFrameTime;
+}
+
+jack_nframes_t jack_last_frame_time (const jack_client_t* client)
+{
+    return DummyCycleStart;
+}
+
+jack_time_t jack_get_time (void)
+{
+    return (jack_time_t)DummyFrameTime*1000000/DUMMY_SAMPLE_RATE;
+}
+
+jack_time_t jack_frames_to_time (const jack_client_t* client, jack_nframes_t frames)
+{
+    return (jack_time_t)frames*1000000/DUMMY_SAMPLE_RATE;
+}
+
+int jack_set_property (jack_client_t* client, jack_uuid_t subject, const char* key, const char* value, const char* type)
+{
+    return 0;
+}
+
+int jack_remove_property (jack_client_t* client, jack_uuid_t subject, const char* key)
+{
+    return 0;
+}
+
+uint32_t jack_midi_get_event_count (void* port_buffer)
+{
+    return ((jack_port_t*)port_buffer)->NumEvents;
+}
+
+int jack_midi_event_get (jack_midi_event_t* event, void* port_buffer, uint32_t event_index)
+{
+    jack_port_t* Port = (jack_port_t*)port_buffer;
+
+    if (event_index>=Port->NumEvents) return -1;
+    *event=Port->Events[event_index];
+    return 0;
+}
+
+void jack_midi_clear_buffer (void* port_buffer)
+{
+    jack_port_t* Port = (jack_port_t*)port_buffer;
+
+    Port->NumEvents=0;
+    Port->DataUsed=0;
+    Port->LastTime=0;
+}
+
+size_t jack_midi_max_event_size (void* port_buffer)
+{
+    jack_port_t* Port = (jack_port_t*)port_buffer;
+
+    if (Port->NumEvents>=DUMMY_MIDI_MAX_EVENTS) return 0;
+    return DUMMY_MIDI_BUFFER_SIZE-Port->DataUsed;
+}
+
+jack_midi_data_t* jack_midi_event_reserve (void* port_buffer, jack_nframes_t time, size_t data_size)
+{
+    jack_port_t* Port = (jack_port_t*)port_buffer;
+    jack_midi_event_t* Event;
+
+    // Same rules as JACK : events in time order, no more than the buffer can hold
+    if (time<Port->LastTime) return 0;
+    if (Port->NumEvents>=DUMMY_MIDI_MAX_EVENTS) return 0;
+    if (Port->DataUsed+data_size>DUMMY_MIDI_BUFFER_SIZE) return 0;
+
+    Event=&Port->Events[Port->NumEvents++];
+    Event->time=time;
+    Event->size=data_size;
+    Event->buffer=&Port->Data[Port->DataUsed];
+    Port->DataUsed+=data_size;
+    Port->LastTime=time;
+    return Event->buffer;
+}
+
+int jack_midi_event_write (void* port_buffer, jack_nframes_t time, const jack_midi_data_t* data, size_t data_size)
+{
+    jack_midi_data_t* Buffer = jack_midi_event_reserve (port_buffer, time, data_size);
+
+    if (Buffer==0) return -1;
+    memcpy (Buffer, data, data_size);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef __DUMMYJACK_H__
+#define __DUMMYJACK_H__
+
+/*
+ * DummyJack.h
+ * Minimal in-process replacement of libjack used by the benchmarks
+ *
+ * Ports own a MIDI buffer in memory, frame time is set by the benchmark.
+ * Only the calls made by jacknetumpd are provided
+ */
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#define DUMMY_MIDI_MAX_EVENTS       1024
+#define DUMMY_MIDI_BUFFER_SIZE      32768
+#define DUMMY_SAMPLE_RATE           48000
+#define DUMMY_BUFFER_SIZE           256
+
+//! Set the values returned by jack_frame_time() and jack_last_frame_time()
+void SetDummyFrameTime (jack_nframes_t FrameTime, jack_nframes_t CycleStart);
+
+//! Empty the MIDI buffer of a port, as JACK does at the beginning of a cycle for input ports
+void ResetDummyPort (jack_port_t* Port);
+
+#endif // __DUMMYJACK_H__
@@ -0,0 +1,474 @@
+/*
+ * LoadTest.cpp
+ * Load generator standing in for a NetUMP peer, used by "make loadtest"
+ *
+ * The program invites a jacknetumpd running on localhost and sends it a message mix at
+ * rising rates. The daemon output port is connected to its input port, so every message
+ * comes back : latency markers (CC 119 on channel 16, which the mixes never use) give the
+ * round trip through the daemon, the JACK period and the network.
+ *
+ * Each step runs at a fixed rate, then the daemon statistics (--stats-socket) are read :
+ * messages the daemon did not receive, drops, process callback time and xruns. A step fails
+ * when something was lost or the 99th percentile round trip is above the latency limit.
+ * The report (one entry per step and the highest passing rate) is printed on stdout as JSON
+ *
+ * Usage : jacknetumpd-loadtest --stats-socket <path> [--port <daemon port>] [--mix <name>]
+ *         [--start-rate <msg/s>] [--rate-factor <x>] [--max-rate <msg/s>] [--step-seconds <s>]
+ *         [--max-latency <ms>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <vector>
+#include "NetUMP.h"
+#include "../EventLoop.h"
+#include "../SessionSocket.h"
+#include "../Transcoder.h"
+
+#define LOADTEST_LOCAL_PORT         15604
+#define LOADTEST_TICK_NS            1000000     // Messages are sent every millisecond
+#define LOADTEST_MAX_TX_WORDS       256         // Same burst size as the daemon, one MTU
+#define LOADTEST_MAX_RX_PER_TICK    64          // Datagrams read per tick
+#define LOADTEST_MARKER_MS          25          // Above the JACK period, so markers are never merged by the daemon
+#define LOADTEST_DRAIN_MS           500         // Left to the daemon after a step before reading its statistics
+#define LOADTEST_CONNECT_TIMEOUT    5000        // In ms
+#define LOADTEST_SYSEX_PACKETS      8           // MT 3 packets per SysEx burst
+#define LOADTEST_STATS_SIZE         65536
+
+#define MARKER_STATUS               0xBF        // Control Change, channel 16
+#define MARKER_CONTROLLER           119
+
+enum {
+    MIX_NOTES,          // MT 2 Note On / Note Off
+    MIX_MIDI2,          // MT 4 Note On / Note Off
+    MIX_CC,             // MT 2 Control Change and Pitch Bend flood
+    MIX_SYSEX,          // MT 3 SysEx bursts
+    MIX_GROUPS,         // MT 2 notes spread over the 16 groups
+    MIX_ALL,            // All of the above in turn
+    NUM_MIXES
+};
+
+static const char* MixNames [NUM_MIXES] = {"notes", "midi2", "cc", "sysex", "groups", "all"};
+
+typedef struct {
+    uint64_t RxMessages;        // Received by the daemon (all message types)
+    uint64_t Drops;             // All reasons
+    uint64_t RxFifoDrops;       // UMP2JACK FIFO full (newest or oldest messages dropped)
+    uint64_t Xruns;
+    uint64_t ProcessPeriods;
+    uint64_t ProcessTimeNs;
+    uint64_t ProcessTimeMaxNs;
+    uint64_t UMP2JACKHighWater;
+} TDaemonStats;
+
+static CNetUMPHandler* Peer=0;
+static volatile bool PeerConnected=false;
+static int PeerSocketFD=-1;
+
+static unsigned int Mix=MIX_ALL;
+static unsigned int MixCounter=0;
+static uint64_t MarkerSentNs [128];
+static unsigned int MarkerSeq=0;
+static unsigned int MarkersSent=0;
+static unsigned int MarkersReceived=0;
+static std::vector<double> RoundTripMs;
+static bool FirstStep=true;
+
+static inline uint64_t GetNanoseconds (void)
+{
+    struct timespec Now;
+
+    clock_gettime (CLOCK_MONOTONIC, &Now);
+    return ((uint64_t)Now.tv_sec*1000000000)+Now.tv_nsec;
+}  // GetNanoseconds
+// ----------------------------------------------------
+
+// Messages echoed by the daemon : only markers are looked at
+static void PeerCallback (void* UserInstance, uint32_t* DataBlock)
+{
+    unsigned int Seq;
+
+    if ((DataBlock[0]>>28)!=0x02) return;
+    if (((DataBlock[0]>>16)&0xFF)!=MARKER_STATUS) return;
+    if (((DataBlock[0]>>8)&0xFF)!=MARKER_CONTROLLER) return;
+
+    Seq=DataBlock[0]&0x7F;
+    if (MarkerSentNs[Seq]==0) return;
+    RoundTripMs.push_back ((double)(GetNanoseconds()-MarkerSentNs[Seq])/1000000.0);
+    MarkerSentNs[Seq]=0;
+    MarkersReceived++;
+}  // PeerCallback
+// ----------------------------------------------------
+
+static void PeerConnectedCallback (const char* EndpointName, unsigned int size)
+{
+    PeerConnected=true;
+}  // PeerConnectedCallback
+// ----------------------------------------------------
+
+// Read what the daemon sent back. RunSession() reads one datagram per call
+static void ReadPeer (void)
+{
+    Peer->RunSession();
+    for (unsigned int d=1; (d<LOADTEST_MAX_RX_PER_TICK)&&(PeerSocketFD>=0)&&(HasPendingDatagram(PeerSocketFD)); d++)
+        Peer->RunSession();
+}  // ReadPeer
+// ----------------------------------------------------
+
+// Next message of the mix, in Words. Returns the number of messages it counts for
+static unsigned int MakeMixMessage (unsigned int MixType, uint32_t* Words, unsigned int* NumWords)
+{
+    unsigned int n=MixCounter++;
+    unsigned int Channel=n%15;
+    unsigned int Note=36+(n/2)%48;
+    unsigned int Pos;
+
+    switch (MixType)
+    {
+        case MIX_NOTES :
+            Words[0]=0x20000000|((n&1) ? 0x800000 : 0x900000)|(Channel<<16)|(Note<<8)|0x40;
+            *NumWords=1;
+            return 1;
+        case MIX_MIDI2 :
+            Words[0]=0x40000000|((n&1) ? 0x800000 : 0x900000)|(Channel<<16)|(Note<<8);
+            Words[1]=0x80000000;
+            *NumWords=2;
+            return 1;
+        case MIX_CC :
+            if (n&1)
+                Words[0]=0x20E00000|(Channel<<16)|((n&0x7F)<<8)|((n>>7)&0x7F);
+            else
+                Words[0]=0x20B00000|(Channel<<16)|(((n&2) ? 74 : 1)<<8)|(n&0x7F);
+            *NumWords=1;
+            return 1;
+        case MIX_SYSEX :
+            // Start, continue... end : 6 data bytes per packet
+            for (unsigned int p=0; p<LOADTEST_SYSEX_PACKETS; p++)
+            {
+                Pos=(p==0) ? 0x1 : (p==LOADTEST_SYSEX_PACKETS-1) ? 0x3 : 0x2;
+                Words[p*2]=0x30000000|(Pos<<20)|(6<<16)|(0x7D<<8)|(p&0x7F);
+                Words[p*2+1]=0x01020304;
+            }
+            *NumWords=LOADTEST_SYSEX_PACKETS*2;
+            return LOADTEST_SYSEX_PACKETS;
+        case MIX_GROUPS :
+            Words[0]=0x20000000|((n%16)<<24)|((n&1) ? 0x800000 : 0x900000)|(Channel<<16)|(Note<<8)|0x40;
+            *NumWords=1;
+            return 1;
+    }
+
+    MixCounter--;
+    return MakeMixMessage (n%(NUM_MIXES-1), Words, NumWords);
+}  // MakeMixMessage
+// ----------------------------------------------------
+
+// Send Count messages (or a bit more for a SysEx burst) in bursts of one MTU. Returns the number sent
+static unsigned int SendMessages (unsigned int Count)
+{
+    uint32_t Words [LOADTEST_SYSEX_PACKETS*2];
+    unsigned int NumWords;
+    unsigned int BurstWords=0;
+    unsigned int Sent=0;
+
+    while (Sent<Count)
+    {
+        Sent+=MakeMixMessage (Mix, &Words[0], &NumWords);
+        if (BurstWords+NumWords>LOADTEST_MAX_TX_WORDS)
+        {
+            Peer->RunSession();
+            BurstWords=0;
+        }
+
+        for (unsigned int Pos=0; Pos<NumWords; Pos+=UMPWordCount[Words[Pos]>>28])
+            Peer->SendUMPMessage (&Words[Pos]);
+        BurstWords+=NumWords;
+    }
+    if (BurstWords>0)
+        Peer->RunSession();
+    return Sent;
+}  // SendMessages
+// ----------------------------------------------------
+
+static void SendMarker (void)
+{
+    uint32_t Marker;
+
+    MarkerSeq=(MarkerSeq+1)&0x7F;
+    Marker=0x20000000|(MARKER_STATUS<<16)|(MARKER_CONTROLLER<<8)|MarkerSeq;
+    MarkerSentNs[MarkerSeq]=GetNanoseconds();
+    Peer->SendUMPMessage (&Marker);
+    Peer->RunSession();
+    MarkersSent++;
+}  // SendMarker
+// ----------------------------------------------------
+
+// Value following "Key": in the JSON answer of the daemon (0 if not found)
+static uint64_t GetJSONValue (const char* Answer, const char* Key)
+{
+    char Pattern [64];
+    const char* Pos;
+
+    snprintf (Pattern, sizeof(Pattern), "\"%s\": ", Key);
+    Pos=strstr (Answer, Pattern);
+    if (Pos==0) return 0;
+    return strtoull (Pos+strlen(Pattern), 0, 10);
+}  // GetJSONValue
+// ----------------------------------------------------
+
+static bool ReadDaemonStats (const char* SocketPath, TDaemonStats* Stats)
+{
+    static char Answer [LOADTEST_STATS_SIZE];
+    struct sockaddr_un Addr;
+    size_t Len=0;
+    ssize_t Read;
+    const char* Pos;
+    char* End;
+    int fd;
+
+    memset (Stats, 0, sizeof(TDaemonStats));
+    fd=socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd<0) return false;
+
+    memset (&Addr, 0, sizeof(Addr));
+    Addr.sun_family=AF_UNIX;
+    snprintf (Addr.sun_path, sizeof(Addr.sun_path), "%s", SocketPath);
+    if ((connect (fd, (struct sockaddr*)&Addr, sizeof(Addr))<0)||(write (fd, "json\n", 5)!=5))
+    {
+        close (fd);
+        return false;
+    }
+
+    // The daemon closes the connection after the answer
+    while ((Read=read (fd, &Answer[Len], sizeof(Answer)-1-Len))>0)
+        Len+=Read;
+    close (fd);
+    Answer[Len]=0;
+
+    // First session is the one we are connected to
+    Pos=strstr (Answer, "\"rx_messages_by_mt\": [");
+    if (Pos==0) return false;
+    Pos+=strlen ("\"rx_messages_by_mt\": [");
+    for (unsigned int mt=0; mt<16; mt++)
+    {
+        Stats->RxMessages+=strtoull (Pos, &End, 10);
+        Pos=End+1;
+    }
+
+    Stats->RxFifoDrops=GetJSONValue (Answer, "rx_fifo_full")+GetJSONValue (Answer, "rx_fifo_oldest");
+    Stats->Drops=Stats->RxFifoDrops+GetJSONValue (Answer, "jack_buffer_full")+GetJSONValue (Answer, "tx_fifo_full");
+    Stats->Xruns=GetJSONValue (Answer, "xruns");
+    Stats->ProcessPeriods=GetJSONValue (Answer, "process_periods");
+    Stats->ProcessTimeNs=GetJSONValue (Answer, "process_time_ns");
+    Stats->ProcessTimeMaxNs=GetJSONValue (Answer, "process_time_max_ns");
+    Stats->UMP2JACKHighWater=GetJSONValue (Answer, "ump2jack_high_water");
+    return true;
+}  // ReadDaemonStats
+// ----------------------------------------------------
+
+// Keep the session running without sending anything
+static void Idle (unsigned int Ms)
+{
+    uint64_t EndMs=GetMonotonicMs()+Ms;
+
+    while (GetMonotonicMs()<EndMs)
+    {
+        ReadPeer();
+        usleep (1000);
+    }
+}  // Idle
+// ----------------------------------------------------
+
+static bool Connect (unsigned short DaemonPort)
+{
+    uint64_t StartMs;
+
+    Peer=new CNetUMPHandler (&PeerCallback, 0);
+    Peer->SetEndpointName ((char*)"jacknetumpd loadtest");
+    Peer->SetProductInstanceID ((char*)"LOADTEST");
+    Peer->SetConnectionCallback (&PeerConnectedCallback);
+    if (Peer->InitiateSession (0x7F000001, DaemonPort, LOADTEST_LOCAL_PORT, true)<0)
+        return false;
+    PeerSocketFD=FindUDPSocketByPort (LOADTEST_LOCAL_PORT);
+
+    StartMs=GetMonotonicMs();
+    while ((!PeerConnected)&&(GetMonotonicMs()-StartMs<LOADTEST_CONNECT_TIMEOUT))
+    {
+        Peer->RunSession();
+        usleep (1000);
+    }
+    return PeerConnected;
+}  // Connect
+// ----------------------------------------------------
+
+static double GetPercentile (const std::vector<double>& Sorted, double Percent)
+{
+    if (Sorted.empty()) return 0;
+    return Sorted[(size_t)(Percent/100.0*(Sorted.size()-1)+0.5)];
+}  // GetPercentile
+// ----------------------------------------------------
+
+// Send at Rate messages/second for Seconds, then compare with what the daemon got. Returns true if nothing was lost
+static bool RunStep (unsigned int Rate, unsigned int Seconds, double MaxLatencyMs, const char* StatsPath)
+{
+    TDaemonStats Before, After;
+    struct timespec Next;
+    uint64_t StartNs, EndNs, NowNs;
+    uint64_t LastMarkerNs;
+    uint64_t Sent=0;
+    uint64_t Due;
+    uint64_t Lost;
+    uint64_t Periods;
+    double P99;
+    bool Pass;
+
+    if (!ReadDaemonStats (StatsPath, &Before))
+    {
+        fprintf (stderr, "jacknetumpd-loadtest : can not read daemon statistics on %s\n", StatsPath);
+        return false;
+    }
+
+    RoundTripMs.clear();
+    memset (&MarkerSentNs[0], 0, sizeof(MarkerSentNs));
+    MarkersSent=0;
+    MarkersReceived=0;
+
+    StartNs=GetNanoseconds();
+    EndNs=StartNs+(uint64_t)Seconds*1000000000;
+    LastMarkerNs=0;
+    clock_gettime (CLOCK_MONOTONIC, &Next);
+
+    while ((NowNs=GetNanoseconds())<EndNs)
+    {
+        // Messages due since the start, so the rate does not depend on the tick accuracy
+        Due=(NowNs-StartNs)*Rate/1000000000;
+        if (Due>Sent)
+            Sent+=SendMessages (Due-Sent);
+
+        if (NowNs-LastMarkerNs>=(uint64_t)LOADTEST_MARKER_MS*1000000)
+        {
+            SendMarker();
+            LastMarkerNs=NowNs;
+        }
+        ReadPeer();
+
+        Next.tv_nsec+=LOADTEST_TICK_NS;
+        if (Next.tv_nsec>=1000000000)
+        {
+            Next.tv_sec++;
+            Next.tv_nsec-=1000000000;
+        }
+        clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &Next, 0);
+    }
+
+    Idle (LOADTEST_DRAIN_MS);
+    if (!ReadDaemonStats (StatsPath, &After))
+    {
+        fprintf (stderr, "jacknetumpd-loadtest : can not read daemon statistics on %s\n", StatsPath);
+        return false;
+    }
+
+    // Markers are messages too. Session keep-alive messages are not UMP messages
+    Sent+=MarkersSent;
+    Lost=(Sent>After.RxMessages-Before.RxMessages) ? Sent-(After.RxMessages-Before.RxMessages) : 0;
+    Periods=After.ProcessPeriods-Before.ProcessPeriods;
+
+    std::sort (RoundTripMs.begin(), RoundTripMs.end());
+    P99=GetPercentile (RoundTripMs, 99);
+    Pass=(Lost==0)&&(After.Drops==Before.Drops)&&(MarkersReceived==MarkersSent)&&(P99<=MaxLatencyMs);
+
+    fprintf (stdout, "%s    {\"rate\": %u, \"sent\": %llu, \"lost_on_network\": %llu, \"drops\": %llu, \"ump2jack_fifo_drops\": %llu, "
+             "\"ump2jack_high_water\": %llu, \"markers_lost\": %u, "
+             "\"round_trip_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+             "\"process_time_us\": {\"avg\": %.2f, \"max_since_start\": %.2f}, \"xruns\": %llu, \"pass\": %s}",
+             FirstStep ? "" : ",\n", Rate, (unsigned long long)Sent, (unsigned long long)Lost,
+             (unsigned long long)(After.Drops-Before.Drops), (unsigned long long)(After.RxFifoDrops-Before.RxFifoDrops),
+             (unsigned long long)After.UMP2JACKHighWater, MarkersSent-MarkersReceived,
+             GetPercentile (RoundTripMs, 50), P99, RoundTripMs.empty() ? 0.0 : RoundTripMs.back(),
+             (Periods>0) ? (double)(After.ProcessTimeNs-Before.ProcessTimeNs)/Periods/1000.0 : 0.0,
+             (double)After.ProcessTimeMaxNs/1000.0, (unsigned long long)(After.Xruns-Before.Xruns),
+             Pass ? "true" : "false");
+    fflush (stdout);
+    FirstStep=false;
+    return Pass;
+}  // RunStep
+// ----------------------------------------------------
+
+int main (int argc, char** argv)
+{
+    const char* StatsPath=0;
+    unsigned short DaemonPort=5604;
+    unsigned int StartRate=1000;
+    unsigned int MaxRate=2000000;
+    double RateFactor=1.5;
+    unsigned int StepSeconds=5;
+    double MaxLatencyMs=20.0;
+    unsigned int Rate;
+    unsigned int MaxPassed=0;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], "--stats-socket")==0 && i+1<argc)
+            StatsPath=argv[++i];
+        else if (strcmp(argv[i], "--port")==0 && i+1<argc)
+            DaemonPort=atoi(argv[++i]);
+        else if (strcmp(argv[i], "--start-rate")==0 && i+1<argc)
+            StartRate=atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-rate")==0 && i+1<argc)
+            MaxRate=atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rate-factor")==0 && i+1<argc)
+            RateFactor=atof(argv[++i]);
+        else if (strcmp(argv[i], "--step-seconds")==0 && i+1<argc)
+            StepSeconds=atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-latency")==0 && i+1<argc)
+            MaxLatencyMs=atof(argv[++i]);
+        else if (strcmp(argv[i], "--mix")==0 && i+1<argc)
+        {
+            i++;
+            for (Mix=0; Mix<NUM_MIXES; Mix++)
+                if (strcmp(argv[i], MixNames[Mix])==0) break;
+            if (Mix==NUM_MIXES)
+            {
+                fprintf (stderr, "jacknetumpd-loadtest : unknown mix '%s' (notes, midi2, cc, sysex, groups or all)\n", argv[i]);
+                return -1;
+            }
+        }
+        else
+        {
+            fprintf (stderr, "Usage : %s --stats-socket <path> [--port <daemon port>] [--mix notes|midi2|cc|sysex|groups|all]\n"
+                     "       [--start-rate <msg/s>] [--rate-factor <x>] [--max-rate <msg/s>] [--step-seconds <s>] [--max-latency <ms>]\n", argv[0]);
+            return -1;
+        }
+    }
+    if ((StatsPath==0)||(StartRate==0)||(RateFactor<=1.0)||(StepSeconds==0))
+    {
+        fprintf (stderr, "jacknetumpd-loadtest : --stats-socket is required, rates and step duration must be above 0, rate factor above 1\n");
+        return -1;
+    }
+
+    if (!Connect (DaemonPort))
+    {
+        fprintf (stderr, "jacknetumpd-loadtest : no session with the daemon on port %u\n", DaemonPort);
+        return -1;
+    }
+    Idle (LOADTEST_DRAIN_MS);       // Endpoint discovery of the daemon
+
+    fprintf (stdout, "{\n  \"mix\": \"%s\",\n  \"max_latency_ms\": %.1f,\n  \"steps\": [\n", MixNames[Mix], MaxLatencyMs);
+    for (Rate=StartRate; Rate<=MaxRate; Rate=(unsigned int)(Rate*RateFactor))
+    {
+        if (!RunStep (Rate, StepSeconds, MaxLatencyMs, StatsPath))
+            break;
+        MaxPassed=Rate;
+    }
+    fprintf (stdout, "\n  ],\n  \"max_sustainable_msgs_per_sec\": %u\n}\n", MaxPassed);
+
+    Peer->CloseSession();
+    delete Peer;
+    return (MaxPassed>0) ? 0 : 1;
+}  // main
+// ----------------------------------------------------
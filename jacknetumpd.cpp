@@ -34,6 +34,32 @@
 --localport <port>       Set local port for Network UMP (5504 by default)
 --remoteport <port>      Set destination port when Zynthian is session initiator
 --endpoint-name <name>   Set local UMP Endpoint Name ("Zynthian NetUMP" by default)
+--sessions <n>           Accept up to n peers at the same time, on consecutive local ports (1 by default)
+--session-tick <ms>      Set NetUMP session housekeeping period (10 ms by default)
+--jitter-buffer <frames> Add a fixed delay to messages received from the network (0 by default)
+--jitter-buffer auto     Play messages with the timing they were sent with (JR Timestamps), adapting the delay to the jitter.
+                         JR Timestamps are used once the peer requests them in a Stream Configuration request
+--midi2                  Advertise MIDI 2.0 Protocol and accept it when requested by the peer
+--ump-ports              Register UMP JACK ports (JackPortIsMIDI2) and pass messages without conversion
+--rt-safe                Report socket I/O or blocking calls made from the JACK process callback
+--measure-latency <s>    Send latency probes to the peer for s seconds (0 : until stopped) and print histograms
+--reflect                Echo latency probes received from the peer (other side of --measure-latency)
+--stats-socket <path>    Export runtime statistics (Prometheus text or JSON) on a Unix socket
+--fec-depth <n>          Send note-off and state messages n more times, drop the copies received (0 by default)
+--routes <file>          Filter, remap and dispatch messages to several JACK ports according to the rules in file (see Routes.h)
+--connect-to <pattern>   Invite the peers found by mDNS whose UMPEndpointName or ProductInstanceId matches pattern (wildcards allowed)
+--function-block <g>:<name>  Declare a static Function Block on group(s) g (1-16, range with '-'), with its own JACK ports
+--rt-priority <n>        Run the network thread with SCHED_FIFO priority n (1-99, keep it below the JACK priority)
+--cpu <list>             Pin the network thread to the CPUs of list (e.g. 3 or 2-3)
+--jack-cpu <list>        Pin the JACK process thread to the CPUs of list
+--mlock                  Lock the daemon memory (mlockall) and fault in the FIFOs and stack at startup
+--socket-buffer <KB>     Set the kernel receive and send buffers of the session sockets
+--busy-poll <us>         Busy poll the network device for up to us microseconds when reading session sockets (SO_BUSY_POLL)
+--record <file>          Log the UMP messages received from the network and sent to it (see Recorder.h for the format)
+--replay <file>          Play the messages received in a log made with --record, as if they came from the network, then stop
+--replay-speed <x>       Replay x times faster than recorded (1 by default)
+--fifo-size <words>      Size of the FIFO of messages from the network to JACK, per session (16384 32-bit words by default)
+--fifo-policy <policy>   What to drop when this FIFO is full : drop-newest (default), drop-oldest or priority (see FIFOPolicy.h)
 --help                   Display this help message
 
  */
@@ -68,6 +94,60 @@
   - all printf transformed to fprintf with adequate stream (stdout or stderr)
   - local port and destination port are now defined separately
   - code cleanup in UMP_mDNS
+
+  V1.5 : 16/10/2026
+  - network loop is now event driven (epoll) : incoming packets are processed as soon as they are received,
+    session housekeeping and mDNS announces run on timers instead of a 1 ms polling loop
+  - messages received from the network are timestamped and played at their position in the JACK period
+    (one period later) instead of being all sent at frame 0
+  - UMP2JACK FIFO replaced by a lock-free ring with proper memory ordering, messages from a network packet
+    are committed in one operation
+  - messages from JACK are queued once per period and sent by the network thread, in bursts bounded to one MTU
+  - no socket I/O from the JACK process callback anymore : it only wakes the network thread up (eventfd write)
+    when that thread is sleeping.
+    --rt-safe option reports any unsafe call made from the process callback
+  - several peers can be connected at the same time (--sessions), each one with its own JACK ports
+  - SYSEX supported in both directions : UMP SYSEX7/SYSEX8 packets are reassembled into one JACK event,
+    JACK SYSEX of any length are segmented into UMP packets. When part of a segmented SYSEX can not be queued
+    (JACK2NET full), the rest of it is dropped and counted as one dropped message
+  - MIDI 2.0 Protocol can be negotiated (--midi2) and UMP JACK ports used (--ump-ports) so messages are
+    passed without transcoding. MIDI 2.0 Channel Voice messages are converted when ports are MIDI 1.0
+  - UMP / MIDI 1.0 conversion uses lookup tables generated at compile time (Transcoder.cpp)
+  - end-to-end latency can be measured against another jacknetumpd running with --reflect (--measure-latency)
+  - messages, drops, FIFO high-water marks and xruns are counted, and exported on a Unix socket (--stats-socket)
+  - note-off and state messages can be sent several times to avoid stuck notes on lossy links (--fec-depth)
+  - adaptive jitter buffer (--jitter-buffer auto) : sender clock offset and drift are estimated from JR Timestamps,
+    the delay follows the observed jitter. The playout frame is computed on reception and stored in the FIFO.
+    JR support is advertised in Endpoint Info. Sessions start without JR Timestamps, they are sent and expected only
+    once the peer has requested them with a Stream Configuration request
+  - routing table (--routes) : messages can be filtered by type/group/channel/status, remapped to another group or
+    channel and sent to several JACK output ports. Rules are compiled into one lookup table per direction
+  - messages are only written to JACK if the output buffer can hold them, the others are played in next period
+    instead of being dropped. Controller and pitch bend updates due in the same period are merged (last value wins)
+  - Function Blocks (--function-block) : Endpoint Info reports them, Function Block Info/Name discovery is answered.
+    Each block has its own JACK port pair. Endpoint Name is taken from --endpoint-name and sent in several packets if needed
+  - mDNS responder : queries for _midi2._udp are answered at once (with known-answer suppression) instead of
+    broadcasting the records every 5 seconds. Names are probed and announced when starting, a goodbye is sent
+    when stopping. The advertised port and UMPEndpointName come from --localport and --endpoint-name. With
+    --sessions, each session is advertised with its own port and ProductInstanceId (also sent in endpoint discovery).
+    The mDNS host name is taken from the system host name
+  - peers can be found by mDNS and invited automatically (--connect-to), each one in its own session. They are
+    invited again when they come back or when their address changes
+  - mDNS records are built for every interface which is up (read with netlink), with its A and AAAA records.
+    Address changes are announced at once
+  - realtime options : SCHED_FIFO network thread (--rt-priority), CPU pinning of the network and JACK threads
+    (--cpu, --jack-cpu), memory locking with the session buffers faulted in at startup (--mlock)
+  - all datagrams queued on a session socket are read in one wake-up (up to SESSION_RX_BATCH). Kernel buffers of the
+    session sockets can be enlarged (--socket-buffer) and busy polling enabled (--busy-poll)
+  - every RunSession() call is a tick of the NetUMP timers : packets read or sent at once use ticks ahead of time
+    (up to MAX_SESSION_LEAD_TICKS, one full SESSION_RX_BATCH), the housekeeping timer only runs the ticks still
+    missing, so the library timeouts follow real time. Datagrams and bursts beyond that wait for the next millisecond
+  - session recorder (--record) : UMP messages received and sent are logged to a binary file by a background thread.
+    The log can be replayed through the network to JACK path (--replay), at recorded or accelerated speed (--replay-speed)
+  - time spent in the JACK process callback is exported with the statistics. "make loadtest" measures the highest
+    message rate sustained with a stand-in peer on localhost and a dummy JACK backend
+  - UMP2JACK FIFO size is set at startup (--fifo-size). When it is full, the newest or the oldest messages can be
+    dropped, or messages ending notes can be given priority over controller updates (--fifo-policy)
  */
 
 #include <stdio.h>
@@ -78,233 +158,1543 @@
 #include <string.h>
 #include <math.h>
 #include <signal.h>
+#include <time.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <atomic>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/metadata.h>
+
+#include "NetUMP.h"
+#include "Endpoint.h"
+#include "UMP_mDNS.h"
+#include "EventLoop.h"
+#include "UMPRing.h"
+#include "RTSafe.h"
+#include "SysEx.h"
+#include "MIDI2Convert.h"
+#include "Transcoder.h"
+#include "Latency.h"
+#include "Stats.h"
+#include "FEC.h"
+#include "JitterBuffer.h"
+#include "OutputScheduler.h"
+#include "Routes.h"
+#include "RealTime.h"
+#include "SessionSocket.h"
+#include "Recorder.h"
+#include "FIFOPolicy.h"
+
+#define DEFAULT_SESSION_TICK_MS     10
+#define MAX_SESSION_CATCHUP_TICKS   1000        // Do not replay more than 1 second of session ticks after a stall
+#define MAX_SESSION_LEAD_TICKS      SESSION_RX_BATCH    // Session ticks run ahead of the elapsed time for packets read or sent at once
+#define SESSION_BUDGET_WAIT_MS      1           // Packets which could not get a tick are read or sent after the next ms boundary
+#define UMP2JACK_FIFO_SIZE          16384       // In 32-bit words, default for --fifo-size (large enough for SYSEX bursts)
+#define MIN_UMP2JACK_FIFO_SIZE      1024
+#define MAX_UMP2JACK_FIFO_SIZE      (1<<24)
+#define RX_STAGING_SIZE             512
+#define RX_PENDING_SIZE             1024        // Messages kept by the network thread while UMP2JACK is full (--fifo-policy)
+#define JACK2NET_FIFO_SIZE          16384       // In 32-bit words, must be a power of two
+#define TX_BATCH_SIZE               256
+#define MAX_TX_WORDS_PER_RUN        256         // Keep each burst given to NetUMP within one Ethernet MTU
+#define MAX_SESSIONS                8
+#if MAX_SESSIONS>MDNS_MAX_INSTANCES
+#error "Each session is advertised by its own mDNS service instance"
+#endif
+#define JACK_PORT_IS_MIDI2          0x20        // JackPortIsMIDI2 : port carries UMP (PipeWire and recent JACK2)
+#define LATENCY_PROBE_PERIOD_MS     100
+#define FEC_COPY_INTERVAL_MS        10          // Copies are repeated at this rate when nothing else is sent
+#define PEER_REINVITE_MS            5000        // Invitation to a peer found by mDNS is repeated until it is connected
+#define FIFO_FRAME_MASK             0x00FFFFFF  // UMP2JACK header : playout frame on 24 bits, port mask in the upper byte
+#define SESSION_RX_BATCH            64          // Datagrams read per session socket wake-up
+#define REPLAY_TICK_MS              1
+#define REPLAY_DRAIN_MS             1000        // Time left to JACK to play the end of a replay before stopping
+
+// Everything related to one remote peer. Each session listens on its own UDP port
+typedef struct {
+    unsigned int Index;
+    unsigned short LocalPort;
+    CNetUMPHandler* Handler;
+    int SocketFD;
+    bool RxPaused;                              // SocketFD is not watched until a session tick is available
+    uint64_t TicksDone;
+    std::atomic<jack_port_t*> InputPort;        // Published to the JACK thread once registered
+    std::atomic<jack_port_t*> OutputPort;
+    jack_port_t* RoutePorts [ROUTE_MAX_PORTS];  // Extra output ports (index 0 unused, main port is OutputPort)
+    jack_port_t* BlockInputPorts [MAX_FUNCTION_BLOCKS];     // Function Block inputs, their outputs are route ports
+    std::atomic<uint8_t> Protocol;              // Protocol selected by the peer (UMP_PROTOCOL_MIDI1 or UMP_PROTOCOL_MIDI2)
+    std::atomic<uint8_t> JR;                    // JR Timestamps settings (UMP_JR_TX / UMP_JR_RX), changed by the peer
+    std::atomic<bool> Connected;
+    TSessionStats* Stats;
+    CUMPDynamicRing UMP2JACK;                   // Allocated at startup (--fifo-size)
+    CUMPRing<JACK2NET_FIFO_SIZE> JACK2NET;
+    uint32_t RxStaging [RX_STAGING_SIZE];       // Messages received in current network packet, waiting to be pushed to UMP2JACK
+    unsigned int RxStagingLen;
+    CUMPRing<RX_PENDING_SIZE> RxPending;        // Used by network thread only : messages waiting for room in UMP2JACK
+    std::atomic<uint32_t> UMP2JACKDropRequest;  // Words of the oldest messages the JACK thread has to drop (drop-oldest)
+    uint16_t RxSysExQueued [2];                 // Groups with a SYSEX (MT 3, MT 5) whose start packet has been queued
+    uint16_t RxSysExDropped [2];                // Groups with a SYSEX whose start packet has been dropped
+    uint16_t JackSysExSkip [2];                 // Used by JACK thread only : groups with a SYSEX whose oldest packets have been dropped
+    CSysExAssembler SysExRx;                    // Used by JACK thread only
+    TOutputScheduler Output;                    // Used by JACK thread only
+    TSysExTxState SysExTx;
+    TSysExTxState BlockSysExTx [MAX_FUNCTION_BLOCKS];
+    TFECTxState FECTx;                          // Used by network thread only
+    TFECRxState FECRx;
+    uint64_t LastFECMs;
+    TJitterBuffer Jitter;                       // Used by network thread only
+    char PeerID [MDNS_MAX_SERVICE_NAME];        // ProductInstanceId of the peer invited with --connect-to, empty if none
+    uint32_t PeerIP;
+    unsigned short PeerPort;
+    uint64_t LastInviteMs;
+} TNetUMPSession;
+
+static jack_client_t *client;
+volatile bool break_request=false;
+
+static TNetUMPSession Sessions [MAX_SESSIONS];
+static unsigned int NumSessions=1;
+
+static uint64_t SessionStartMs;
+static int SessionBudgetTimer = -1;             // Fires when the sessions can run one more tick
+static jack_nframes_t JitterBufferFrames=0;
+static bool AdaptiveJitter=false;
+static jack_nframes_t SampleRate=48000;
+static std::atomic<jack_nframes_t> PeriodFrames (0);
+static bool UMPPorts=false;
+static unsigned int BlockPorts [MAX_FUNCTION_BLOCKS];      // Route port of each Function Block
+static bool AutoConnect=false;
+static bool FixedPeer=false;            // First session is used for --host
+static unsigned int FIFOPolicy=FIFO_DROP_NEWEST;
+
+static double ReplaySpeed=1.0;
+static uint64_t ReplayStartUs;
+static uint64_t ReplayFirstUs;
+static uint64_t ReplayEndMs=0;
+static unsigned long ReplayedMessages=0;
+static unsigned long ReplaySkipped=0;
+
+// Push all messages received from the network to the FIFO with a single index update, then the
+// messages kept while the FIFO was full (they came after the staged ones) as long as there is room
+static void FlushRxStaging (TNetUMPSession* Session)
+{
+    unsigned int Available, Free;
+    unsigned int Pos, Size;
+
+    if (Session->RxStagingLen>0)
+    {
+        Session->UMP2JACK.Push(&Session->RxStaging[0], Session->RxStagingLen);
+        Session->RxStagingLen=0;
+    }
+
+    // Kept messages which fit are moved at once, without splitting a message
+    Available=Session->RxPending.GetReadAvailable();
+    Free=Session->UMP2JACK.GetFreeSpace();
+    for (Pos=0; Pos<Available; Pos+=Size)
+    {
+        Size=UMPWordCount[Session->RxPending.Peek(Pos+1)>>28]+1;
+        if (Pos+Size>Free)
+            break;
+    }
+    if (Pos>0)
+        Session->UMP2JACK.PushFrom(Session->RxPending, Pos);
+
+    // Drop oldest : the JACK thread makes room for what is left at the beginning of next period
+    if ((FIFOPolicy==FIFO_DROP_OLDEST)&&(Session->RxPending.GetReadAvailable()>0))
+        Session->UMP2JACKDropRequest.store(Session->RxPending.GetReadAvailable(), std::memory_order_relaxed);
+}  // FlushRxStaging
+//-----------------------------------------------------------------------------
+
+// The start or continue packet of a SYSEX has been dropped from RxPending : drop the next packets of the
+// message (same group and MT 3 / MT 5 set) still kept there, and the ones to come if its end is not there yet
+static void DropPendingSysEx (TNetUMPSession* Session, uint32_t Word0)
+{
+    unsigned int Set=((Word0>>28)==0x05) ? 1 : 0;
+    unsigned int Group=(Word0>>24)&0x0F;
+    unsigned int Available=Session->RxPending.GetReadAvailable();
+    unsigned int Pos, Size, Status;
+    uint32_t Entry[5];
+    bool Ended=false;
+
+    // Only the network thread uses RxPending : each entry is consumed and pushed back unless dropped
+    for (Pos=0; Pos<Available; Pos+=Size)
+    {
+        Size=UMPWordCount[Session->RxPending.Peek(1)>>28]+1;
+        Session->RxPending.Read(0, &Entry[0], Size);
+        Session->RxPending.Consume(Size);
+
+        // Status 2 and 3 : continue and end packets. A complete or start packet begins the next message
+        Status=(Entry[1]>>20)&0x0F;
+        if ((!Ended)&&((Entry[1]>>28)==(Word0>>28))&&(((Entry[1]>>24)&0x0F)==Group)&&(Status<=3))
+        {
+            Ended=(Status!=2);
+            if (Status>=2)
+                continue;
+        }
+        Session->RxPending.Push(&Entry[0], Size);
+    }
+
+    Session->RxSysExQueued[Set]&=~(1<<Group);
+    if (!Ended)
+        Session->RxSysExDropped[Set]|=(1<<Group);
+}  // DropPendingSysEx
+//-----------------------------------------------------------------------------
+
+// Keep a message UMP2JACK has no room for, until FlushRxStaging() can push it. Returns false if dropped
+static bool KeepRxMessage (TNetUMPSession* Session, const uint32_t* Entry, unsigned int Size)
+{
+    unsigned int Set=((Entry[1]>>28)==0x05) ? 1 : 0;
+    uint16_t GroupBit=1<<((Entry[1]>>24)&0x0F);
+    uint32_t Word0;
+    unsigned int Part;
+
+    // Drop oldest : the oldest kept messages make room for the new one. A SYSEX is dropped as a whole
+    while ((FIFOPolicy==FIFO_DROP_OLDEST)&&(Session->RxPending.GetFreeSpace()<Size))
+    {
+        Word0=Session->RxPending.Peek(1);
+        Session->RxPending.Consume(UMPWordCount[Word0>>28]+1);
+        StatAdd(Session->Stats->Drops[DROP_RX_FIFO_FULL], 1);
+
+        Part=GetFIFOSysExPart(Word0);
+        if ((Part==FIFO_SYSEX_START)||(Part==FIFO_SYSEX_CONTINUE))
+            DropPendingSysEx(Session, Word0);
+    }
+
+    // The new packet may belong to the SYSEX just dropped (already counted)
+    Part=GetFIFOSysExPart(Entry[1]);
+    if (((Part==FIFO_SYSEX_CONTINUE)||(Part==FIFO_SYSEX_END))&&(Session->RxSysExDropped[Set]&GroupBit))
+    {
+        if (Part==FIFO_SYSEX_END)
+            Session->RxSysExDropped[Set]&=~GroupBit;
+        return false;
+    }
+
+    if (Session->RxPending.Push(Entry, Size))
+        return true;
+    StatAdd(Session->Stats->Drops[DROP_RX_FIFO_FULL], 1);
+    return false;
+}  // KeepRxMessage
+//-----------------------------------------------------------------------------
+
+// Replace the value of a staged update of the same controller (same message type) by the new one.
+// The staged message keeps its position and playout frame. Returns false if there is none
+static bool CollapseRxMessage (TNetUMPSession* Session, const uint32_t* Entry, unsigned int Size)
+{
+    uint32_t Key, StagedKey;
+    unsigned int Found=RX_STAGING_SIZE;
+
+    GetCoalesceKey(Entry[1], &Key);
+    for (unsigned int Pos=0; Pos<Session->RxStagingLen; Pos+=UMPWordCount[Session->RxStaging[Pos+1]>>28]+1)
+    {
+        if ((Session->RxStaging[Pos+1]>>28)!=(Entry[1]>>28)) continue;
+        if (!IsCoalesceCandidate(Session->RxStaging[Pos+1])) continue;
+        if ((GetCoalesceKey(Session->RxStaging[Pos+1], &StagedKey))&&(StagedKey==Key))
+            Found=Pos;
+    }
+    if (Found==RX_STAGING_SIZE)
+        return false;
+
+    memcpy(&Session->RxStaging[Found+1], &Entry[1], (Size-1)*sizeof(uint32_t));
+    return true;
+}  // CollapseRxMessage
+//-----------------------------------------------------------------------------
+
+// Stage a message (FIFO header and UMP words) for the FIFO, or apply the overflow policy if there is no room
+// Returns false if the message is dropped
+static bool StageRxMessage (TNetUMPSession* Session, const uint32_t* Entry, unsigned int Size, unsigned int Class, bool MustKeep)
+{
+    unsigned int Reserve=0;
+
+    if (Session->RxStagingLen+Size>RX_STAGING_SIZE)
+        FlushRxStaging(Session);
+
+    if (FIFOPolicy==FIFO_PRIORITY)
+        Reserve=GetFIFOReserve(Class, Session->UMP2JACK.GetSize());
+
+    // Free space can only grow until we push, so the flush can not fail. Kept messages go first, to stay in order
+    if ((Session->RxPending.GetReadAvailable()==0)&&(Session->RxStagingLen+Size+Reserve<=Session->UMP2JACK.GetFreeSpace()))
+    {
+        memcpy(&Session->RxStaging[Session->RxStagingLen], Entry, Size*sizeof(uint32_t));
+        Session->RxStagingLen+=Size;
+        return true;
+    }
+
+    if ((MustKeep)||(FIFOPolicy==FIFO_DROP_OLDEST)||((FIFOPolicy==FIFO_PRIORITY)&&(Class==FIFO_MSG_CRITICAL)))
+        return KeepRxMessage(Session, Entry, Size);
+
+    if ((Class==FIFO_MSG_COLLAPSIBLE)&&(CollapseRxMessage(Session, Entry, Size)))
+    {
+        StatAdd(Session->Stats->RxCollapsed, 1);
+        return true;
+    }
+    StatAdd(Session->Stats->Drops[DROP_RX_FIFO_FULL], 1);
+    return false;
+}  // StageRxMessage
+//-----------------------------------------------------------------------------
+
+// Queue a message received from the network. SYSEX split over several packets is queued or dropped as
+// a whole, per group : a start packet decides for the continue and end packets of the same message
+static void QueueRxMessage (TNetUMPSession* Session, const uint32_t* Entry, unsigned int Size)
+{
+    unsigned int Class=FIFO_MSG_NORMAL;
+    unsigned int Part=GetFIFOSysExPart(Entry[1]);
+    unsigned int Set=((Entry[1]>>28)==0x05) ? 1 : 0;
+    uint16_t GroupBit=1<<((Entry[1]>>24)&0x0F);
+    bool InProgress=false;
+    bool Queued;
+
+    if (FIFOPolicy==FIFO_PRIORITY)
+        Class=GetFIFOMessageClass(Entry[1], (Size>2) ? Entry[2] : 0);
+
+    if ((Part==FIFO_SYSEX_CONTINUE)||(Part==FIFO_SYSEX_END))
+    {
+        if (Session->RxSysExDropped[Set]&GroupBit)
+        {
+            if (Part==FIFO_SYSEX_END)
+                Session->RxSysExDropped[Set]&=~GroupBit;
+            StatAdd(Session->Stats->Drops[DROP_RX_FIFO_FULL], 1);
+            return;
+        }
+        InProgress=(Session->RxSysExQueued[Set]&GroupBit)!=0;
+        if (InProgress)
+            Class=FIFO_MSG_CRITICAL;
+        if (Part==FIFO_SYSEX_END)
+            Session->RxSysExQueued[Set]&=~GroupBit;
+    }
+
+    Queued=StageRxMessage(Session, Entry, Size, Class, InProgress);
+
+    if (Part==FIFO_SYSEX_START)
+    {
+        if (Queued)
+        {
+            Session->RxSysExQueued[Set]|=GroupBit;
+            Session->RxSysExDropped[Set]&=~GroupBit;
+        }
+        else
+        {
+            Session->RxSysExDropped[Set]|=GroupBit;
+            Session->RxSysExQueued[Set]&=~GroupBit;
+        }
+    }
+}  // QueueRxMessage
+//-----------------------------------------------------------------------------
+
+// Function called when the UMP engine receives a valid UMP message
+// Messages are collected in a staging buffer, with the JACK frame they must be played at,
+// and committed to the FIFO by FlushRxStaging() once the received packet is processed
+void NetUMPCallback (void* UserInstance, uint32_t* DataBlock)
+{
+    TNetUMPSession* Session = (TNetUMPSession*)UserInstance;
+    unsigned int MTSize;
+    uint32_t Entry[5];
+    uint32_t PortMask;
+    uint8_t JR;
+
+    MTSize = UMPWordCount[DataBlock[0]>>28];
+    RecordUMP(RECORD_RX, Session->Index, DataBlock, MTSize);
+    StatAdd(Session->Stats->RxMessages[DataBlock[0]>>28], 1);
+    StatAdd(Session->Stats->RxBytes, MTSize*sizeof(uint32_t));
+
+    // Process Endpoint related UMP messages
+    if ((DataBlock[0]&0xFFFF0000)==0xF0000000)
+    {
+        ProcessEndpointDiscovery(Session->Handler, DataBlock[1], Session->Protocol.load(), Session->JR.load(),
+                                 GetmDNSProductInstanceID(Session->Index));
+        return;     // Do not transmit this message to Jack
+    }
+
+    if ((DataBlock[0]&0xFFFF0000)==0xF0100000)
+    {
+        ProcessFunctionBlockDiscovery(Session->Handler, (DataBlock[0]>>8)&0xFF, DataBlock[0]&0xFF);
+        return;
+    }
+
+    if ((DataBlock[0]&0xFFFF0000)==0xF0050000)
+    {
+        Session->Protocol.store(ProcessStreamConfigRequest(Session->Handler, DataBlock[0], &JR));
+        Session->JR.store(JR);
+        Session->Stats->Protocol.store(Session->Protocol.load(), std::memory_order_relaxed);
+        return;
+    }
+
+    if (IsLatencyProbe(DataBlock[0]))
+    {
+        // Reflector sends the probe back at once, without going through JACK
+        if (IsLatencyReflectorEnabled())
+        {
+            Session->Handler->SendUMPMessage(DataBlock);
+            return;
+        }
+        if (IsLatencyMeasureEnabled())
+            LatencyProbeReceived(DataBlock[0], jack_get_time());
+    }
+
+    // JR Timestamps give the sender time of the next messages, they are not sent to JACK
+    if ((AdaptiveJitter)&&((DataBlock[0]&0xF0FF0000)==0x00200000))
+    {
+        JitterBufferTimestamp(&Session->Jitter, DataBlock[0]&0xFFFF, jack_frame_time(client));
+        return;
+    }
+
+    if ((GetFECDepth()>0)&&(IsFECDuplicate(&Session->FECRx, DataBlock)))
+    {
+        StatAdd(Session->Stats->FECDuplicates, 1);
+        return;
+    }
+
+    // Routing table gives the remapped group/channel and the JACK ports the message goes to (none : filtered out)
+    Entry[1]=DataBlock[0];
+    PortMask=RouteMessage(ROUTE_IN, &Entry[1]);
+    if (PortMask==0)
+    {
+        StatAdd(Session->Stats->RxFiltered, 1);
+        return;
+    }
+
+    Entry[0]=(PortMask<<24)|(GetPlayoutFrame(&Session->Jitter, jack_frame_time(client), PeriodFrames.load(std::memory_order_relaxed))&FIFO_FRAME_MASK);
+    for (unsigned int i=1; i<MTSize; i++)
+        Entry[1+i]=DataBlock[i];
+    QueueRxMessage(Session, &Entry[0], MTSize+1);
+}  // NetUMPCallback
+//-----------------------------------------------------------------------------
+
+// The JACK buffer is full : the message stays in the FIFO for next period, unless even an empty buffer can not hold it
+static inline bool KeepForNextPeriod (TNetUMPSession* Session, void* PortBuffer)
+{
+    if (jack_midi_get_event_count(PortBuffer)>0)
+        return true;
+
+    StatAdd(Session->Stats->Drops[DROP_JACK_BUFFER_FULL], 1);
+    return false;
+}  // KeepForNextPeriod
+// ----------------------------------------------------
+
+// Position of a message in the period from its FIFO header (24-bit frame difference, sign extended)
+static inline int32_t GetFrameOffset (uint32_t Header, jack_nframes_t CycleStart)
+{
+    return ((int32_t)((Header-CycleStart)<<8))>>8;
+}  // GetFrameOffset
+// ----------------------------------------------------
+
+enum {
+    PORT_WRITE_DONE,            // Written (or dropped, when it can never fit)
+    PORT_WRITE_FULL,            // Nothing written, keep the message for next period
+    PORT_WRITE_PARTIAL          // Some MIDI 1.0 messages written, the others are pending
+};
+
+// Write a message to the JACK ports of PortMask, as one UMP event or as MIDI 1.0 messages
+static unsigned int WriteToPorts (TNetUMPSession* Session, void** PortBuffers, uint32_t PortMask, uint32_t Offset,
+                                  const uint8_t* Data, unsigned int Size, bool IsUMP, unsigned int* NumEvents)
+{
+    bool SinglePort=(PortMask&(PortMask-1))==0;
+    unsigned int Port;
+    unsigned int Written;
+
+    // A message sent to several ports is only written when all of them have room, so no port gets it twice
+    if (!SinglePort)
+    {
+        for (uint32_t Ports=PortMask; Ports!=0; Ports&=Ports-1)
+        {
+            Port=__builtin_ctz(Ports);
+            if (jack_midi_max_event_size(PortBuffers[Port])<Size)
+                return KeepForNextPeriod(Session, PortBuffers[Port]) ? PORT_WRITE_FULL : PORT_WRITE_DONE;
+        }
+    }
+
+    for (; PortMask!=0; PortMask&=PortMask-1)
+    {
+        Port=__builtin_ctz(PortMask);
+        if (IsUMP)
+        {
+            Written=0;
+            if (jack_midi_event_write(PortBuffers[Port], Offset, Data, Size)==0)
+            {
+                Written=Size;
+                (*NumEvents)++;
+            }
+        }
+        else
+            Written=WriteMIDI1Messages(PortBuffers[Port], Offset, Data, Size, NumEvents);
+
+        if (Written==Size)
+            continue;
+        if (!SinglePort)
+        {  // Room has been checked, only a MIDI 2.0 conversion into several messages can get here
+            StatAdd(Session->Stats->Drops[DROP_JACK_BUFFER_FULL], 1);
+            continue;
+        }
+        if (Written==0)
+            return KeepForNextPeriod(Session, PortBuffers[Port]) ? PORT_WRITE_FULL : PORT_WRITE_DONE;
+        KeepPendingMessages(&Session->Output, Port, &Data[Written], Size-Written);
+        return PORT_WRITE_PARTIAL;
+    }
+    return PORT_WRITE_DONE;
+}  // WriteToPorts
+// ----------------------------------------------------
+
+// Drop oldest policy : drop whole messages from the head of the FIFO, at least NumWords words
+// Check if a packet belongs to a SYSEX whose oldest packets have been dropped by DropOldestMessages()
+// The packets are skipped up to the end of the message, or up to the start of the next one of the group
+static bool SkipDroppedSysEx (TNetUMPSession* Session, uint32_t Word0)
+{
+    unsigned int MT=Word0>>28;
+    unsigned int Status=(Word0>>20)&0x0F;
+    unsigned int Set=(MT==0x05) ? 1 : 0;
+    uint16_t GroupBit=1<<((Word0>>24)&0x0F);
+
+    if (((MT!=0x03)&&(MT!=0x05))||(Status>3))
+        return false;
+    if ((Session->JackSysExSkip[Set]&GroupBit)==0)
+        return false;
+
+    if ((Status==0)||(Status==1))
+    {  // Complete or start packet : new message
+        Session->JackSysExSkip[Set]&=~GroupBit;
+        return false;
+    }
+    if (GetFIFOSysExPart(Word0)==FIFO_SYSEX_END)
+        Session->JackSysExSkip[Set]&=~GroupBit;
+    return true;
+}  // SkipDroppedSysEx
+// ----------------------------------------------------
+
+static void DropOldestMessages (TNetUMPSession* Session, unsigned int NumWords)
+{
+    unsigned int Available=Session->UMP2JACK.GetReadAvailable();
+    unsigned int ReadPos=0;
+    unsigned int Part;
+    uint32_t Word0;
+
+    while ((ReadPos<NumWords)&&(ReadPos<Available))
+    {
+        Word0=Session->UMP2JACK.Peek(ReadPos+1);
+        ReadPos+=UMPWordCount[Word0>>28]+1;
+        if (SkipDroppedSysEx(Session, Word0))
+            continue;       // Counted with the packet which started the drop
+        StatAdd(Session->Stats->Drops[DROP_RX_FIFO_OLDEST], 1);
+
+        // The rest of a SYSEX is skipped when read, wherever it is in the FIFO
+        Part=GetFIFOSysExPart(Word0);
+        if ((Part==FIFO_SYSEX_START)||(Part==FIFO_SYSEX_CONTINUE))
+            Session->JackSysExSkip[((Word0>>28)==0x05) ? 1 : 0]|=1<<((Word0>>24)&0x0F);
+    }
+    Session->UMP2JACK.Consume(ReadPos);
+}  // DropOldestMessages
+// ----------------------------------------------------
+
+// Generate JACK events from the messages received by the session
+static void ProcessNetToJack (TNetUMPSession* Session, jack_port_t* OutputPort, jack_nframes_t nframes, jack_nframes_t CycleStart)
+{
+    void* PortBuffers[ROUTE_MAX_PORTS];
+    unsigned int NumPorts=GetRoutePortCount();
+    unsigned int Available, ReadPos, MsgPos;
+    uint32_t UMPMsg[4];
+    uint8_t MIDIMsg[MIDI2_MAX_MIDI1_BYTES];
+    unsigned int MTSize;
+    uint8_t* EventData;
+    unsigned int EventSize;
+    unsigned int NumEvents=0;
+    uint32_t Header;
+    int32_t Offset;
+    jack_nframes_t LastOffset;
+
+    // Port 0 is the main port, others are declared in the routes file
+    PortBuffers[0]=jack_port_get_buffer(OutputPort, nframes);
+    for (unsigned int p=1; p<NumPorts; p++)
+        PortBuffers[p]=jack_port_get_buffer(Session->RoutePorts[p], nframes);
+    for (unsigned int p=0; p<NumPorts; p++)
+        jack_midi_clear_buffer(PortBuffers[p]);    // Recommended to call this at the beginning of process cycle
+
+    // The network thread keeps messages the FIFO had no room for (drop-oldest policy)
+    if (Session->UMP2JACKDropRequest.load(std::memory_order_relaxed)>0)
+        DropOldestMessages(Session, Session->UMP2JACKDropRequest.exchange(0, std::memory_order_relaxed));
+
+    // A SYSEX or the end of a MIDI 2.0 conversion which did not fit in previous period goes first, to keep messages in order
+    if (!Session->SysExRx.EmitReady(PortBuffers, 0))
+        return;
+    if (!WritePendingMessages(&Session->Output, PortBuffers[Session->Output.PendingPort], &NumEvents))
+    {
+        StatAdd(Session->Stats->JackEventsOut, NumEvents);
+        return;
+    }
+
+    // Check if we have UMP data waiting in the FIFO from NetUMP to be sent to JACK
+    Available=Session->UMP2JACK.GetReadAvailable();
+    if (Available==0)
+    {
+        StatAdd(Session->Stats->JackEventsOut, NumEvents);
+        return;
+    }
+    StatMax(Session->Stats->UMP2JACKHighWater, Available);
+
+    // First pass : find the last update of each controller among the messages due in this period
+    BeginOutputPeriod(&Session->Output);
+    for (ReadPos=0; ReadPos<Available; ReadPos+=MTSize+1)
+    {
+        if (GetFrameOffset(Session->UMP2JACK.Peek(ReadPos), CycleStart)>=(int32_t)nframes)
+            break;
+        UMPMsg[0]=Session->UMP2JACK.Peek(ReadPos+1);
+        MTSize = UMPWordCount[UMPMsg[0]>>28];
+        if (IsCoalesceCandidate(UMPMsg[0]))
+            RecordOutputMessage(&Session->Output, UMPMsg[0], ReadPos);
+    }
+
+    // Read FIFO and generate JACK events for each MIDI message in the FIFO
+    ReadPos=0;
+    LastOffset=0;
+
+    while (ReadPos<Available)
+    {
+        // Playout frame has been set by the jitter buffer on reception. Messages due later stay in the FIFO
+        Header=Session->UMP2JACK.Peek(ReadPos);
+        Offset=GetFrameOffset(Header, CycleStart);
+        if (Offset>=(int32_t)nframes)
+            break;
+
+        // Late messages are played immediately, and JACK events must be in time order
+        if (Offset<(int32_t)LastOffset)
+            Offset=LastOffset;
+        LastOffset=Offset;
+
+        // Identify message length from first word
+        MsgPos=ReadPos;
+        MTSize = UMPWordCount[Session->UMP2JACK.Peek(ReadPos+1)>>28];
+        Session->UMP2JACK.Read(ReadPos+1, &UMPMsg[0], MTSize);
+        ReadPos+=MTSize+1;
+
+        // Controller value replaced later in the same period (last value wins)
+        if (IsOutputSuperseded(&Session->Output, MsgPos))
+        {
+            StatAdd(Session->Stats->Coalesced, 1);
+            continue;
+        }
+
+        // Rest of a SYSEX whose beginning has been dropped (drop-oldest)
+        if (SkipDroppedSysEx(Session, UMPMsg[0]))
+            continue;
+
+        // Our own latency probes come back : the event would be played at Offset in next period
+        if ((IsLatencyMeasureEnabled())&&(IsLatencyProbe(UMPMsg[0])))
+        {
+            LatencyProbePlayed(UMPMsg[0], jack_get_time(), jack_frames_to_time(client, CycleStart+nframes+Offset));
+            continue;
+        }
+
+        if (UMPPorts)
+        {  // UMP ports get the messages as they are
+            EventData=(uint8_t*)&UMPMsg[0];
+            EventSize=MTSize*sizeof(uint32_t);
+        }
+        else
+        {
+            // SYSEX packets are reassembled and sent to the ports of the route as one event when complete
+            if (((UMPMsg[0]>>28)==0x03)||((UMPMsg[0]>>28)==0x05))
+            {
+                if (Session->SysExRx.AddPacket(&UMPMsg[0], Header>>24))
+                {
+                    if (!Session->SysExRx.EmitReady(PortBuffers, Offset))
+                        break;      // JACK buffer is full, continue in next period
+                }
+                continue;
+            }
+
+            // MIDI 2.0 Channel Voice may give several MIDI 1.0 messages (Bank Select, RPN...)
+            if ((UMPMsg[0]>>28)==0x04)
+                EventSize = TranscodeMIDI2_MIDI1 (&UMPMsg[0], &MIDIMsg[0]);
+            else
+                EventSize = TranscodeUMPMessage_MIDI1 (&UMPMsg[0], &MIDIMsg[0]);
+
+            if (EventSize==0)
+            {
+                if (((UMPMsg[0]>>28)==0x01)||((UMPMsg[0]>>28)==0x02)||((UMPMsg[0]>>28)==0x04))
+                    StatAdd(Session->Stats->TranscodeFailures, 1);
+                continue;
+            }
+            EventData=&MIDIMsg[0];
+        }
+
+        switch (WriteToPorts(Session, PortBuffers, Header>>24, Offset, EventData, EventSize, UMPPorts, &NumEvents))
+        {
+            case PORT_WRITE_FULL :      // The message stays in the FIFO for next period
+                ReadPos=MsgPos;
+                break;
+            case PORT_WRITE_PARTIAL :   // The rest of the message is written first in next period
+                break;
+            default :
+                continue;
+        }
+        break;
+    }  // loop over all events in the queue
+
+    if ((ReadPos<Available)&&(GetFrameOffset(Session->UMP2JACK.Peek(ReadPos), CycleStart)<(int32_t)nframes))
+        StatAdd(Session->Stats->Deferred, 1);
+    StatAdd(Session->Stats->JackEventsOut, NumEvents);
+
+    // Release the space only when we have parsed the messages
+    Session->UMP2JACK.Consume(ReadPos);
+}  // ProcessNetToJack
+// ----------------------------------------------------
+
+// Queue a batch for the network thread, once filtered and remapped by the routing table.
+// A batch which does not fit is dropped as a whole. A SYSEX from JACK with packets in the dropped batch
+// is dropped up to its end, so the peer never gets a Continue or End packet without its Start
+static void PushTxBatch (TNetUMPSession* Session, TSysExTxState* SysExTx, uint32_t* TxBatch, unsigned int TxBatchLen)
+{
+    unsigned int Pos, Kept=0;
+    unsigned int MTSize;
+
+    for (Pos=0; Pos<TxBatchLen; Pos+=MTSize)
+    {
+        MTSize=UMPWordCount[TxBatch[Pos]>>28];
+        if (RouteMessage(ROUTE_OUT, &TxBatch[Pos])==0)
+        {
+            StatAdd(Session->Stats->TxFiltered, 1);
+            continue;
+        }
+        RecordUMP(RECORD_TX, Session->Index, &TxBatch[Pos], MTSize);
+        if (Kept!=Pos)
+            memmove(&TxBatch[Kept], &TxBatch[Pos], MTSize*sizeof(uint32_t));
+        Kept+=MTSize;
+    }
+    TxBatchLen=Kept;
+
+    if (Session->JACK2NET.Push(TxBatch, TxBatchLen))
+        return;
+
+    // A SYSEX is one dropped message : counted on its last packet, or below if it is still in progress
+    for (unsigned int Pos=0; Pos<TxBatchLen; Pos+=UMPWordCount[TxBatch[Pos]>>28])
+    {
+        unsigned int Part=GetFIFOSysExPart(TxBatch[Pos]);
+        if ((Part==FIFO_SYSEX_NONE)||(Part==FIFO_SYSEX_END))
+            StatAdd(Session->Stats->Drops[DROP_TX_FIFO_FULL], 1);
+    }
+
+    if ((SysExTx)&&(SysExTx->InProgress)&&(!SysExTx->Dropped))
+    {
+        SysExTx->Dropped=true;
+        StatAdd(Session->Stats->Drops[DROP_TX_FIFO_FULL], 1);
+    }
+}  // PushTxBatch
+// ----------------------------------------------------
+
+// Add a message to the batch of the period, the batch is pushed to the FIFO when full
+static void AddToTxBatch (TNetUMPSession* Session, TSysExTxState* SysExTx, uint32_t* TxBatch, unsigned int* TxBatchLen,
+                          const uint32_t* Words, unsigned int NumWords)
+{
+    if (*TxBatchLen+NumWords>TX_BATCH_SIZE)
+    {
+        PushTxBatch(Session, SysExTx, &TxBatch[0], *TxBatchLen);
+        *TxBatchLen=0;
+    }
+    memcpy(&TxBatch[*TxBatchLen], Words, NumWords*sizeof(uint32_t));
+    *TxBatchLen+=NumWords;
+}  // AddToTxBatch
+// ----------------------------------------------------
+
+// Queue the events sent by JACK to the session. MIDI 1.0 events are sent on Group (Function Block input ports)
+// Returns true if something has been queued
+static bool ProcessJackToNet (TNetUMPSession* Session, jack_port_t* InputPort, TSysExTxState* SysExTx, uint8_t Group,
+                              jack_nframes_t nframes, jack_nframes_t CycleStart)
+{
+    void* in_port_buf = jack_port_get_buffer(InputPort, nframes);
+    jack_midi_event_t in_event;
+    jack_nframes_t event_count;
+    size_t NumBytesInEvent;
+    size_t SysExPos;
+    uint32_t UMPMsg[4];
+    uint32_t MIDI2Msg[2];
+    unsigned int MTSize;
+    uint32_t TxBatch[TX_BATCH_SIZE];
+    unsigned int TxBatchLen=0;
+    uint32_t Timestamp;
+    jack_nframes_t LastEventTime=(jack_nframes_t)-1;
+    bool SendJR=(Session->JR.load(std::memory_order_relaxed)&UMP_JR_TX)!=0;
+
+    // Generate NetUMP payload for each event sent by JACK
+    if (in_port_buf)
+        event_count = jack_midi_get_event_count(in_port_buf);
+    else
+        event_count = 0;
+
+    if (event_count==0)
+        return false;
+    StatAdd(Session->Stats->JackEventsIn, event_count);
+
+    for(unsigned int i=0; i<event_count; i++)
+    {
+        jack_midi_event_get(&in_event, in_port_buf, i);
+        NumBytesInEvent=in_event.size;
+
+        // The peer jitter buffer uses JR Timestamps to play messages with the same spacing (32 us units)
+        if ((SendJR)&&(in_event.time!=LastEventTime))
+        {
+            Timestamp=0x00200000|((jack_frames_to_time(client, CycleStart+in_event.time)/32)&0xFFFF);
+            AddToTxBatch(Session, SysExTx, TxBatch, &TxBatchLen, &Timestamp, 1);
+            LastEventTime=in_event.time;
+        }
+
+        // UMP ports events are complete UMP messages
+        if (UMPPorts)
+        {
+            for (size_t Pos=0; Pos+sizeof(uint32_t)<=NumBytesInEvent; Pos+=MTSize*sizeof(uint32_t))
+            {
+                memcpy(&UMPMsg[0], &in_event.buffer[Pos], sizeof(uint32_t));
+                MTSize = UMPWordCount[UMPMsg[0]>>28];
+                if (Pos+MTSize*sizeof(uint32_t)>NumBytesInEvent)
+                    break;
+                memcpy(&UMPMsg[0], &in_event.buffer[Pos], MTSize*sizeof(uint32_t));
+                AddToTxBatch(Session, SysExTx, TxBatch, &TxBatchLen, &UMPMsg[0], MTSize);
+            }
+            continue;
+        }
+
+        // SYSEX of any length are segmented into as many MT 3 packets as needed
+        if (IsSysExEvent(SysExTx, &in_event.buffer[0], NumBytesInEvent))
+        {
+            SysExPos=0;
+            while (SysExPos<NumBytesInEvent)
+            {
+                TxBatchLen+=SegmentSysEx(SysExTx, Group, &in_event.buffer[0], NumBytesInEvent, &SysExPos,
+                                         &TxBatch[TxBatchLen], TX_BATCH_SIZE-TxBatchLen);
+                if (SysExPos<NumBytesInEvent)
+                {  // Batch is full
+                    PushTxBatch(Session, SysExTx, &TxBatch[0], TxBatchLen);
+                    TxBatchLen=0;
+                }
+            }
+            continue;
+        }
+
+        if (TranscodeMIDI1Message_UMP (&in_event.buffer[0], NumBytesInEvent, Group, &UMPMsg[0]))
+        {
+            // Peer has selected MIDI 2.0 Protocol : send Channel Voice messages as MT 4
+            if ((Session->Protocol.load(std::memory_order_relaxed)==UMP_PROTOCOL_MIDI2)&&(UpgradeMIDI1_MIDI2(&UMPMsg[0], &MIDI2Msg[0])))
+            {
+                AddToTxBatch(Session, SysExTx, TxBatch, &TxBatchLen, &MIDI2Msg[0], 2);
+                continue;
+            }
+
+            MTSize = UMPWordCount[UMPMsg[0]>>28];
+            AddToTxBatch(Session, SysExTx, TxBatch, &TxBatchLen, &UMPMsg[0], MTSize);
+        }
+        else
+        {
+            StatAdd(Session->Stats->TranscodeFailures, 1);
+        }
+    }
+
+    // Queue all messages of the period at once (dropped if the network thread is late)
+    if (TxBatchLen>0)
+        PushTxBatch(Session, SysExTx, &TxBatch[0], TxBatchLen);
+
+    return true;
+}  // ProcessJackToNet
+// ----------------------------------------------------
+
+// CLOCK_MONOTONIC in ns, for the time spent in the process callback (vDSO call, no syscall)
+static inline uint64_t GetProcessClockNs (void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (uint64_t)Now.tv_sec*1000000000+Now.tv_nsec;
+}  // GetProcessClockNs
+// ----------------------------------------------------
+
+// Callback function called when there is an audio block to process
+int jack_process(jack_nframes_t nframes, void *arg)
+{
+    uint64_t StartNs=GetProcessClockNs();
+    TNetUMPSession* Session;
+    jack_port_t* InputPort;
+    jack_port_t* OutputPort;
+    jack_nframes_t CycleStart;
+    uint32_t Probe;
+    bool Queued=false;
+
+    RTSafeEnterCallback();
+    CycleStart=jack_last_frame_time(client);
+
+    for (unsigned int s=0; s<NumSessions; s++)
+    {
+        Session=&Sessions[s];
+
+        // Ports are registered when the first peer connects to the session
+        OutputPort=Session->OutputPort.load(std::memory_order_acquire);
+        InputPort=Session->InputPort.load(std::memory_order_acquire);
+        if ((OutputPort==0)||(InputPort==0))
+            continue;
+
+        ProcessNetToJack(Session, OutputPort, nframes, CycleStart);
+        if (ProcessJackToNet(Session, InputPort, &Session->SysExTx, 0, nframes, CycleStart))
+            Queued=true;
+        for (unsigned int b=0; b<GetFunctionBlockCount(); b++)
+        {
+            if (ProcessJackToNet(Session, Session->BlockInputPorts[b], &Session->BlockSysExTx[b], GetFunctionBlock(b)->FirstGroup, nframes, CycleStart))
+                Queued=true;
+        }
+    }
+
+    // Latency probes leave through the first session, like messages from its JACK input
+    if ((IsLatencyMeasureEnabled())&&(Sessions[0].Connected.load(std::memory_order_relaxed)))
+    {
+        if (MakeLatencyProbe(jack_get_time(), &Probe))
+        {
+            if (Sessions[0].JACK2NET.Push(&Probe, 1))
+                Queued=true;
+        }
+    }
+
+    // Let the network thread send them now rather than on its next timer tick (eventfd write only if it sleeps)
+    if (Queued)
+        KickEventLoop();
+
+    StatsProcessTime(GetProcessClockNs()-StartNs);
+    RTSafeLeaveCallback();
+    return 0;
+}  // jack_process
+// ----------------------------------------------------
+
+int jack_xrun(void *arg)
+{
+    StatsXrun();
+    return 0;
+}  // jack_xrun
+// ----------------------------------------------------
+
+int jack_buffer_size(jack_nframes_t nframes, void *arg)
+{
+    PeriodFrames.store(nframes, std::memory_order_relaxed);
+    return 0;
+}  // jack_buffer_size
+// ----------------------------------------------------
+
+/* Callback function called when jack server is shut down */
+void jack_shutdown(void *arg)
+{
+    printf ("JACK has shut down\n");
+    break_request=true;
+    WakeEventLoop();
+}  // jack_shutdown
+// ----------------------------------------------------
+
+void sig_handler (int signo)
+{
+    if (signo == SIGINT)
+    {
+        break_request=true;
+        WakeEventLoop();
+    }
+}  // sig_handler
+// ----------------------------------------------------
+
+static bool RegisterSessionPorts (TNetUMPSession* Session)
+{
+    char InName[32];
+    char OutName[32];
+    char RouteName[48];
+    jack_port_t* InputPort;
+    jack_port_t* OutputPort;
+    unsigned long PortFlags;
+
+    if (Session->OutputPort.load(std::memory_order_relaxed)!=0)
+        return true;        // Ports are kept registered after a disconnection
+
+    // First session keeps the historical port names
+    if (Session->Index==0)
+    {
+        strcpy(InName, "netump_in");
+        strcpy(OutName, "netump_out");
+    }
+    else
+    {
+        snprintf(InName, sizeof(InName), "netump_in_%u", Session->Index+1);
+        snprintf(OutName, sizeof(OutName), "netump_out_%u", Session->Index+1);
+    }
+
+    if (UMPPorts)
+        PortFlags=JACK_PORT_IS_MIDI2;
+    else
+        PortFlags=0;
+
+    InputPort = jack_port_register (client, InName, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput|PortFlags, 0);
+    OutputPort = jack_port_register (client, OutName, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput|PortFlags, 0);
+    if ((InputPort==0)||(OutputPort==0))
+    {
+        fprintf (stderr, "jacknetumpd : can not register JACK ports for session %u\n", Session->Index+1);
+        if (InputPort) jack_port_unregister(client, InputPort);
+        if (OutputPort) jack_port_unregister(client, OutputPort);
+        return false;
+    }
+
+    // Extra output ports of the routes file, registered before the session ports are published to the JACK thread
+    for (unsigned int p=1; p<GetRoutePortCount(); p++)
+    {
+        snprintf(RouteName, sizeof(RouteName), "%s_%s", OutName, GetRoutePortName(p));
+        Session->RoutePorts[p] = jack_port_register (client, RouteName, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput|PortFlags, 0);
+        if (Session->RoutePorts[p]==0)
+        {
+            fprintf (stderr, "jacknetumpd : can not register JACK port %s\n", RouteName);
+            while (--p>0)
+                jack_port_unregister(client, Session->RoutePorts[p]);
+            jack_port_unregister(client, InputPort);
+            jack_port_unregister(client, OutputPort);
+            return false;
+        }
+    }
+
+    // Function Block inputs are named after the output port of the block
+    for (unsigned int b=0; b<GetFunctionBlockCount(); b++)
+    {
+        snprintf(RouteName, sizeof(RouteName), "%s_%s", InName, GetRoutePortName(BlockPorts[b]));
+        Session->BlockInputPorts[b] = jack_port_register (client, RouteName, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput|PortFlags, 0);
+        if (Session->BlockInputPorts[b]==0)
+        {
+            fprintf (stderr, "jacknetumpd : can not register JACK port %s\n", RouteName);
+            while (b-->0)
+                jack_port_unregister(client, Session->BlockInputPorts[b]);
+            for (unsigned int p=1; p<GetRoutePortCount(); p++)
+                jack_port_unregister(client, Session->RoutePorts[p]);
+            jack_port_unregister(client, InputPort);
+            jack_port_unregister(client, OutputPort);
+            return false;
+        }
+    }
+
+    Session->InputPort.store(InputPort, std::memory_order_release);
+    Session->OutputPort.store(OutputPort, std::memory_order_release);
+    return true;
+}  // RegisterSessionPorts
+// ----------------------------------------------------
+
+static void SessionConnected (TNetUMPSession* Session, const char* EndpointName)
+{
+    fprintf (stdout, "jacknetumpd : session %u connected to '%s'.\n", Session->Index+1, EndpointName);
+    Session->Protocol.store(UMP_PROTOCOL_MIDI1);        // Until the peer requests another protocol
+    Session->JR.store(0);                               // Until the peer requests JR Timestamps
+    Session->Connected.store(true);
+    Session->Stats->Protocol.store(UMP_PROTOCOL_MIDI1, std::memory_order_relaxed);
+    Session->Stats->Connected.store(true, std::memory_order_relaxed);
+    InitFECTx(&Session->FECTx);
+    InitFECRx(&Session->FECRx);
+    InitJitterBuffer(&Session->Jitter, SampleRate, JitterBufferFrames, AdaptiveJitter);     // New peer clock
+
+    if (!RegisterSessionPorts(Session))
+        return;
+
+    jack_set_property(client, jack_port_uuid(Session->OutputPort.load()), "UMPEndpointName", EndpointName, "text/plain");
+    jack_set_property(client, jack_port_uuid(Session->InputPort.load()), "UMPEndpointName", EndpointName, "text/plain");
+    for (unsigned int p=1; p<GetRoutePortCount(); p++)
+        jack_set_property(client, jack_port_uuid(Session->RoutePorts[p]), "UMPEndpointName", EndpointName, "text/plain");
+    for (unsigned int b=0; b<GetFunctionBlockCount(); b++)
+        jack_set_property(client, jack_port_uuid(Session->BlockInputPorts[b]), "UMPEndpointName", EndpointName, "text/plain");
+}  // SessionConnected
+// ----------------------------------------------------
+
+static void SessionDisconnected (TNetUMPSession* Session)
+{
+    fprintf (stdout, "jacknetumpd : session %u disconnected\n", Session->Index+1);
+    Session->Connected.store(false);
+    Session->Stats->Connected.store(false, std::memory_order_relaxed);
+
+    if (Session->OutputPort.load()==0)
+        return;
+
+    jack_remove_property(client, jack_port_uuid(Session->OutputPort.load()), "UMPEndpointName");
+    jack_remove_property(client, jack_port_uuid(Session->InputPort.load()), "UMPEndpointName");
+    for (unsigned int p=1; p<GetRoutePortCount(); p++)
+        jack_remove_property(client, jack_port_uuid(Session->RoutePorts[p]), "UMPEndpointName");
+    for (unsigned int b=0; b<GetFunctionBlockCount(); b++)
+        jack_remove_property(client, jack_port_uuid(Session->BlockInputPorts[b]), "UMPEndpointName");
+}  // SessionDisconnected
+// ----------------------------------------------------
+
+// NetUMP connection callbacks do not carry a user instance : generate one per session slot
+template <unsigned int Slot> static void OnSessionConnected (const char* EndpointName, unsigned int size)
+{
+    SessionConnected(&Sessions[Slot], EndpointName);
+}
+
+template <unsigned int Slot> static void OnSessionDisconnected (void)
+{
+    SessionDisconnected(&Sessions[Slot]);
+}
+
+typedef void (*TConnectedCallback) (const char* EndpointName, unsigned int size);
+typedef void (*TDisconnectedCallback) (void);
+
+static const TConnectedCallback ConnectedCallbacks [MAX_SESSIONS] = {
+    &OnSessionConnected<0>, &OnSessionConnected<1>, &OnSessionConnected<2>, &OnSessionConnected<3>,
+    &OnSessionConnected<4>, &OnSessionConnected<5>, &OnSessionConnected<6>, &OnSessionConnected<7>
+};
+
+static const TDisconnectedCallback DisconnectedCallbacks [MAX_SESSIONS] = {
+    &OnSessionDisconnected<0>, &OnSessionDisconnected<1>, &OnSessionDisconnected<2>, &OnSessionDisconnected<3>,
+    &OnSessionDisconnected<4>, &OnSessionDisconnected<5>, &OnSessionDisconnected<6>, &OnSessionDisconnected<7>
+};
+// ----------------------------------------------------
+
+// The NetUMP library expects RunSession() to be called every millisecond and counts its timers in calls, so
+// each call is a tick of the library clock. Packets are read and sent at once with ticks taken ahead of the
+// elapsed time, as long as the library clock stays within MAX_SESSION_LEAD_TICKS of it
+static bool CanRunSessionTick (const TNetUMPSession* Session)
+{
+    return Session->TicksDone<GetMonotonicMs()-SessionStartMs+MAX_SESSION_LEAD_TICKS;
+}  // CanRunSessionTick
+// ----------------------------------------------------
+
+// No tick left : the socket is read and JACK2NET is flushed again after the next millisecond boundary
+static void WaitSessionBudget (void)
+{
+    ArmEventTimer(SessionBudgetTimer, SESSION_BUDGET_WAIT_MS);
+}  // WaitSessionBudget
+// ----------------------------------------------------
+
+// The only place RunSession() is called : it reads one datagram and sends the messages given to the handler
+static void RunSessionTick (TNetUMPSession* Session)
+{
+    Session->Handler->RunSession();
+    Session->TicksDone++;
+    FlushRxStaging(Session);
+    JitterBufferEndOfPacket(&Session->Jitter);      // Timestamps do not apply to next packet
+}  // RunSessionTick
+// ----------------------------------------------------
+
+// Send again the protected messages sent in previous bursts. Returns the number of words sent
+static unsigned int SendFECCopies (TNetUMPSession* Session)
+{
+    uint32_t Copies[FEC_QUEUE_SIZE*2];
+    unsigned int NumWords;
+    unsigned int MTSize;
+
+    if (Session->FECTx.Count==0) return 0;
+
+    NumWords=GetFECCopies(&Session->FECTx, &Copies[0], FEC_QUEUE_SIZE*2);
+    for (unsigned int Pos=0; Pos<NumWords; Pos+=MTSize)
+    {
+        MTSize=UMPWordCount[Copies[Pos]>>28];
+        Session->Handler->SendUMPMessage(&Copies[Pos]);
+        StatAdd(Session->Stats->FECCopies, 1);
+    }
+    return NumWords;
+}  // SendFECCopies
+// ----------------------------------------------------
+
+// Hand the messages queued by jack_process to the NetUMP handler, in bursts followed by a
+// single RunSession() so they can leave in as few packets as possible. Bursts which can not get
+// a tick stay in JACK2NET until the next millisecond
+static void FlushJackToNet (TNetUMPSession* Session)
+{
+    unsigned int Available;
+    unsigned int ReadPos;
+    unsigned int BurstWords;
+    unsigned int MTSize;
+    uint32_t UMPMsg[4];
+
+    Available=Session->JACK2NET.GetReadAvailable();
+    if (Available==0) return;
+    StatMax(Session->Stats->JACK2NETHighWater, Available);
+    if (!CanRunSessionTick(Session))
+    {
+        WaitSessionBudget();
+        return;
+    }
 
-#include <jack/jack.h>
-#include <jack/midiport.h>
-#include <jack/metadata.h>
+    RTSafeAssert("SendUMPMessage");
+    ReadPos=0;
 
-#include "SystemSleep.h"
-#include "NetUMP.h"
-#include "UMP_Transcoder.h"
-#include "Endpoint.h"
-#include "UMP_mDNS.h"
+    // Copies of the previous protected messages leave in the same packet as the new messages
+    BurstWords=SendFECCopies(Session);
+    Session->LastFECMs=GetMonotonicMs();
+    while (ReadPos<Available)
+    {
+        MTSize = UMPWordCount[Session->JACK2NET.Peek(ReadPos)>>28];
+        Session->JACK2NET.Read(ReadPos, &UMPMsg[0], MTSize);
+        ReadPos+=MTSize;
+
+        if ((IsLatencyMeasureEnabled())&&(IsLatencyProbe(UMPMsg[0])))
+            LatencyProbeSent(UMPMsg[0], jack_get_time());
+
+        Session->Handler->SendUMPMessage(&UMPMsg[0]);
+        AddFECMessage(&Session->FECTx, &UMPMsg[0]);
+        StatAdd(Session->Stats->TxMessages[UMPMsg[0]>>28], 1);
+        StatAdd(Session->Stats->TxBytes, MTSize*sizeof(uint32_t));
+        BurstWords+=MTSize;
+        if (BurstWords>=MAX_TX_WORDS_PER_RUN)
+        {
+            RunSessionTick(Session);
+            StatAdd(Session->Stats->TxPackets, 1);
+            BurstWords=0;
+            if (!CanRunSessionTick(Session))
+            {
+                WaitSessionBudget();
+                break;
+            }
+        }
+    }
+    Session->JACK2NET.Consume(ReadPos);
+
+    if (BurstWords>0)
+    {
+        RunSessionTick(Session);
+        StatAdd(Session->Stats->TxPackets, 1);
+    }
+}  // FlushJackToNet
+// ----------------------------------------------------
 
-jack_port_t *input_port;
-static jack_port_t *output_port;
-bool break_request=false;
-unsigned int IntermDNSPacketCounter;
+static void OnSessionSocket (void* UserInstance, uint64_t Count);
 
-CNetUMPHandler* NetUMPHandler=NULL;
-TUMP_FIFO UMP2JACK;
+static void ResumeSessionSocket (TNetUMPSession* Session)
+{
+    if ((!Session->RxPaused)||(Session->SocketFD<0)) return;
 
-static unsigned int UMPSize [16] = {1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4};
+    Session->RxPaused = false;
+    if (!AddEventSource(Session->SocketFD, &OnSessionSocket, Session))
+        Session->SocketFD = -1;
+}  // ResumeSessionSocket
+// ----------------------------------------------------
 
-// Function called when the UMP engine receives a valid UMP message
-void NetUMPCallback (void* UserInstance, uint32_t* DataBlock)
+// Housekeeping : runs the ticks the library clock is missing, so the number of RunSession() calls follows
+// the elapsed time whatever the packets read and sent at once, then watches the session socket again
+static void ServiceNetUMPSession (TNetUMPSession* Session)
 {
-    unsigned int CurrentOutPtr;
-    unsigned int TempInPtr;
-    unsigned int MTSize;
+    uint64_t Elapsed;
 
-    // Process Endpoint related UMP messages
-    if ((DataBlock[0]&0xFFFF0000)==0xF0000000)
+    if (Session->Handler==0) return;
+
+    FlushJackToNet(Session);
+
+    // Protected messages are repeated even when nothing else is sent
+    if ((Session->FECTx.Count>0)&&(GetMonotonicMs()-Session->LastFECMs>=FEC_COPY_INTERVAL_MS)&&(CanRunSessionTick(Session)))
     {
-        ProcessEndpointDiscovery(DataBlock[1]);
-        return;     // Do not transmit this message to Jack
+        SendFECCopies(Session);
+        Session->LastFECMs=GetMonotonicMs();
+        RunSessionTick(Session);
+        StatAdd(Session->Stats->TxPackets, 1);
     }
 
-    // Push UMP message into the queue to JACK
-    CurrentOutPtr=UMP2JACK.ReadPtr;
-    TempInPtr=UMP2JACK.WritePtr;
+    Elapsed = GetMonotonicMs()-SessionStartMs;
+    if (Elapsed>Session->TicksDone+MAX_SESSION_CATCHUP_TICKS)
+        Session->TicksDone = Elapsed-MAX_SESSION_CATCHUP_TICKS;
+
+    while (Session->TicksDone<Elapsed)
+        RunSessionTick(Session);
 
-    MTSize = UMPSize[DataBlock[0]>>28];
+    ResumeSessionSocket(Session);
+}  // ServiceNetUMPSession
+// ----------------------------------------------------
 
-    // Store first UMP word in all cases
-    UMP2JACK.FIFO[TempInPtr]=DataBlock[0];
-    TempInPtr+=1;
-    if (TempInPtr>=UMP_FIFO_SIZE)
-        TempInPtr=0;
-    if (TempInPtr==CurrentOutPtr)
-        return;     // FIFO is full
+// Session socket is readable. RunSession() reads one datagram : those queued behind it are read now
+// instead of going through the event loop once per datagram. When the library clock is too far ahead,
+// the socket is not watched until the next millisecond (it would stay readable and wake the loop again)
+static void OnSessionSocket (void* UserInstance, uint64_t Count)
+{
+    TNetUMPSession* Session = (TNetUMPSession*)UserInstance;
+    unsigned int Datagrams = 0;
 
-    // Store second word
-    if (MTSize>=2)
+    do
     {
-        UMP2JACK.FIFO[TempInPtr]=DataBlock[1];
-        TempInPtr+=1;
-        if (TempInPtr>=UMP_FIFO_SIZE)
-            TempInPtr=0;
-        if (TempInPtr==CurrentOutPtr)
-            return;     // FIFO is full
-
-        if (MTSize>=3)
+        if (!CanRunSessionTick(Session))
         {
-            UMP2JACK.FIFO[TempInPtr]=DataBlock[2];
-            TempInPtr+=1;
-            if (TempInPtr>=UMP_FIFO_SIZE)
-                TempInPtr=0;
-            if (TempInPtr==CurrentOutPtr)
-                return;     // FIFO is full
-
-            if (MTSize==4)
-            {
-                UMP2JACK.FIFO[TempInPtr]=DataBlock[3];
-                TempInPtr+=1;
-                if (TempInPtr>=UMP_FIFO_SIZE)
-                    TempInPtr=0;
-                if (TempInPtr==CurrentOutPtr)
-                    return;     // FIFO is full
-            }
+            RemoveEventSource(Session->SocketFD);
+            Session->RxPaused = true;
+            WaitSessionBudget();
+            return;
         }
+        RunSessionTick(Session);
+        StatAdd(Session->Stats->RxPackets, 1);
+        Datagrams++;
+    } while ((Datagrams<SESSION_RX_BATCH)&&(Session->SocketFD>=0)&&(HasPendingDatagram(Session->SocketFD)));
+}  // OnSessionSocket
+// ----------------------------------------------------
+
+// One more millisecond has elapsed since a session ran out of ticks
+static void OnSessionBudget (void* UserInstance, uint64_t Count)
+{
+    for (unsigned int s=0; s<NumSessions; s++)
+    {
+        if (Sessions[s].Handler==0) continue;
+        FlushJackToNet(&Sessions[s]);
+        ResumeSessionSocket(&Sessions[s]);
     }
+}  // OnSessionBudget
+// ----------------------------------------------------
 
-    // Update the pointer only when all UMP words have been stored
-    UMP2JACK.WritePtr=TempInPtr;
-}  // NetUMPCallback
-//-----------------------------------------------------------------------------
+// JACK has queued messages for the network
+static void OnJackWakeUp (void* UserInstance, uint64_t Count)
+{
+    for (unsigned int s=0; s<NumSessions; s++)
+        FlushJackToNet(&Sessions[s]);
+}  // OnJackWakeUp
+// ----------------------------------------------------
 
-// Callback function called when there is an audio block to process
-int jack_process(jack_nframes_t nframes, void *arg)
+static void OnSessionTick (void* UserInstance, uint64_t Count)
 {
-    unsigned int i;
-    void* in_port_buf = jack_port_get_buffer(input_port, nframes);
-    void* out_port_buf = jack_port_get_buffer(output_port, nframes);
-    jack_midi_event_t in_event;
-    jack_nframes_t event_count;
-    jack_midi_data_t* Buffer;
-    unsigned int TempRead, LastBufferPos;
-    size_t NumBytesInEvent;
-    uint32_t UMPMsg[4];
-    uint8_t MIDIMsg[8];
-    unsigned int MTSize;
-    unsigned int MIDI1Size;
+    for (unsigned int s=0; s<NumSessions; s++)
+        ServiceNetUMPSession (&Sessions[s]);
 
-    jack_midi_clear_buffer(out_port_buf);    // Recommended to call this at the beginning of process cycle
+    if (IsLatencyMeasureDone(jack_get_time()))
+        break_request=true;
+}  // OnSessionTick
+// ----------------------------------------------------
 
-    // Check if we have UMP data waiting in the FIFO from NetUMP to be sent to JACK
-    if (UMP2JACK.ReadPtr!=UMP2JACK.WritePtr)
-    {
-        // Read FIFO and generate JACK events for each MIDI message in the FIFO
-        TempRead=UMP2JACK.ReadPtr;     // Local snapshot to avoid UMP thread to see pointer moving while we parse the buffer
-        LastBufferPos=UMP2JACK.WritePtr;
+// Invite a peer found by mDNS. NetUMP creates the session socket again, so it has to be watched again
+static void InviteSessionPeer (TNetUMPSession* Session, const TmDNSService* Service)
+{
+    struct in_addr Addr;
+
+    Addr.s_addr = htonl(Service->IPV4Addr);
+    fprintf (stdout, "jacknetumpd : session %u inviting '%s' (%s:%u)\n", Session->Index+1, Service->EndpointName, inet_ntoa(Addr), Service->Port);
+
+    if (Session->SocketFD>=0)
+        RemoveEventSource(Session->SocketFD);
+    Session->RxPaused = false;
+    Session->Handler->CloseSession();
+    if (Session->Handler->InitiateSession(Service->IPV4Addr, Service->Port, Session->LocalPort, true)<0)
+        fprintf (stderr, "jacknetumpd : can not create session on port %d\n", Session->LocalPort);
+
+    Session->SocketFD = FindUDPSocketByPort(Session->LocalPort);
+    TuneSessionSocket(Session->SocketFD);
+    if ((Session->SocketFD>=0)&&(!AddEventSource(Session->SocketFD, &OnSessionSocket, Session)))
+        Session->SocketFD = -1;
+    if (Session->SocketFD<0)
+        fprintf (stderr, "jacknetumpd : socket for session %u not found, packets are read on session ticks only\n", Session->Index+1);
+
+    Session->PeerIP = Service->IPV4Addr;
+    Session->PeerPort = Service->Port;
+    Session->LastInviteMs = GetMonotonicMs();
+}  // InviteSessionPeer
+// ----------------------------------------------------
 
-        while (TempRead!=LastBufferPos)
+// Each peer found by mDNS gets its own session, and is invited again while it is not connected
+static void AutoConnectSessions (void)
+{
+    TmDNSService Services [MAX_SESSIONS];
+    TNetUMPSession* Session;
+    unsigned int NumServices;
+    uint64_t NowMs = GetMonotonicMs();
+
+    NumServices = GetmDNSServices(&Services[0], MAX_SESSIONS);
+    for (unsigned int i=0; i<NumServices; i++)
+    {
+        // Peers are identified by their ProductInstanceId, which does not change with their address
+        Session = 0;
+        for (unsigned int s=0; s<NumSessions; s++)
         {
-            // Identify message length from first word
-            UMPMsg[0]=UMP2JACK.FIFO[TempRead];
-            TempRead+=1;
-            if (TempRead>=UMP_FIFO_SIZE)
-                TempRead=0;
+            if (strcmp(Sessions[s].PeerID, Services[i].ProductInstanceID)==0)
+                Session = &Sessions[s];
+        }
 
-            MTSize = UMPSize[UMPMsg[0]>>28];
-            // Read other UMP words if necessary
-            if (MTSize>=2)
+        if (Session==0)
+        {  // New peer : take a session nobody is connected to
+            for (unsigned int s=(FixedPeer ? 1 : 0); s<NumSessions; s++)
             {
-                UMPMsg[1]=UMP2JACK.FIFO[TempRead];
-                TempRead+=1;
-                if (TempRead>=UMP_FIFO_SIZE)
-                    TempRead=0;
-
-                if (MTSize>=3)
+                if ((Sessions[s].PeerID[0]==0)&&(!Sessions[s].Connected.load()))
                 {
-                    UMPMsg[2]=UMP2JACK.FIFO[TempRead];
-                    TempRead+=1;
-                    if (TempRead>=UMP_FIFO_SIZE)
-                        TempRead=0;
-
-                    if (MTSize==4)
-                    {
-                        UMPMsg[3]=UMP2JACK.FIFO[TempRead];
-                        TempRead+=1;
-                        if (TempRead>=UMP_FIFO_SIZE)
-                            TempRead=0;
-                    }
+                    Session = &Sessions[s];
+                    break;
                 }
             }
+            if (Session==0) continue;
+            snprintf(Session->PeerID, sizeof(Session->PeerID), "%s", Services[i].ProductInstanceID);
+        }
 
-            MIDI1Size = TranscodeUMP_MIDI1 (&UMPMsg[0], &MIDIMsg[0]);
-            if (MIDI1Size>0)        // UMP message has been transcoded successfully into MIDI1.0
-            {
-                Buffer=jack_midi_event_reserve (out_port_buf, 0, MIDI1Size);
-                if (Buffer!=0)
-                {
-                    memcpy(Buffer, &MIDIMsg[0], MIDI1Size);
-                }
-            }
+        if (Session->Connected.load()) continue;
+        if ((Session->PeerIP==Services[i].IPV4Addr)&&(Session->PeerPort==Services[i].Port)&&(NowMs-Session->LastInviteMs<PEER_REINVITE_MS))
+            continue;
+        InviteSessionPeer(Session, &Services[i]);
+    }
+}  // AutoConnectSessions
+// ----------------------------------------------------
 
-            // TODO : For now, we do not convert SYSEX as we don't see real interest for the Zynthian
-        }  // loop over all events in the queue
+static void OnmDNSTimer (void* UserInstance, uint64_t Count)
+{
+    RunmDNS(GetMonotonicMs());
+    if (AutoConnect)
+        AutoConnectSessions();
+    RTSafeReport();
+}  // OnmDNSTimer
+// ----------------------------------------------------
+
+// Peers found in the announces are invited at once
+static void OnmDNSSocket (void* UserInstance, uint64_t Count)
+{
+    ProcessmDNSPackets();
+    if (AutoConnect)
+        AutoConnectSessions();
+}  // OnmDNSSocket
+// ----------------------------------------------------
 
-        // Update read pointer only when we have parsed the whole buffer
-        UMP2JACK.ReadPtr=TempRead;
-    }  // MIDI data available from NetUMP queue
+static void OnmDNSInterfaces (void* UserInstance, uint64_t Count)
+{
+    ProcessmDNSInterfaceChange();
+}  // OnmDNSInterfaces
+// ----------------------------------------------------
 
-    // Generate NetUMP payload for each event sent by JACK
-    if (in_port_buf)
-        event_count = jack_midi_get_event_count(in_port_buf);
-    else
-        event_count = 0;
+// Give the received messages of the log to NetUMPCallback when their (scaled) time has come, one packet per session
+// and per tick. Messages we sent are not replayed : JACK produces them again
+static void OnReplayTimer (void* UserInstance, uint64_t Count)
+{
+    TRecordedUMP Record;
+    TNetUMPSession* Session;
+    uint32_t UMPMsg[4];
+    uint64_t ReplayTimeUs;
+    bool Fed[MAX_SESSIONS];
 
-    if(event_count >= 1)
+    if (ReplayEndMs!=0)
     {
-        //printf("jackrtpumpd: %d events\n", event_count);
+        if (GetMonotonicMs()-ReplayEndMs>=REPLAY_DRAIN_MS)
+            break_request=true;
+        return;
+    }
 
-        for(i=0; i<event_count; i++)
-        {
-            jack_midi_event_get(&in_event, in_port_buf, i);
-            NumBytesInEvent=in_event.size;
+    memset(&Fed[0], 0, sizeof(Fed));
+    ReplayTimeUs=ReplayFirstUs+(uint64_t)((GetRecorderTimeUs()-ReplayStartUs)*ReplaySpeed);
 
-            if (TranscodeMIDI1_UMP (&in_event.buffer[0], NumBytesInEvent, &UMPMsg[0]))
-            {
-                if (NetUMPHandler)
-                {
-                    NetUMPHandler->SendUMPMessage(&UMPMsg[0]);
-                }
-            }
+    while (PeekReplay(&Record))
+    {
+        if (Record.TimeUs>ReplayTimeUs)
+            break;
+        NextReplay();
+
+        // Stream messages would be answered to a peer which is not there
+        if ((Record.Direction!=RECORD_RX)||((Record.Words[0]>>28)==0x0F))
+            continue;
+        if ((Record.Session>=NumSessions)||(Sessions[Record.Session].OutputPort.load()==0)||(Record.NumWords!=UMPWordCount[Record.Words[0]>>28]))
+        {
+            ReplaySkipped++;
+            continue;
         }
+
+        Session=&Sessions[Record.Session];
+        memcpy(&UMPMsg[0], Record.Words, Record.NumWords*sizeof(uint32_t));
+        NetUMPCallback(Session, &UMPMsg[0]);
+        Fed[Record.Session]=true;
+        ReplayedMessages++;
     }
 
-    return 0;
-}  // jack_process
+    for (unsigned int s=0; s<NumSessions; s++)
+    {
+        if (!Fed[s]) continue;
+        FlushRxStaging(&Sessions[s]);
+        JitterBufferEndOfPacket(&Sessions[s].Jitter);
+    }
+
+    if (!PeekReplay(&Record))
+    {
+        fprintf (stdout, "jacknetumpd : replay done, %lu messages played, %lu skipped (session not open)\n", ReplayedMessages, ReplaySkipped);
+        ReplayEndMs=GetMonotonicMs();
+    }
+}  // OnReplayTimer
 // ----------------------------------------------------
 
-/* Callback function called when jack server is shut down */
-void jack_shutdown(void *arg)
+static void CloseSessions (void)
 {
-    printf ("JACK has shut down\n");
-    break_request=true;
-}  // jack_shutdown
+    for (unsigned int s=0; s<NumSessions; s++)
+    {
+        if (Sessions[s].Handler)
+        {
+            fprintf (stdout, "Closing NetUMP handler %u...\n", s+1);
+            Sessions[s].Handler->CloseSession();
+            delete Sessions[s].Handler;
+            Sessions[s].Handler=0;
+        }
+    }
+}  // CloseSessions
 // ----------------------------------------------------
 
-void sig_handler (int signo)
+// Parse "<first>[-<last>]:<name>" (groups 1-16) and declare the Function Block, with its JACK output port
+// and the route sending its groups to this port. Groups of different blocks must not overlap
+static bool DeclareFunctionBlock (const char* Spec)
 {
-    if (signo == SIGINT)
+    static uint16_t UsedGroups=0;
+    char PortName [ROUTE_MAX_NAME];
+    char* End;
+    unsigned long First, Last;
+    uint16_t Groups;
+    int Port;
+    int Block;
+
+    First=strtoul(Spec, &End, 10);
+    Last=First;
+    if (*End=='-')
+        Last=strtoul(End+1, &End, 10);
+    if ((*End!=':')||(End[1]==0)||(First<1)||(Last>16)||(First>Last))
     {
-        break_request=true;
+        fprintf (stderr, "jacknetumpd : invalid Function Block '%s' (expected <group>[-<group>]:<name>)\n", Spec);
+        return false;
     }
-}  // sig_handler
+
+    Groups=((1<<(Last-First+1))-1)<<(First-1);
+    if (UsedGroups&Groups)
+    {
+        fprintf (stderr, "jacknetumpd : Function Block '%s' uses a group of another block\n", Spec);
+        return false;
+    }
+
+    // JACK port is named after the block, without spaces
+    snprintf(PortName, sizeof(PortName), "%s", End+1);
+    for (char* c=&PortName[0]; *c; c++)
+        if ((*c==' ')||(*c==':')) *c='_';
+
+    Port=AddRoutePort(PortName);
+    if (Port<0)
+    {
+        fprintf (stderr, "jacknetumpd : can not add port for Function Block '%s' (duplicate name or too many ports)\n", Spec);
+        return false;
+    }
+    Block=AddFunctionBlock(End+1, First-1, Last-First+1, !UMPPorts);
+    if (Block<0)
+    {
+        fprintf (stderr, "jacknetumpd : too many Function Blocks (max %d)\n", MAX_FUNCTION_BLOCKS);
+        return false;
+    }
+
+    BlockPorts[Block]=Port;
+    RouteGroupsToPort(First-1, Last-First+1, Port);
+    UsedGroups|=Groups;
+    return true;
+}  // DeclareFunctionBlock
 // ----------------------------------------------------
 
 int main(int argc, char** argv)
 {
     int Ret;
-    static jack_client_t *client;
     char *destHost = 0;
     char *LocalEndpointName = "Zynthian NetUMP";
     unsigned int LocalPort = 5504;
     unsigned int RemotePort = 5504;
-
-    fprintf (stdout, "JACK <-> Network UMP bridge V1.4 for Zynthian\n");
+    unsigned int SessionTickMs = DEFAULT_SESSION_TICK_MS;
+    unsigned int destIP = 0;
+    char *StatsSocketPath = 0;
+    char *RoutesPath = 0;
+    char *ConnectPattern = 0;
+    char *BlockSpecs [MAX_FUNCTION_BLOCKS];
+    unsigned int NumBlockSpecs = 0;
+    int NetPriority = 0;
+    cpu_set_t NetCPUs;
+    cpu_set_t JackCPUs;
+    bool PinNet = false;
+    bool PinJack = false;
+    bool LockPages = false;
+    unsigned int SocketBufferKB = 0;
+    unsigned int BusyPollUs = 0;
+    char *RecordPath = 0;
+    char *ReplayPath = 0;
+    unsigned int FIFOSize = UMP2JACK_FIFO_SIZE;
+    TRecordedUMP FirstRecord;
+    TNetUMPSession* Session;
+
+    fprintf (stdout, "JACK <-> Network UMP bridge V1.5 for Zynthian\n");
     fprintf (stdout, "Copyright 2024/2025 Benoit BOUCHEZ (BEB)\n");
     fprintf (stdout, "Please report any issue to BEB on discourse.zynthian.org\n");
 
     break_request=false;
     signal (SIGINT, sig_handler);
-
-    UMP2JACK.ReadPtr=0;
-    UMP2JACK.WritePtr=0;
+    InitRoutes();
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++)
@@ -329,6 +1719,168 @@ int main(int argc, char** argv)
             LocalEndpointName = argv[i + 1];
             i++;
         }
+        else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc)
+        {
+            NumSessions = atoi(argv[i + 1]);
+            if (NumSessions < 1)
+                NumSessions = 1;
+            if (NumSessions > MAX_SESSIONS)
+                NumSessions = MAX_SESSIONS;
+            i++;
+        }
+        else if (strcmp(argv[i], "--session-tick") == 0 && i + 1 < argc)
+        {
+            SessionTickMs = atoi(argv[i + 1]);
+            if (SessionTickMs == 0)
+                SessionTickMs = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], "--jitter-buffer") == 0 && i + 1 < argc)
+        {
+            if (strcmp(argv[i + 1], "auto") == 0)
+            {
+                AdaptiveJitter = true;
+                EnableEndpointJR();
+            }
+            else
+                JitterBufferFrames = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--midi2") == 0)
+        {
+            EnableEndpointMIDI2();
+        }
+        else if (strcmp(argv[i], "--ump-ports") == 0)
+        {
+            UMPPorts = true;
+        }
+        else if (strcmp(argv[i], "--rt-safe") == 0)
+        {
+            EnableRTSafeCheck();
+        }
+        else if (strcmp(argv[i], "--measure-latency") == 0 && i + 1 < argc)
+        {
+            EnableLatencyMeasure(atoi(argv[i + 1]), LATENCY_PROBE_PERIOD_MS);
+            i++;
+        }
+        else if (strcmp(argv[i], "--reflect") == 0)
+        {
+            EnableLatencyReflector();
+        }
+        else if (strcmp(argv[i], "--stats-socket") == 0 && i + 1 < argc)
+        {
+            StatsSocketPath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--fec-depth") == 0 && i + 1 < argc)
+        {
+            SetFECDepth(atoi(argv[i + 1]));
+            i++;
+        }
+        else if (strcmp(argv[i], "--routes") == 0 && i + 1 < argc)
+        {
+            RoutesPath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--connect-to") == 0 && i + 1 < argc)
+        {
+            ConnectPattern = argv[i + 1];
+            AutoConnect = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--function-block") == 0 && i + 1 < argc)
+        {
+            if (NumBlockSpecs >= MAX_FUNCTION_BLOCKS)
+            {
+                fprintf(stderr, "jacknetumpd : too many Function Blocks (max %d)\n", MAX_FUNCTION_BLOCKS);
+                return -1;
+            }
+            BlockSpecs[NumBlockSpecs++] = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--rt-priority") == 0 && i + 1 < argc)
+        {
+            NetPriority = atoi(argv[i + 1]);
+            if ((NetPriority < 1) || (NetPriority > 99))
+            {
+                fprintf(stderr, "jacknetumpd : realtime priority must be between 1 and 99\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc)
+        {
+            if (!ParseCPUSet(argv[i + 1], &NetCPUs))
+            {
+                fprintf(stderr, "jacknetumpd : invalid CPU list '%s'\n", argv[i + 1]);
+                return -1;
+            }
+            PinNet = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--jack-cpu") == 0 && i + 1 < argc)
+        {
+            if (!ParseCPUSet(argv[i + 1], &JackCPUs))
+            {
+                fprintf(stderr, "jacknetumpd : invalid CPU list '%s'\n", argv[i + 1]);
+                return -1;
+            }
+            PinJack = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--mlock") == 0)
+        {
+            LockPages = true;
+        }
+        else if (strcmp(argv[i], "--socket-buffer") == 0 && i + 1 < argc)
+        {
+            SocketBufferKB = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--busy-poll") == 0 && i + 1 < argc)
+        {
+            BusyPollUs = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            RecordPath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            ReplayPath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc)
+        {
+            ReplaySpeed = atof(argv[i + 1]);
+            if (ReplaySpeed <= 0)
+            {
+                fprintf(stderr, "jacknetumpd : replay speed must be above 0\n");
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--fifo-size") == 0 && i + 1 < argc)
+        {
+            FIFOSize = atoi(argv[i + 1]);
+            if ((FIFOSize < MIN_UMP2JACK_FIFO_SIZE) || (FIFOSize > MAX_UMP2JACK_FIFO_SIZE))
+            {
+                fprintf(stderr, "jacknetumpd : FIFO size must be between %d and %d words\n", MIN_UMP2JACK_FIFO_SIZE, MAX_UMP2JACK_FIFO_SIZE);
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--fifo-policy") == 0 && i + 1 < argc)
+        {
+            if (!ParseFIFOPolicy(argv[i + 1], &FIFOPolicy))
+            {
+                fprintf(stderr, "jacknetumpd : unknown FIFO policy '%s' (drop-newest, drop-oldest or priority)\n", argv[i + 1]);
+                return -1;
+            }
+            i++;
+        }
         else if (strcmp(argv[i], "--help") == 0)
         {
             fprintf(stdout, "Usage: %s [options]\n", argv[0]);
@@ -337,6 +1889,31 @@ int main(int argc, char** argv)
             fprintf(stdout, "  --localport <port>       Set Network UMP local port\n");
             fprintf(stdout, "  --remoteport <port>      Set Network UMP port on remote host\n");
             fprintf(stdout, "  --endpoint-name <name>   Set local UMP Endpoint Name\n");
+            fprintf(stdout, "  --sessions <n>           Accept up to n peers, on consecutive local ports (max %d)\n", MAX_SESSIONS);
+            fprintf(stdout, "  --session-tick <ms>      Set NetUMP session housekeeping period\n");
+            fprintf(stdout, "  --jitter-buffer <frames> Add a fixed delay to messages from the network\n");
+            fprintf(stdout, "  --jitter-buffer auto     Adaptive delay, using JR Timestamps once requested by the peer\n");
+            fprintf(stdout, "  --midi2                  Accept MIDI 2.0 Protocol when requested by the peer\n");
+            fprintf(stdout, "  --ump-ports              Use UMP JACK ports (PipeWire / recent JACK2) instead of MIDI 1.0\n");
+            fprintf(stdout, "  --rt-safe                Report unsafe calls made from the JACK process callback\n");
+            fprintf(stdout, "  --measure-latency <s>    Measure latency with a peer running --reflect, for s seconds (0 : until stopped)\n");
+            fprintf(stdout, "  --reflect                Echo latency probes received from the peer\n");
+            fprintf(stdout, "  --stats-socket <path>    Export runtime statistics on a Unix socket\n");
+            fprintf(stdout, "  --fec-depth <n>          Repeat note-off and state messages n times (max %d, same value on both peers)\n", FEC_MAX_DEPTH);
+            fprintf(stdout, "  --routes <file>          Filter, remap and dispatch messages to extra JACK ports\n");
+            fprintf(stdout, "  --connect-to <pattern>   Invite peers found by mDNS whose endpoint name or instance id matches pattern\n");
+            fprintf(stdout, "  --function-block <g>:<name>  Declare a Function Block on group(s) g (e.g. 2-3:Drums), with its own JACK ports\n");
+            fprintf(stdout, "  --rt-priority <n>        Run the network thread with SCHED_FIFO priority n (below the JACK priority)\n");
+            fprintf(stdout, "  --cpu <list>             Pin the network thread to the CPUs of list (e.g. 3 or 2-3)\n");
+            fprintf(stdout, "  --jack-cpu <list>        Pin the JACK process thread to the CPUs of list\n");
+            fprintf(stdout, "  --mlock                  Lock memory and fault in the buffers at startup\n");
+            fprintf(stdout, "  --socket-buffer <KB>     Set the kernel buffers of the session sockets\n");
+            fprintf(stdout, "  --busy-poll <us>         Busy poll the network device when reading session sockets\n");
+            fprintf(stdout, "  --record <file>          Log the UMP messages received from and sent to the network\n");
+            fprintf(stdout, "  --replay <file>          Play the messages received in a log as if they came from the network, then stop\n");
+            fprintf(stdout, "  --replay-speed <x>       Replay x times faster than recorded\n");
+            fprintf(stdout, "  --fifo-size <words>      Size of the FIFO from the network to JACK, per session (default %d)\n", UMP2JACK_FIFO_SIZE);
+            fprintf(stdout, "  --fifo-policy <policy>   drop-newest, drop-oldest or priority (keep note-offs, drop controllers first)\n");
             fprintf(stdout, "  --help                   Display this help message\n");
             return 0;
         }
@@ -348,112 +1925,234 @@ int main(int argc, char** argv)
         }
     }
 
-    initUMP_mDNS();
+    // Function Blocks come first, so the routes file can refine what goes to their ports
+    for (unsigned int b=0; b<NumBlockSpecs; b++)
+    {
+        if (!DeclareFunctionBlock(BlockSpecs[b]))
+            return -1;
+    }
+    if ((RoutesPath)&&(!LoadRoutes(RoutesPath)))
+        return -1;
+    SetEndpointDiscoveryName(LocalEndpointName);
+    ConfigureSessionSockets(SocketBufferKB*1024, BusyPollUs);
+    if ((ReplayPath)&&(!OpenReplay(ReplayPath)))
+        return -1;
+
+    if (!InitEventLoop(&OnJackWakeUp, 0))
+    {
+        fprintf(stderr, "jacknetumpd : can not create event loop\n");
+        return -1;
+    }
+
+    initUMP_mDNS(LocalEndpointName, LocalPort, NumSessions);
+    if (ConnectPattern)
+        StartmDNSBrowse(ConnectPattern);
 
     if ((client = jack_client_open ("jacknetumpd", JackNullOption, NULL)) == 0)
     {
         fprintf(stderr, "jacknetumpd : JACK server is not running\n");
         return -1;
     }
+    SampleRate = jack_get_sample_rate(client);
+    PeriodFrames = jack_get_buffer_size(client);
 
-    NetUMPHandler = new CNetUMPHandler (&NetUMPCallback, 0);
-    if (NetUMPHandler)
+    if (destHost)
     {
-        NetUMPHandler->SetEndpointName(LocalEndpointName);
-        NetUMPHandler->SetProductInstanceID((char*)"ZV5_001");      // TODO : this should be random
-
-        NetUMPHandler->SetConnectionCallback([](const char* EndpointName, unsigned int size)
+        FixedPeer = true;
+        fprintf(stdout, "jacknetumpd : connecting to peer '%s:%d'...\n", destHost, RemotePort);
+        struct hostent *host_entry;
+        host_entry = gethostbyname(destHost);
+        if (host_entry == NULL)
         {
-            fprintf (stdout, "jacknetumpd : connected to '%s'.\n", EndpointName);
-            jack_uuid_t output_port_uuid = jack_port_uuid(output_port);
-            jack_set_property(client, output_port_uuid, "UMPEndpointName", EndpointName, "text/plain");
-        });
+            fprintf(stderr, "jacknetumpd : could not resolve hostname: %s\n", destHost);
+            return 1;
+        }
+
+        char *ip = inet_ntoa(*((struct in_addr*) host_entry->h_addr_list[0]));
+        fprintf(stdout, "jacknetumpd : resolved hostname '%s' to IP address %s\n", destHost, ip);
+        destIP = ntohl(inet_addr(ip));
+    }
 
-        NetUMPHandler->SetDisconnectCallback([]()
+    for (unsigned int s=0; s<NumSessions; s++)
+    {
+        Session = &Sessions[s];
+        Session->Index = s;
+        Session->LocalPort = LocalPort+s;
+        Session->SocketFD = -1;
+        Session->RxPaused = false;
+        Session->TicksDone = 0;
+        Session->InputPort = 0;
+        Session->OutputPort = 0;
+        Session->Protocol = UMP_PROTOCOL_MIDI1;
+        Session->JR = 0;
+        Session->Connected = false;
+        Session->Stats = GetSessionStats(s);
+        Session->JACK2NET.Reset();
+        Session->RxStagingLen = 0;
+        Session->RxPending.Reset();
+        Session->UMP2JACKDropRequest = 0;
+        Session->RxSysExQueued[0] = Session->RxSysExQueued[1] = 0;
+        Session->RxSysExDropped[0] = Session->RxSysExDropped[1] = 0;
+        Session->JackSysExSkip[0] = Session->JackSysExSkip[1] = 0;
+        InitSysExTx(&Session->SysExTx);
+        for (unsigned int b=0; b<MAX_FUNCTION_BLOCKS; b++)
+            InitSysExTx(&Session->BlockSysExTx[b]);
+        InitOutputScheduler(&Session->Output);
+        InitFECTx(&Session->FECTx);
+        InitFECRx(&Session->FECRx);
+        Session->LastFECMs = 0;
+        Session->PeerID[0] = 0;
+        Session->PeerIP = 0;
+        Session->PeerPort = 0;
+        Session->LastInviteMs = 0;
+        InitJitterBuffer(&Session->Jitter, SampleRate, JitterBufferFrames, AdaptiveJitter);
+        if (!Session->SysExRx.Init())
+        {
+            fprintf (stderr, "jacknetumpd : can not allocate SYSEX buffers! Aborting...\n");
+            CloseSessions();
+            return -1;
+        }
+        if (!Session->UMP2JACK.Allocate(FIFOSize))
         {
-            fprintf (stdout, "jacknetumpd : disconnected\n");
-            jack_uuid_t output_port_uuid = jack_port_uuid(output_port);
-            jack_remove_property(client, output_port_uuid, "UMPEndpointName");
-        });
+            fprintf (stderr, "jacknetumpd : can not allocate FIFO of %u words! Aborting...\n", FIFOSize);
+            CloseSessions();
+            return -1;
+        }
 
-        if (destHost)
+        Session->Handler = new CNetUMPHandler (&NetUMPCallback, Session);
+        if (Session->Handler==0)
         {
-            fprintf(stdout, "jacknetumpd : connecting to peer '%s:%d'...\n", destHost, RemotePort);
-            struct hostent *host_entry;
-            host_entry = gethostbyname(destHost);
-            if (host_entry == NULL)
-            {
-                fprintf(stderr, "jacknetumpd : could not resolve hostname: %s\n", destHost);
-                delete NetUMPHandler;
-                return 1;
-            }
+            fprintf (stderr, "jacknetumpd : can not create NetworkUMP handler! Aborting...\n");
+            CloseSessions();
+            return -1;
+        }
 
-            char *ip = inet_ntoa(*((struct in_addr*) host_entry->h_addr_list[0]));
-            fprintf(stdout, "jacknetumpd : resolved hostname '%s' to IP address %s\n", destHost, ip);
-            unsigned int destIP = ntohl(inet_addr(ip));
-            Ret = NetUMPHandler->InitiateSession(destIP, RemotePort, LocalPort, true);
+        Session->Handler->SetEndpointName(LocalEndpointName);
+        Session->Handler->SetProductInstanceID((char*)GetmDNSProductInstanceID(s));
+        Session->Handler->SetConnectionCallback(ConnectedCallbacks[s]);
+        Session->Handler->SetDisconnectCallback(DisconnectedCallbacks[s]);
+
+        // When a remote host is given, first session connects to it, others wait for peers
+        if ((destHost)&&(s==0))
+        {
+            Ret = Session->Handler->InitiateSession(destIP, RemotePort, Session->LocalPort, true);
         }
         else
         {
-            fprintf(stdout, "jacknetumpd : waiting for connection on port %d...\n", LocalPort);
-            Ret = NetUMPHandler->InitiateSession (0, 0, LocalPort, false);
+            fprintf(stdout, "jacknetumpd : waiting for connection on port %d...\n", Session->LocalPort);
+            Ret = Session->Handler->InitiateSession (0, 0, Session->LocalPort, false);
         }
 
         // Report if problem arises when session is activated
         if (Ret<0)
         {
-            fprintf (stderr, "jacknetumpd : can not create session\n");
-            delete NetUMPHandler;
+            fprintf (stderr, "jacknetumpd : can not create session on port %d\n", Session->LocalPort);
+            CloseSessions();
             return -1;
         }
-    }  // NetUMPHandler created
-    else
+    }
+
+    // Pages are locked before JACK calls us. The sessions (JACK2NET and the rings kept inside) are touched once :
+    // mlockall maps them, but this also breaks the copy-on-write of zero pages that were only read so far.
+    // UMP2JACK is on the heap and has already been written when allocated, mlockall maps the SYSEX buffers
+    if (LockPages)
     {
-        fprintf (stderr, "jacknetumpd : can not create NetworkUMP handler! Aborting...\n");
-        return -1;
+        if (LockMemory())
+            PrefaultMemory(&Sessions[0], sizeof(Sessions));
     }
 
     // Register the various callbacks needed by a JACK application
     jack_set_process_callback (client, jack_process, 0);
     jack_on_shutdown (client, jack_shutdown, 0);
+    jack_set_xrun_callback (client, jack_xrun, 0);
+    jack_set_buffer_size_callback (client, jack_buffer_size, 0);
 
-    input_port = jack_port_register (client, "netump_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-    output_port = jack_port_register (client, "netump_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+    // First session ports always exist, others are created when a peer connects (or now, to replay their messages)
+    for (unsigned int s=0; s<(ReplayPath ? NumSessions : 1); s++)
+    {
+        if (!RegisterSessionPorts(&Sessions[s]))
+        {
+            CloseSessions();
+            return 1;
+        }
+    }
 
     if (jack_activate (client))
     {
         fprintf(stderr, "jacknetumpd : cannot activate client");
+        CloseSessions();
         return 1;
     }
 
-    /* run until interrupted */
-    while(break_request==false)
+    // JACK threads exist now : they do not inherit the settings of the network thread
+    if (PinJack)
+        SetThreadCPUs(jack_client_thread_id(client), &JackCPUs, "JACK");
+    if (PinNet)
+        SetThreadCPUs(pthread_self(), &NetCPUs, "network");
+    if (NetPriority > 0)
+        SetThreadRealtime(pthread_self(), NetPriority, "network");
+
+    // Wake up as soon as a packet is received on a session socket
+    for (unsigned int s=0; s<NumSessions; s++)
     {
-        if (NetUMPHandler)
-            NetUMPHandler->RunSession();
+        Session = &Sessions[s];
+        Session->SocketFD = FindUDPSocketByPort(Session->LocalPort);
+        TuneSessionSocket(Session->SocketFD);
+        if ((Session->SocketFD<0)||(!AddEventSource(Session->SocketFD, &OnSessionSocket, Session)))
+        {
+            fprintf(stderr, "jacknetumpd : socket for session %u not found, falling back to 1 ms polling\n", s+1);
+            SessionTickMs = 1;
+        }
+    }
+
+    SessionStartMs = GetMonotonicMs();
+    AddEventTimer(SessionTickMs, &OnSessionTick, 0);
+    // Without it, sessions out of ticks wait for the housekeeping tick
+    SessionBudgetTimer = AddEventOneShotTimer(&OnSessionBudget, 0);
+    // mDNS queries are answered as soon as they are received, the timer runs the probe/announce sequence
+    if (GetmDNSSocket()>=0)
+        AddEventSource(GetmDNSSocket(), &OnmDNSSocket, 0);
+    if (GetmDNSMonitorSocket()>=0)
+        AddEventSource(GetmDNSMonitorSocket(), &OnmDNSInterfaces, 0);
+    AddEventTimer(MDNS_TICK_MS, &OnmDNSTimer, 0);
+
+    if (StatsSocketPath)
+        OpenStatsSocket(StatsSocketPath, NumSessions);
+
+    if ((RecordPath)&&(!StartRecorder(RecordPath)))
+        break_request=true;
 
-        // Send UMP mDNS packet every 5 seconds
-        IntermDNSPacketCounter++;
-        if (IntermDNSPacketCounter>=5000)
+    // Log time is moved to now : first message is played at once
+    if (ReplayPath)
+    {
+        if (PeekReplay(&FirstRecord))
         {
-            IntermDNSPacketCounter = 0;
-            SendUMPmDNS();
+            fprintf (stdout, "jacknetumpd : replaying %s at speed %g\n", ReplayPath, ReplaySpeed);
+            ReplayFirstUs = FirstRecord.TimeUs;
         }
-        SystemSleepMillis(1);        // Run NetUMP process every millisecond
+        ReplayStartUs = GetRecorderTimeUs();
+        AddEventTimer(REPLAY_TICK_MS, &OnReplayTimer, 0);
+    }
+
+    /* run until interrupted */
+    while(break_request==false)
+    {
+        // Messages queued by JACK are flushed by OnJackWakeUp(), as soon as KickEventLoop() is called
+        if (!RunEventLoop(-1))
+            break;
     }
     fprintf (stdout, "Program termination requested by user\n");
 
     // Clean everything before we exit
     jack_client_close(client);
-    if (NetUMPHandler)
-    {
-        fprintf (stdout, "Closing NetUMP handler...\n");
-        NetUMPHandler->CloseSession();
-        delete NetUMPHandler;
-        NetUMPHandler=0;
-    }
+    CloseSessions();
+    StopRecorder();
+    CloseReplay();
+    LatencyReport();
 
     TerminatemDNS();
+    CloseStatsSocket();
+    CloseEventLoop();
 
     fprintf (stdout, "Done...\n");
 
@@ -0,0 +1,319 @@
+/*
+ * mDNSTest.cpp
+ * Checks of the mDNS responder packets, run by make test
+ *
+ * UMP_mDNS.cpp is included to reach its static functions. Queries are given to ProcessQuery()
+ * directly, with a fake interface, and the answers are read on a localhost socket
+ */
+
+#include <poll.h>
+#include "../UMP_mDNS.cpp"
+
+#define TEST_REPLY_TIMEOUT_MS   200
+
+static unsigned int Failures = 0;
+
+#define CHECK(Condition) \
+    do { \
+        if (!(Condition)) \
+        { \
+            fprintf (stderr, "%s:%d : check failed : %s\n", __FILE__, __LINE__, #Condition); \
+            Failures++; \
+        } \
+    } while (0)
+
+static TNetInterface TestInterface;
+static int ReplySocket = -1;
+static sockaddr_in ReplyAddress;
+
+//! Responder with the largest records : long endpoint name, all the sessions, all the addresses an interface can have
+static bool SetupResponder (void)
+{
+    char LongName [sizeof(EndpointName)];
+    socklen_t AddressLen = sizeof(ReplyAddress);
+
+    memset (&TestInterface, 0, sizeof(TestInterface));
+    TestInterface.Index = 1;
+    TestInterface.NumIPv4 = NET_MAX_ADDRESSES;
+    TestInterface.NumIPv6 = NET_MAX_ADDRESSES;
+    for (unsigned int a=0; a<NET_MAX_ADDRESSES; a++)
+    {
+        TestInterface.IPv4[a] = 0xC0A80001+a;
+        memset (TestInterface.IPv6[a], 0xF0+a, 16);
+    }
+    memcpy (&Interfaces[0], &TestInterface, sizeof(TNetInterface));
+    NumInterfaces = 1;
+
+    memset (LongName, 'N', sizeof(LongName)-1);
+    LongName[sizeof(LongName)-1] = 0;
+    snprintf (EndpointName, sizeof(EndpointName), "%s", LongName);
+    InitInstances (5504, MDNS_MAX_INSTANCES);
+    Conflicts = 0;
+    BuildRecords ();
+    State = MDNS_ANNOUNCED;
+
+    mDNSSocket = socket (AF_INET, SOCK_DGRAM, 0);
+    ReplySocket = socket (AF_INET, SOCK_DGRAM, 0);
+    if ((mDNSSocket<0)||(ReplySocket<0)) return false;
+
+    memset (&ReplyAddress, 0, sizeof(ReplyAddress));
+    ReplyAddress.sin_family = AF_INET;
+    ReplyAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind (ReplySocket, (const sockaddr*)&ReplyAddress, sizeof(ReplyAddress))<0) return false;
+    return getsockname (ReplySocket, (sockaddr*)&ReplyAddress, &AddressLen)==0;
+}  // SetupResponder
+// -------------------------------------------------------------
+
+//! Wait for the answer to a query. Returns its length, 0 if nothing has been sent
+static unsigned int ReadReply (uint8_t* Reply, unsigned int MaxLen)
+{
+    pollfd Poll;
+    ssize_t Len;
+
+    Poll.fd = ReplySocket;
+    Poll.events = POLLIN;
+    Poll.revents = 0;
+    if (poll (&Poll, 1, TEST_REPLY_TIMEOUT_MS)<=0) return 0;
+    Len = recv (ReplySocket, Reply, MaxLen, 0);
+    return (Len>0) ? Len : 0;
+}  // ReadReply
+// -------------------------------------------------------------
+
+//! Walk through all the sections : every record must be complete and end exactly at the end of the packet
+static bool IsWellFormed (const uint8_t* Packet, unsigned int Len)
+{
+    const TMDNS_Header* Header = (const TMDNS_Header*)Packet;
+    uint8_t Name [MDNS_MAX_NAME];
+    unsigned int NameLen;
+    unsigned int Pos = sizeof(TMDNS_Header);
+    unsigned int NumRecords;
+
+    for (unsigned int q=0; q<ntohs(Header->Questions); q++)
+    {
+        if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) return false;
+        Pos += 4;
+    }
+    NumRecords = ntohs(Header->AnswerRRs)+ntohs(Header->AuthorityRRs)+ntohs(Header->AdditionalRRs);
+    for (unsigned int r=0; r<NumRecords; r++)
+    {
+        if (!ReadName (Packet, Len, &Pos, Name, &NameLen)) return false;
+        if (Pos+10>Len) return false;
+        Pos += 10+GetU16 (&Packet[Pos+8]);
+    }
+    return Pos==Len;
+}  // IsWellFormed
+// -------------------------------------------------------------
+
+//! Name of nobody taking NameBytes bytes (at least 3), in labels of 50 characters
+static void PutFillerName (uint8_t* Query, unsigned int* Pos, unsigned int NameBytes)
+{
+    unsigned int Label;
+
+    while (NameBytes>1)
+    {
+        Label = (NameBytes>60) ? 50 : NameBytes-2;
+        Query[(*Pos)++] = Label;
+        memset (&Query[*Pos], 'x', Label);
+        *Pos += Label;
+        NameBytes -= Label+1;
+    }
+    Query[(*Pos)++] = 0;
+}  // PutFillerName
+// -------------------------------------------------------------
+
+//! Build a query with NumQuestions questions : the last one asks for Type records of Name, the others are names
+//! of nobody, so that the questions take QuestionBytes bytes
+static unsigned int BuildQuery (uint8_t* Query, unsigned int NumQuestions, unsigned int QuestionBytes,
+                                const uint8_t* Name, unsigned int NameLen, unsigned int Type)
+{
+    TMDNS_Header* Header = (TMDNS_Header*)Query;
+    unsigned int Pos = sizeof(TMDNS_Header);
+    unsigned int Filler = QuestionBytes-(NameLen+4);
+    unsigned int NameBytes;
+
+    memset (Header, 0, sizeof(TMDNS_Header));
+    Header->TransactionID = htons(0x1234);
+    Header->Questions = htons(NumQuestions);
+
+    for (unsigned int q=0; q+1<NumQuestions; q++)
+    {
+        NameBytes = Filler/(NumQuestions-1);
+        if (q==NumQuestions-2) NameBytes = Filler-(NumQuestions-2)*NameBytes;
+        PutFillerName (Query, &Pos, NameBytes-4);
+        Query[Pos++] = 0; Query[Pos++] = DNS_TYPE_A;
+        Query[Pos++] = 0; Query[Pos++] = DNS_CLASS_IN;
+    }
+
+    memcpy (&Query[Pos], Name, NameLen);
+    Pos += NameLen;
+    Query[Pos++] = 0; Query[Pos++] = Type;
+    Query[Pos++] = 0; Query[Pos++] = DNS_CLASS_IN;
+    return Pos;
+}  // BuildQuery
+// -------------------------------------------------------------
+
+//! A record which does not fit is left out, with all the records after it
+static void TestPutRecordsBound (void)
+{
+    TMDNS_Packet Packet;
+    unsigned int All = RR_SERVICES|AllInstances (RR_PTR|RR_SRV|RR_TXT)|RR_ADDRESS;
+    unsigned int Total;
+    unsigned int Count;
+
+    InitPacket (&Packet, 0, 0x8400);
+    Total = PutRecords (&Packet, All, MDNS_TTL, true, &TestInterface);
+    // Records of all the sessions do not fit in one packet
+    CHECK (Packet.Full);
+    CHECK ((Total>0)&&(Total<1+3*MDNS_MAX_INSTANCES+2*NET_MAX_ADDRESSES));
+
+    for (unsigned int Space=0; Space<MDNS_MAX_PACKET; Space+=7)
+    {
+        InitPacket (&Packet, 0, 0x8400);
+        Packet.Len = MDNS_MAX_PACKET-Space;
+        Count = PutRecords (&Packet, All, MDNS_TTL, true, &TestInterface);
+        CHECK (Packet.Len<=MDNS_MAX_PACKET);
+        if (Count<Total)
+        {
+            // Nothing is added once the packet is full, even a record which would fit
+            CHECK (Packet.Full);
+            CHECK (PutRecords (&Packet, RR_ADDRESS, MDNS_TTL, true, &TestInterface)==0);
+            CHECK (Packet.Len<=MDNS_MAX_PACKET);
+        }
+    }
+}  // TestPutRecordsBound
+// -------------------------------------------------------------
+
+//! One-shot query (not from port 5353) : its questions are sent back with the answers
+static void TestLegacyQuery (void)
+{
+    uint8_t Query [MDNS_MAX_PACKET];
+    uint8_t Reply [MDNS_MAX_PACKET+1];
+    const TMDNS_Header* Header = (const TMDNS_Header*)Reply;
+    unsigned int QueryLen;
+    unsigned int ReplyLen;
+
+    // Largest query which is still answered
+    QueryLen = BuildQuery (Query, MDNS_LEGACY_MAX_QUESTIONS, MDNS_LEGACY_MAX_QUESTION_BYTES,
+                           Instances[0].Name, Instances[0].NameLen, DNS_TYPE_ANY);
+    CHECK (QueryLen==sizeof(TMDNS_Header)+MDNS_LEGACY_MAX_QUESTION_BYTES);
+    ProcessQuery (Query, QueryLen, &ReplyAddress, &TestInterface);
+    ReplyLen = ReadReply (Reply, sizeof(Reply));
+    CHECK (ReplyLen>0);
+    CHECK (ReplyLen<=MDNS_MAX_PACKET);
+    CHECK (IsWellFormed (Reply, ReplyLen));
+    CHECK (ntohs(Header->Questions)==MDNS_LEGACY_MAX_QUESTIONS);
+    CHECK (ntohs(Header->AnswerRRs)==2);
+    CHECK ((ntohs(Header->Flags)&DNS_FLAG_TC)==0);
+
+    // Too many questions, too many bytes of questions : not answered
+    QueryLen = BuildQuery (Query, MDNS_LEGACY_MAX_QUESTIONS+1, MDNS_LEGACY_MAX_QUESTION_BYTES,
+                           Instances[0].Name, Instances[0].NameLen, DNS_TYPE_ANY);
+    ProcessQuery (Query, QueryLen, &ReplyAddress, &TestInterface);
+    CHECK (ReadReply (Reply, sizeof(Reply))==0);
+
+    QueryLen = BuildQuery (Query, MDNS_LEGACY_MAX_QUESTIONS, MDNS_MAX_PACKET/2,
+                           Instances[0].Name, Instances[0].NameLen, DNS_TYPE_ANY);
+    ProcessQuery (Query, QueryLen, &ReplyAddress, &TestInterface);
+    CHECK (ReadReply (Reply, sizeof(Reply))==0);
+}  // TestLegacyQuery
+// -------------------------------------------------------------
+
+//! Every session has its own instance : the service type lists all of them, each SRV record gives the port
+//! of its session and each ProductInstanceId is different
+static void TestServiceInstances (void)
+{
+    uint8_t Query [MDNS_MAX_PACKET];
+    uint8_t Reply [MDNS_MAX_PACKET+1];
+    const TMDNS_Header* Header = (const TMDNS_Header*)Reply;
+    uint8_t Name [MDNS_MAX_NAME];
+    unsigned int NameLen;
+    unsigned int Pos;
+    unsigned int QueryLen;
+    unsigned int ReplyLen;
+
+    QueryLen = BuildQuery (Query, 1, ServiceNameLen+4, ServiceName, ServiceNameLen, DNS_TYPE_PTR);
+    ProcessQuery (Query, QueryLen, &ReplyAddress, &TestInterface);
+    ReplyLen = ReadReply (Reply, sizeof(Reply));
+    CHECK (IsWellFormed (Reply, ReplyLen));
+    CHECK (ntohs(Header->AnswerRRs)==MDNS_MAX_INSTANCES);
+
+    for (unsigned int i=0; i<MDNS_MAX_INSTANCES; i++)
+    {
+        QueryLen = BuildQuery (Query, 1, Instances[i].NameLen+4, Instances[i].Name, Instances[i].NameLen, DNS_TYPE_SRV);
+        ProcessQuery (Query, QueryLen, &ReplyAddress, &TestInterface);
+        ReplyLen = ReadReply (Reply, sizeof(Reply));
+        CHECK (IsWellFormed (Reply, ReplyLen));
+        CHECK (ntohs(Header->AnswerRRs)==1);
+
+        // Skip the question and the name of the answer : priority, weight, port
+        Pos = sizeof(TMDNS_Header);
+        CHECK ((ReadName (Reply, ReplyLen, &Pos, Name, &NameLen))&&(Pos+4<=ReplyLen));
+        Pos += 4;
+        CHECK ((ReadName (Reply, ReplyLen, &Pos, Name, &NameLen))&&(Pos+16<=ReplyLen));
+        CHECK (GetU16 (&Reply[Pos])==DNS_TYPE_SRV);
+        CHECK (GetU16 (&Reply[Pos+14])==5504+i);
+
+        for (unsigned int j=0; j<i; j++)
+            CHECK (strcmp (GetmDNSProductInstanceID (i), GetmDNSProductInstanceID (j))!=0);
+    }
+}  // TestServiceInstances
+// -------------------------------------------------------------
+
+//! Host label comes from the system host name and must be a valid DNS host label
+static void TestHostLabel (void)
+{
+    char Saved [sizeof(TargetName)];
+    char Long [2*HOST_LABEL_MAX];
+
+    memcpy (Saved, TargetName, sizeof(TargetName));
+
+    SetHostLabel ("zynthian");
+    CHECK (strcmp (TargetName, "zynthian")==0);
+    SetHostLabel ("My_Synth (2).example.org");
+    CHECK (strcmp (TargetName, "My-Synth--2")==0);
+    SetHostLabel ("-edge-");
+    CHECK (strcmp (TargetName, "edge")==0);
+    // Nothing usable : previous label is kept
+    SetHostLabel ("_.local");
+    CHECK (strcmp (TargetName, "edge")==0);
+
+    memset (Long, 'h', sizeof(Long)-1);
+    Long[sizeof(Long)-1] = 0;
+    SetHostLabel (Long);
+    CHECK (strlen (TargetName)==HOST_LABEL_MAX);
+
+    // Conflict suffix stays in the label
+    Conflicts = MDNS_MAX_CONFLICTS;
+    BuildRecords ();
+    CHECK ((HostName[0]<=63)&&(memcmp (&HostName[1+HostName[0]-3], "-10", 3)==0));
+
+    memcpy (TargetName, Saved, sizeof(TargetName));
+    Conflicts = 0;
+    BuildRecords ();
+}  // TestHostLabel
+// -------------------------------------------------------------
+
+int main (void)
+{
+    if (!SetupResponder ())
+    {
+        fprintf (stderr, "mDNSTest : can not open localhost sockets (%s)\n", strerror(errno));
+        return 1;
+    }
+
+    TestPutRecordsBound ();
+    TestLegacyQuery ();
+    TestServiceInstances ();
+    TestHostLabel ();
+
+    close (mDNSSocket);
+    close (ReplySocket);
+    if (Failures>0)
+    {
+        fprintf (stderr, "mDNSTest : %u checks failed\n", Failures);
+        return 1;
+    }
+    fprintf (stdout, "mDNSTest : all checks passed\n");
+    return 0;
+}  // main
+// -------------------------------------------------------------